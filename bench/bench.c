@@ -0,0 +1,319 @@
+#include "../src/arena.h"
+#include "../src/class.h"
+#include "../src/output.h"
+#include "../src/print.h"
+#include "../src/swap.h"
+#include <errno.h>
+#include <fcntl.h>
+#include "gen.h"
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* How much slower than the baseline a figure may get before it counts as a regression */
+#define BENCH_TOLERANCE 0.10
+
+/* Timed passes over every class; the fastest time of each class is kept to shed scheduler noise */
+#define BENCH_PASSES 5
+
+/* Entries in the table each byte-swapping kernel decodes */
+#define SWAP_TABLE 32768
+
+static const GenProfile PROFILES[] = {
+        /* name, strings, constants, fields, methods, attributes, attribute_size, string_min, string_max, skew,
+         * interfaces */
+        {"tiny", 8, 4, 1, 2, 1, 16, 3, 12, 1, 0},
+        {"typical", 300, 60, 12, 30, 2, 120, 3, 40, 2, 0},
+        {"large", 6000, 800, 200, 600, 3, 400, 4, 80, 3, 0},
+        {"strings", 2000, 200, 20, 20, 1, 32, 10, 2000, 4, 0},
+        {"tables", 20, 0, 4, 4, 1, 16, 3, 12, 1, 16000}
+};
+
+#define PROFILES_COUNT (sizeof(PROFILES) / sizeof(PROFILES[0]))
+
+/* malloc-family calls since start-up. glibc lets a program replace malloc and reach the real one underneath. */
+static uint64_t allocations;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+/* One line of results: a profile and phase */
+typedef struct {
+    char name[48];
+    double ns_per_class;
+    double mb_per_s;
+    double p50;
+    double p90;
+    double p99;
+    double allocations_per_class;
+} Result;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const uint64_t *sorted, size_t count, double p) {
+    size_t i = (size_t) (p * (count - 1) + 0.5);
+    return (double) sorted[i];
+}
+
+/* Time phase over every class: parse alone, or parse and print into out */
+static void run(Result *result, const char *const *classes, const size_t *lengths, size_t count, Arena *arena,
+                Output *out) {
+    uint64_t *best = malloc(count * sizeof(uint64_t));
+    uint64_t bytes = 0;
+    size_t c;
+    for (c = 0; c < count; c++) {
+        best[c] = UINT64_MAX;
+        bytes += lengths[c];
+    }
+    uint64_t allocated = 0;
+    int pass;
+    for (pass = 0; pass < BENCH_PASSES; pass++) {
+        uint64_t before = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+        for (c = 0; c < count; c++) {
+            Bytecode bytecode = {.data = classes[c], .length = (long) lengths[c], .index = 0};
+            ParseOptions opts = {.flags = PARSE_ZERO_COPY, .arena = arena};
+            uint64_t start = now_ns();
+            Class *
+            class = read_class_opts(&bytecode, &opts);
+            if (class != NULL && out != NULL) {
+                output_class(out,
+                class);
+            }
+            arena_reset(arena);
+            uint64_t elapsed = now_ns() - start;
+            if (elapsed < best[c]) {
+                best[c] = elapsed;
+            }
+        }
+        allocated = __atomic_load_n(&allocations, __ATOMIC_RELAXED) - before;
+    }
+    uint64_t total = 0;
+    for (c = 0; c < count; c++) {
+        total += best[c];
+    }
+    qsort(best, count, sizeof(uint64_t), compare_u64);
+    result->ns_per_class = (double) total / count;
+    result->mb_per_s = total > 0 ? bytes / (1024.0 * 1024.0) / (total / 1e9) : 0;
+    result->p50 = percentile(best, count, 0.50);
+    result->p90 = percentile(best, count, 0.90);
+    result->p99 = percentile(best, count, 0.99);
+    // the last pass runs on warmed-up arenas and buffers, as a long scan would
+    result->allocations_per_class = (double) allocated / count;
+    free(best);
+}
+
+/* Time decoding a table of SWAP_TABLE big-endian values of width bytes with kernel, repeats times */
+static void run_swap(Result *result, SwapKernel kernel, int width, long repeats) {
+    uint8_t *table = malloc(SWAP_TABLE * 4 + 1);
+    uint32_t *decoded = malloc(SWAP_TABLE * sizeof(uint32_t));
+    uint64_t *times = malloc(repeats * sizeof(uint64_t));
+    if (table == NULL || decoded == NULL || times == NULL) {
+        printf("Out of memory");
+        exit(EXIT_FAILURE);
+    }
+    long r;
+    for (r = 0; r < SWAP_TABLE * 4 + 1; r++) {
+        table[r] = (uint8_t) r;
+    }
+    swap_use(kernel);
+    uint64_t total = 0;
+    for (r = 0; r < repeats; r++) {
+        uint64_t start = now_ns();
+        // one byte in, as a table inside a class file seldom starts aligned
+        if (width == 2) {
+            swap_u2((uint16_t *) decoded, table + 1, SWAP_TABLE);
+        } else {
+            swap_u4(decoded, table + 1, SWAP_TABLE);
+        }
+        times[r] = now_ns() - start;
+        total += times[r];
+    }
+    swap_use(SWAP_BEST);
+    qsort(times, repeats, sizeof(uint64_t), compare_u64);
+    result->ns_per_class = (double) total / repeats;
+    result->mb_per_s = total > 0 ? (double) SWAP_TABLE * width * repeats / (1024.0 * 1024.0) / (total / 1e9) : 0;
+    result->p50 = percentile(times, repeats, 0.50);
+    result->p90 = percentile(times, repeats, 0.90);
+    result->p99 = percentile(times, repeats, 0.99);
+    result->allocations_per_class = 0;
+    free(table);
+    free(decoded);
+    free(times);
+}
+
+/* Look name up in a baseline written by --write-baseline. Returns false if it is not there. */
+static bool baseline_lookup(FILE *baseline, const char *name, Result *found) {
+    char line[256];
+    rewind(baseline);
+    while (fgets(line, sizeof(line), baseline) != NULL) {
+        Result r;
+        if (line[0] != '#' && sscanf(line, "%47s %lf %lf %lf %lf %lf %lf", r.name, &r.ns_per_class, &r.mb_per_s,
+                                     &r.p50, &r.p90, &r.p99, &r.allocations_per_class) == 7
+            && strcmp(r.name, name) == 0) {
+            *found = r;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Print result, compare it with its baseline figure if there is one and append it to written. Returns true if it
+ * regressed. */
+static bool report(const Result *result, FILE *baseline, FILE *written) {
+    printf("%-16s %10.0f %10.1f %10.0f %10.0f %10.0f %12.2f", result->name, result->ns_per_class,
+           result->mb_per_s, result->p50, result->p90, result->p99, result->allocations_per_class);
+    bool regressed = false;
+    Result base;
+    if (baseline != NULL && baseline_lookup(baseline, result->name, &base)) {
+        double change = base.ns_per_class > 0 ? result->ns_per_class / base.ns_per_class - 1 : 0;
+        regressed = change > BENCH_TOLERANCE || result->allocations_per_class > base.allocations_per_class + 0.5;
+        printf("  %+5.1f%%%s", change * 100, regressed ? "  REGRESSION" : "");
+    }
+    printf("\n");
+    if (written != NULL) {
+        fprintf(written, "%s %.1f %.2f %.0f %.0f %.0f %.2f\n", result->name, result->ns_per_class,
+                result->mb_per_s, result->p50, result->p90, result->p99, result->allocations_per_class);
+    }
+    return regressed;
+}
+
+int main(int argc, char *args[]) {
+    static const struct option long_options[] = {
+            {"baseline", required_argument, NULL, 'b'},
+            {"write-baseline", required_argument, NULL, 'w'},
+            {NULL, 0, NULL, 0}
+    };
+    long classes_count = 2000;
+    const char *baseline_name = NULL;
+    const char *write_name = NULL;
+    int opt;
+    while ((opt = getopt_long(argc, args, "n:", long_options, NULL)) != -1) {
+        if (opt == 'n') {
+            classes_count = strtol(optarg, NULL, 10);
+        } else if (opt == 'b') {
+            baseline_name = optarg;
+        } else if (opt == 'w') {
+            write_name = optarg;
+        }
+        if ((opt != 'n' && opt != 'b' && opt != 'w') || classes_count < 1) {
+            printf("Usage: cfr-bench [-n classes] [--baseline file] [--write-baseline file]\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    FILE *baseline = baseline_name != NULL ? fopen(baseline_name, "r") : NULL;
+    if (baseline_name != NULL && baseline == NULL) {
+        fprintf(stderr, "Could not open baseline '%s': %s\n", baseline_name, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    FILE *written = write_name != NULL ? fopen(write_name, "w") : NULL;
+    if (write_name != NULL && written == NULL) {
+        fprintf(stderr, "Could not write baseline '%s': %s\n", write_name, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (written != NULL) {
+        fprintf(written, "# name ns/class MB/s p50 p90 p99 allocations/class\n");
+    }
+
+    // printed text goes to /dev/null through the same buffered Output a run uses
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    Output out;
+    Arena arena;
+    if (null_fd < 0 || !output_init(&out, null_fd, OUTPUT_BUFFER) || !arena_init(&arena, ARENA_MIN_BLOCK * 16)) {
+        printf("Out of memory");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%-16s %10s %10s %10s %10s %10s %12s\n", "benchmark", "ns/class", "MB/s", "p50 ns", "p90 ns", "p99 ns",
+           "allocs/class");
+    int regressions = 0;
+    size_t p;
+    for (p = 0; p < PROFILES_COUNT; p++) {
+        char **classes = malloc(classes_count * sizeof(char *));
+        size_t *lengths = malloc(classes_count * sizeof(size_t));
+        long c;
+        for (c = 0; c < classes_count; c++) {
+            classes[c] = gen_class(PROFILES + p, (uint64_t) c, lengths + c);
+            if (classes[c] == NULL) {
+                printf("Could not generate profile %s\n", PROFILES[p].name);
+                exit(EXIT_FAILURE);
+            }
+        }
+        int phase;
+        for (phase = 0; phase < 2; phase++) {
+            Result result;
+            snprintf(result.name, sizeof(result.name), "%s/%s", PROFILES[p].name, phase == 0 ? "parse" : "print");
+            run(&result, (const char *const *) classes, lengths, classes_count, &arena, phase == 0 ? NULL : &out);
+            output_flush(&out);
+            regressions += report(&result, baseline, written);
+        }
+        for (c = 0; c < classes_count; c++) {
+            free(classes[c]);
+        }
+        free(classes);
+        free(lengths);
+    }
+
+    // the byte-swapping kernels on their own, each that the CPU supports; ns/class is per table of SWAP_TABLE
+    SwapKernel kernel;
+    for (kernel = SWAP_SCALAR; kernel <= SWAP_AVX2; kernel++) {
+        if (swap_use(kernel) != kernel) {
+            continue;
+        }
+        int width;
+        for (width = 2; width <= 4; width += 2) {
+            Result result;
+            snprintf(result.name, sizeof(result.name), "swap-u%d/%s", width, swap_kernel_name(kernel));
+            run_swap(&result, kernel, width, classes_count);
+            regressions += report(&result, baseline, written);
+        }
+    }
+    swap_use(SWAP_BEST);
+
+    if (baseline != NULL) {
+        fclose(baseline);
+    }
+    if (written != NULL) {
+        fclose(written);
+    }
+    output_free(&out);
+    arena_destroy(&arena);
+    close(null_fd);
+    if (regressions > 0) {
+        printf("%d benchmark(s) regressed by more than %.0f%% against %s\n", regressions, BENCH_TOLERANCE * 100,
+               baseline_name);
+        exit(EXIT_FAILURE);
+    }
+    exit(EXIT_SUCCESS);
+}
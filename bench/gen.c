@@ -0,0 +1,193 @@
+#include "gen.h"
+#include "../src/output.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Fixed entries at the start of every generated pool */
+enum {
+    POOL_THIS_NAME = 1,
+    POOL_THIS,
+    POOL_SUPER_NAME,
+    POOL_SUPER,
+    POOL_SOURCE_FILE,
+    POOL_CODE,
+    POOL_CONSTANT_VALUE,
+    POOL_SOURCE,
+    POOL_DESCRIPTORS /* the first of DESCRIPTORS_COUNT descriptors */
+};
+
+static const char *DESCRIPTORS[] = {"I", "J", "Ljava/lang/String;", "()V", "(I)I", "(Ljava/lang/Object;)Z"};
+
+#define DESCRIPTORS_COUNT (sizeof(DESCRIPTORS) / sizeof(DESCRIPTORS[0]))
+
+/* Characters of generated strings. An occasional two byte é is mixed in so non-ASCII paths are exercised too. */
+static const char ALPHABET[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_$";
+
+static uint64_t next(uint64_t *state) {
+    // xorshift64*
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ull;
+}
+
+static uint32_t below(uint64_t *state, uint32_t bound) {
+    return bound > 0 ? (uint32_t) (next(state) % bound) : 0;
+}
+
+static void u1(Output *out, uint8_t value) {
+    output_char(out, (char) value);
+}
+
+static void u2(Output *out, uint16_t value) {
+    u1(out, value >> 8);
+    u1(out, value & 0xff);
+}
+
+static void u4(Output *out, uint32_t value) {
+    u2(out, value >> 16);
+    u2(out, value & 0xffff);
+}
+
+static void utf8(Output *out, const char *value, size_t length) {
+    u1(out, 1);
+    u2(out, (uint16_t) length);
+    output_bytes(out, value, length);
+}
+
+static void random_utf8(Output *out, const GenProfile *profile, uint64_t *state) {
+    double u = (double) below(state, 1u << 30) / (1u << 30);
+    uint32_t span = profile->string_max - profile->string_min;
+    uint32_t length = profile->string_min + (uint32_t) (span * pow(u, profile->string_skew > 0 ? profile->string_skew : 1));
+    u1(out, 1);
+    u2(out, (uint16_t) length);
+    uint32_t i = 0;
+    while (i < length) {
+        if (length - i >= 2 && below(state, 64) == 0) {
+            // é, two bytes of Modified UTF-8
+            output_bytes(out, "\xc3\xa9", 2);
+            i += 2;
+        } else {
+            output_char(out, ALPHABET[below(state, sizeof(ALPHABET) - 1)]);
+            i++;
+        }
+    }
+}
+
+static void random_bytes(Output *out, uint64_t *state, uint32_t length) {
+    uint32_t i;
+    for (i = 0; i < length; i++) {
+        u1(out, (uint8_t) next(state));
+    }
+}
+
+char *gen_class(const GenProfile *profile, uint64_t seed, size_t *length) {
+    uint64_t state = seed * 0x9e3779b97f4a7c15ull + 1;
+    uint32_t strings_start = POOL_DESCRIPTORS + DESCRIPTORS_COUNT;
+    // every fourth constant is a Long or Double, which take two entries
+    uint32_t constants_entries = profile->constants + (profile->constants + 1) / 4;
+    uint32_t pool_count = strings_start + profile->strings + constants_entries;
+    if (pool_count > UINT16_MAX || profile->string_max > UINT16_MAX || profile->string_min > profile->string_max) {
+        return NULL;
+    }
+    Output out;
+    if (!output_init(&out, -1, 4096)) {
+        return NULL;
+    }
+    u4(&out, 0xcafebabe);
+    u2(&out, 0);
+    u2(&out, 51);
+    u2(&out, (uint16_t) pool_count);
+
+    char name[32];
+    int name_length = snprintf(name, sizeof(name), "bench/Gen%llu", (unsigned long long) seed);
+    utf8(&out, name, name_length);
+    u1(&out, 7);
+    u2(&out, POOL_THIS_NAME);
+    utf8(&out, "java/lang/Object", 16);
+    u1(&out, 7);
+    u2(&out, POOL_SUPER_NAME);
+    utf8(&out, "SourceFile", 10);
+    utf8(&out, "Code", 4);
+    utf8(&out, "ConstantValue", 13);
+    utf8(&out, "Gen.java", 8);
+    uint32_t i;
+    for (i = 0; i < DESCRIPTORS_COUNT; i++) {
+        utf8(&out, DESCRIPTORS[i], strlen(DESCRIPTORS[i]));
+    }
+    for (i = 0; i < profile->strings; i++) {
+        random_utf8(&out, profile, &state);
+    }
+    for (i = 0; i < profile->constants; i++) {
+        switch (i % 4) {
+            case 0:
+                u1(&out, 3);
+                u4(&out, (uint32_t) next(&state));
+                break;
+            case 1:
+                u1(&out, 4);
+                u4(&out, 0x3fc00000); // 1.5f
+                break;
+            case 2:
+                u1(&out, i % 8 == 2 ? 5 : 6);
+                u4(&out, (uint32_t) next(&state));
+                u4(&out, (uint32_t) next(&state));
+                break;
+            default:
+                u1(&out, 8);
+                u2(&out, (uint16_t) (profile->strings > 0 ? strings_start + below(&state, profile->strings)
+                                                          : POOL_SOURCE));
+                break;
+        }
+    }
+
+    u2(&out, 0x0021);
+    u2(&out, POOL_THIS);
+    u2(&out, POOL_SUPER);
+    // a parser does not check what an interface entry names, so they can all share a Class constant
+    u2(&out, profile->interfaces);
+    for (i = 0; i < profile->interfaces; i++) {
+        u2(&out, POOL_SUPER);
+    }
+
+    u2(&out, profile->fields);
+    for (i = 0; i < profile->fields; i++) {
+        u2(&out, 0x0002);
+        u2(&out, (uint16_t) (profile->strings > 0 ? strings_start + below(&state, profile->strings) : POOL_SOURCE));
+        u2(&out, (uint16_t) (POOL_DESCRIPTORS + below(&state, 3)));
+        u2(&out, 1);
+        u2(&out, POOL_CONSTANT_VALUE);
+        u4(&out, 2);
+        u2(&out, POOL_DESCRIPTORS);
+    }
+
+    u2(&out, profile->methods);
+    for (i = 0; i < profile->methods; i++) {
+        u2(&out, 0x0001);
+        u2(&out, (uint16_t) (profile->strings > 0 ? strings_start + below(&state, profile->strings) : POOL_SOURCE));
+        u2(&out, (uint16_t) (POOL_DESCRIPTORS + 3 + below(&state, 3)));
+        u2(&out, profile->attributes);
+        uint16_t a;
+        for (a = 0; a < profile->attributes; a++) {
+            u2(&out, a == 0 ? POOL_CODE : POOL_SOURCE_FILE);
+            u4(&out, profile->attribute_size);
+            random_bytes(&out, &state, profile->attribute_size);
+        }
+    }
+
+    u2(&out, 1);
+    u2(&out, POOL_SOURCE_FILE);
+    u4(&out, 2);
+    u2(&out, POOL_SOURCE);
+
+    if (out.err != 0) {
+        output_free(&out);
+        return NULL;
+    }
+    *length = out.length;
+    return out.data;
+}
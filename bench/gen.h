@@ -0,0 +1,29 @@
+#ifndef GEN_H
+#define GEN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* The shape of the synthetic classes a benchmark runs over */
+typedef struct {
+    const char *name;
+    uint32_t strings; /* random UTF8 constants, used for member names and String constants */
+    uint32_t constants; /* Integer, Float, Long, Double and String constants, taken in turn */
+    uint16_t fields;
+    uint16_t methods;
+    uint16_t attributes; /* per method, the first a Code attribute and the rest opaque */
+    uint32_t attribute_size; /* payload bytes of every method attribute */
+    uint32_t string_min;
+    uint32_t string_max;
+    /* 1 spreads string lengths evenly between min and max; larger values skew them towards min, as in real pools */
+    double string_skew;
+    uint16_t interfaces; /* entries of the interfaces table */
+} GenProfile;
+
+/* Generate a valid class file of the given profile. The same seed always gives the same bytes. Returns a malloc'd
+ * buffer of *length bytes, or NULL if memory ran out or the profile needs more than 65535 constant pool entries. */
+char *gen_class(const GenProfile *profile, uint64_t seed, size_t *length);
+
+#endif //GEN_H
@@ -0,0 +1,138 @@
+#include "arena.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stats.h"
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t size; /* usable bytes in data */
+    size_t used;
+    char data[];
+};
+
+static ArenaBlock *new_block(const ArenaAllocator *allocator, size_t size) {
+    STATS_ADD(STATS_ARENA_BLOCKS, 1);
+    ArenaBlock *block = allocator->alloc != NULL ? allocator->alloc(allocator->ctx, sizeof(ArenaBlock) + size)
+                                                 : malloc(sizeof(ArenaBlock) + size);
+    if (block != NULL) {
+        block->next = NULL;
+        block->size = size;
+        block->used = 0;
+    }
+    return block;
+}
+
+static void free_blocks(ArenaBlock *block, const ArenaAllocator *allocator) {
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        if (allocator->free != NULL) {
+            allocator->free(allocator->ctx, block);
+        } else if (allocator->alloc == NULL) {
+            free(block);
+        }
+        block = next;
+    }
+}
+
+/* Bytes needed to serve size from a fresh block whatever its data alignment */
+static size_t padded(size_t size) {
+    return size + ARENA_ALIGN - 1;
+}
+
+bool arena_init(Arena *arena, size_t size) {
+    return arena_init_with(arena, size, NULL);
+}
+
+bool arena_init_with(Arena *arena, size_t size, const ArenaAllocator *allocator) {
+    if (size < ARENA_MIN_BLOCK) {
+        size = ARENA_MIN_BLOCK;
+    }
+    if (allocator != NULL) {
+        arena->allocator = *allocator;
+    } else {
+        memset(&arena->allocator, 0, sizeof(arena->allocator));
+    }
+    arena->head = new_block(&arena->allocator, size);
+    arena->block_size = size;
+    arena->allocated = 0;
+    arena->blocks = arena->head != NULL ? 1 : 0;
+    arena->exhausted = arena->head == NULL;
+    return arena->head != NULL;
+}
+
+Arena *arena_create(size_t size) {
+    Arena tmp;
+    if (!arena_init(&tmp, size + padded(sizeof(Arena)))) {
+        return NULL;
+    }
+    Arena *arena = arena_alloc(&tmp, sizeof(Arena));
+    *arena = tmp;
+    return arena;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    ArenaBlock *block = arena->head;
+    if (block != NULL) {
+        uintptr_t start = (uintptr_t) (block->data + block->used);
+        size_t pad = (ARENA_ALIGN - (start & (ARENA_ALIGN - 1))) & (ARENA_ALIGN - 1);
+        if (pad + size <= block->size - block->used) {
+            block->used += pad + size;
+            arena->allocated += size;
+            return (void *) (start + pad);
+        }
+    }
+
+    // grow geometrically so a badly sized first block costs O(log n) mallocs
+    size_t want = arena->block_size * 2;
+    if (want < padded(size)) {
+        want = padded(size);
+    }
+    ArenaBlock *fresh = new_block(&arena->allocator, want);
+    if (fresh == NULL) {
+        arena->exhausted = true;
+        return NULL;
+    }
+    fresh->next = block;
+    arena->head = fresh;
+    arena->block_size = want;
+    arena->blocks++;
+    return arena_alloc(arena, size);
+}
+
+void *arena_calloc(Arena *arena, size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        arena->exhausted = true;
+        return NULL;
+    }
+    void *p = arena_alloc(arena, count * size);
+    if (p != NULL) {
+        memset(p, 0, count * size);
+    }
+    return p;
+}
+
+void arena_reset(Arena *arena) {
+    ArenaBlock *block = arena->head;
+    arena->exhausted = false;
+    if (block != NULL && block->next == NULL) {
+        block->used = 0;
+        arena->allocated = 0;
+        return;
+    }
+
+    size_t total = 0;
+    for (; block != NULL; block = block->next) {
+        total += block->size;
+    }
+    ArenaAllocator allocator = arena->allocator;
+    free_blocks(arena->head, &allocator);
+    arena_init_with(arena, total, &allocator);
+}
+
+void arena_destroy(Arena *arena) {
+    // arena may live inside one of these blocks, so read nothing from it once freeing starts
+    ArenaAllocator allocator = arena->allocator;
+    free_blocks(arena->head, &allocator);
+}
@@ -0,0 +1,57 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Alignment of every pointer returned by arena_alloc() */
+#define ARENA_ALIGN 16
+
+/* Smallest block an arena will request from malloc */
+#define ARENA_MIN_BLOCK 4096
+
+typedef struct ArenaBlock ArenaBlock;
+
+/* Where an arena gets its blocks from. ctx is passed back on every call. free may be NULL for allocators that release
+ * their memory in bulk. */
+typedef struct {
+    void *(*alloc)(void *ctx, size_t size);
+    void (*free)(void *ctx, void *ptr);
+    void *ctx;
+} ArenaAllocator;
+
+/* A bump allocator. Memory is handed out from large blocks and only ever released all at once. */
+typedef struct {
+    ArenaBlock *head; /* the block being filled, older blocks follow head->next */
+    size_t block_size; /* size of the next block to be malloc'd */
+    size_t allocated; /* bytes handed out since the last reset */
+    uint32_t blocks; /* blocks currently held */
+    bool exhausted; /* set when an allocation has failed since the last reset */
+    ArenaAllocator allocator; /* alloc is NULL for malloc and free */
+} Arena;
+
+/* Initialise a caller-owned arena whose first block holds at least size bytes. Returns false if memory ran out. */
+bool arena_init(Arena *arena, size_t size);
+
+/* As arena_init() but taking blocks from allocator, which may be NULL for malloc and free */
+bool arena_init_with(Arena *arena, size_t size, const ArenaAllocator *allocator);
+
+/* Create an arena that lives inside its own first block. Release it with arena_destroy(), never arena_reset(). */
+Arena *arena_create(size_t size);
+
+/* Return size bytes aligned to ARENA_ALIGN, or NULL if memory ran out */
+void *arena_alloc(Arena *arena, size_t size);
+
+/* As arena_alloc() but for count zeroed members of size bytes each */
+void *arena_calloc(Arena *arena, size_t count, size_t size);
+
+/* Forget every allocation so the arena can be reused. Memory is kept in a single block large enough for
+ * everything allocated since the last reset, so a loop over similar inputs settles on one malloc'd block. */
+void arena_reset(Arena *arena);
+
+/* Free every block. An arena from arena_init() may be initialised again afterwards. */
+void arena_destroy(Arena *arena);
+
+#endif //ARENA_H
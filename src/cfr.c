@@ -0,0 +1,337 @@
+#include "cfr.h"
+#include "arena.h"
+#include "class.h"
+#include <errno.h>
+#include "input.h"
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct CfrClass {
+    Arena arena; /* holds the Class and, unless borrowed, copies of its payloads */
+    Class *class;
+    Input input; /* what cfr_open_fd() read, empty for a buffer */
+    CfrAllocator allocator; /* alloc is NULL for malloc and free */
+};
+
+static const char *ERRORS[] = {
+        [CFR_OK] = "success",
+        [CFR_ERR_ARGUMENT] = "invalid argument",
+        [CFR_ERR_NOMEM] = "out of memory",
+        [CFR_ERR_IO] = "input could not be read",
+        [CFR_ERR_NOT_CLASS] = "not a class file",
+        [CFR_ERR_MALFORMED] = "malformed class file",
+        [CFR_ERR_TRUNCATED] = "truncated class file"
+};
+
+uint32_t cfr_api_version(void) {
+    return CFR_API_VERSION;
+}
+
+const char *cfr_strerror(CfrError err) {
+    return (unsigned) err < sizeof(ERRORS) / sizeof(ERRORS[0]) ? ERRORS[err] : "unknown error";
+}
+
+/* Allocate an empty handle whose arena takes its blocks from the same allocator */
+static CfrClass *create(const CfrOptions *opts, size_t length) {
+    CfrAllocator allocator = {NULL, NULL, NULL};
+    if (opts != NULL && opts->allocator != NULL) {
+        allocator = *opts->allocator;
+    }
+    CfrClass *cls = allocator.alloc != NULL ? allocator.alloc(allocator.ctx, sizeof(CfrClass))
+                                            : malloc(sizeof(CfrClass));
+    if (cls == NULL) {
+        return NULL;
+    }
+    memset(cls, 0, sizeof(CfrClass));
+    cls->allocator = allocator;
+    // the same sizing read_class() uses for its own arenas: payload copies plus the decoded tables
+    ArenaAllocator blocks = {allocator.alloc, allocator.free, allocator.ctx};
+    if (!arena_init_with(&cls->arena, 2 * length + ARENA_MIN_BLOCK, &blocks)) {
+        cfr_free(cls);
+        return NULL;
+    }
+    return cls;
+}
+
+/* Parse length bytes at data into cls */
+static CfrError parse(CfrClass *cls, const char *data, size_t length, uint32_t flags) {
+    if (length < 4 || !is_class(&(Bytecode) {.data = data, .length = 4, .index = 0})) {
+        return CFR_ERR_NOT_CLASS;
+    }
+    if (length > INT_MAX) {
+        return CFR_ERR_MALFORMED;
+    }
+    Bytecode bytecode = {.data = data, .length = (long) length, .index = 0};
+    ParseOptions parse_opts = {.flags = flags, .arena = &cls->arena};
+    int err = read_class_err(&bytecode, &parse_opts, &cls->class);
+    switch (err) {
+        case 0:
+            return CFR_OK;
+        case ENOMEM:
+            return CFR_ERR_NOMEM;
+        case ENODATA:
+            return CFR_ERR_TRUNCATED;
+        default:
+            return CFR_ERR_MALFORMED;
+    }
+}
+
+CfrError cfr_open_buffer(CfrClass **cls, const void *data, size_t length, const CfrOptions *opts) {
+    if (cls == NULL) {
+        return CFR_ERR_ARGUMENT;
+    }
+    *cls = NULL;
+    if ((data == NULL && length > 0) || (opts != NULL && (opts->flags & ~(CFR_BORROW | CFR_STRICT)) != 0)) {
+        return CFR_ERR_ARGUMENT;
+    }
+    CfrClass *created = create(opts, length);
+    if (created == NULL) {
+        return CFR_ERR_NOMEM;
+    }
+    uint32_t flags = opts != NULL ? opts->flags : 0;
+    CfrError err = parse(created, data, length,
+                         ((flags & CFR_BORROW) ? PARSE_ZERO_COPY : 0) | ((flags & CFR_STRICT) ? PARSE_STRICT_UTF8 : 0));
+    if (err != CFR_OK) {
+        cfr_free(created);
+        return err;
+    }
+    *cls = created;
+    return CFR_OK;
+}
+
+CfrError cfr_open_fd(CfrClass **cls, int fd, const CfrOptions *opts) {
+    if (cls == NULL) {
+        return CFR_ERR_ARGUMENT;
+    }
+    *cls = NULL;
+    if (fd < 0 || (opts != NULL && (opts->flags & ~(CFR_BORROW | CFR_STRICT)) != 0)) {
+        return CFR_ERR_ARGUMENT;
+    }
+    Input input;
+    int err = input_open_fd(&input, fd);
+    if (err != 0) {
+        errno = err;
+        return err == ENOMEM ? CFR_ERR_NOMEM : CFR_ERR_IO;
+    }
+    CfrClass *created = create(opts, 0);
+    if (created == NULL) {
+        input_close(&input);
+        return CFR_ERR_NOMEM;
+    }
+    // the handle keeps the input, so nothing needs copying out of it
+    created->input = input;
+    bool strict = opts != NULL && (opts->flags & CFR_STRICT);
+    CfrError parsed = parse(created, input.data, input.length, PARSE_ZERO_COPY | (strict ? PARSE_STRICT_UTF8 : 0));
+    if (parsed != CFR_OK) {
+        cfr_free(created);
+        return parsed;
+    }
+    *cls = created;
+    return CFR_OK;
+}
+
+void cfr_free(CfrClass *cls) {
+    if (cls == NULL) {
+        return;
+    }
+    arena_destroy(&cls->arena);
+    input_close(&cls->input);
+    if (cls->allocator.free != NULL) {
+        cls->allocator.free(cls->allocator.ctx, cls);
+    } else if (cls->allocator.alloc == NULL) {
+        free(cls);
+    }
+}
+
+uint16_t cfr_major_version(const CfrClass *cls) {
+    return cls != NULL ? cls->class->major_version : 0;
+}
+
+uint16_t cfr_minor_version(const CfrClass *cls) {
+    return cls != NULL ? cls->class->minor_version : 0;
+}
+
+uint16_t cfr_access_flags(const CfrClass *cls) {
+    return cls != NULL ? cls->class->flags : 0;
+}
+
+/* Set *string to the UTF-8 constant at index */
+static CfrError utf8_at(const Class *class, uint16_t index, CfrString *string) {
+    Item item = get_item(
+    class, index);
+    if (item.tag != STRING_UTF8) {
+        return CFR_ERR_MALFORMED;
+    }
+    string->data = item.value.string.value;
+    string->length = item.value.string.length;
+    return CFR_OK;
+}
+
+/* Set *name to the name of the Class constant at index */
+static CfrError class_name_at(const Class *class, uint16_t index, CfrString *name) {
+    Item item = get_item(
+    class, index);
+    if (item.tag != CLASS) {
+        return CFR_ERR_MALFORMED;
+    }
+    return utf8_at(
+    class, item.value.ref.class_idx, name);
+}
+
+CfrError cfr_name(const CfrClass *cls, CfrString *name) {
+    if (cls == NULL || name == NULL) {
+        return CFR_ERR_ARGUMENT;
+    }
+    return class_name_at(cls->class, cls->class->this_class, name);
+}
+
+CfrError cfr_super_name(const CfrClass *cls, CfrString *name) {
+    if (cls == NULL || name == NULL) {
+        return CFR_ERR_ARGUMENT;
+    }
+    if (cls->class->super_class == 0) {
+        name->data = "";
+        name->length = 0;
+        return CFR_OK;
+    }
+    return class_name_at(cls->class, cls->class->super_class, name);
+}
+
+uint16_t cfr_interfaces_count(const CfrClass *cls) {
+    return cls != NULL ? cls->class->interfaces_count : 0;
+}
+
+CfrError cfr_interface_name(const CfrClass *cls, uint16_t index, CfrString *name) {
+    if (cls == NULL || name == NULL || index >= cls->class->interfaces_count) {
+        return CFR_ERR_ARGUMENT;
+    }
+    return class_name_at(cls->class, cls->class->interfaces[index], name);
+}
+
+uint16_t cfr_fields_count(const CfrClass *cls) {
+    return cls != NULL ? cls->class->fields_count : 0;
+}
+
+/* Fill *member from the parts fields and methods share */
+static CfrError fill_member(const Class *class, uint16_t flags, uint16_t name_idx, uint16_t desc_idx, uint16_t attrs_count,
+                       CfrMember *member) {
+    member->access_flags = flags;
+    member->attributes_count = attrs_count;
+    CfrError err = utf8_at(
+    class, name_idx, &member->name);
+    return err != CFR_OK ? err : utf8_at(
+    class, desc_idx, &member->descriptor);
+}
+
+CfrError cfr_field(const CfrClass *cls, uint16_t index, CfrMember *field) {
+    if (cls == NULL || field == NULL || index >= cls->class->fields_count) {
+        return CFR_ERR_ARGUMENT;
+    }
+    const Field *f = cls->class->fields + index;
+    return fill_member(cls->class, f->flags, f->name_idx, f->desc_idx, f->attrs_count, field);
+}
+
+uint16_t cfr_methods_count(const CfrClass *cls) {
+    return cls != NULL ? cls->class->methods_count : 0;
+}
+
+CfrError cfr_method(const CfrClass *cls, uint16_t index, CfrMember *method) {
+    if (cls == NULL || method == NULL || index >= cls->class->methods_count) {
+        return CFR_ERR_ARGUMENT;
+    }
+    const Method *m = cls->class->methods + index;
+    return fill_member(cls->class, m->flags, m->name_idx, m->desc_idx, m->attrs_count, method);
+}
+
+/* The attribute table of owner, or NULL if there is no such owner */
+static const Attribute *attributes_of(const Class *class, CfrOwner owner, uint16_t member, uint16_t *count) {
+    switch (owner) {
+        case CFR_OWNER_CLASS:
+            *count =
+            class->attributes_count;
+            return
+            class->attributes;
+        case CFR_OWNER_FIELD:
+            if (member >= class->fields_count) {
+                return NULL;
+            }
+            *count =
+            class->fields[member].attrs_count;
+            return
+            class->fields[member].attrs;
+        case CFR_OWNER_METHOD:
+            if (member >= class->methods_count) {
+                return NULL;
+            }
+            *count =
+            class->methods[member].attrs_count;
+            return
+            class->methods[member].attrs;
+        default:
+            return NULL;
+    }
+}
+
+uint16_t cfr_attributes_count(const CfrClass *cls, CfrOwner owner, uint16_t member) {
+    uint16_t count = 0;
+    if (cls == NULL || attributes_of(cls->class, owner, member, &count) == NULL) {
+        return 0;
+    }
+    return count;
+}
+
+CfrError cfr_attribute(const CfrClass *cls, CfrOwner owner, uint16_t member, uint16_t index,
+                       CfrAttribute *attribute) {
+    uint16_t count = 0;
+    const Attribute *attrs = cls != NULL && attribute != NULL ? attributes_of(cls->class, owner, member, &count) : NULL;
+    if (attrs == NULL || index >= count) {
+        return CFR_ERR_ARGUMENT;
+    }
+    attribute->data = (const uint8_t *) attrs[index].info;
+    attribute->length = attrs[index].length;
+    return utf8_at(cls->class, attrs[index].name_idx, &attribute->name);
+}
+
+uint16_t cfr_constant_pool_count(const CfrClass *cls) {
+    return cls != NULL ? cls->class->const_pool_count : 0;
+}
+
+CfrError cfr_constant(const CfrClass *cls, uint16_t index, CfrConstant *constant) {
+    if (cls == NULL || constant == NULL || index == 0 || index >= cls->class->const_pool_count) {
+        return CFR_ERR_ARGUMENT;
+    }
+    Item item = get_item(cls->class, index);
+    uint64_t bits;
+    memset(constant, 0, sizeof(CfrConstant));
+    constant->tag = item.tag;
+    switch (item.tag) {
+        case 0: // the second entry of a Long or Double
+            break;
+        case STRING_UTF8:
+            constant->value.utf8.data = item.value.string.value;
+            constant->value.utf8.length = item.value.string.length;
+            break;
+        case INTEGER:
+            constant->value.integer = item.value.integer;
+            break;
+        case FLOAT:
+            constant->value.flt = item.value.flt;
+            break;
+        case LONG:
+            bits = (uint64_t) item.value.lng.high << 32 | item.value.lng.low;
+            constant->value.lng = (int64_t) bits;
+            break;
+        case DOUBLE:
+            bits = (uint64_t) item.value.dbl.high << 32 | item.value.dbl.low;
+            memcpy(&constant->value.dbl, &bits, sizeof(bits));
+            break;
+        default:
+            constant->value.ref.first = item.value.ref.class_idx;
+            constant->value.ref.second = item.value.ref.name_idx;
+            break;
+    }
+    return CFR_OK;
+}
@@ -0,0 +1,166 @@
+#ifndef CFR_H
+#define CFR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The embedding API of libcfr. Classes are opaque handles; everything a caller sees is plain data, so the layout of
+ * the parser's own structs may change without breaking binaries built against this header.
+ *
+ * The library keeps no mutable global state: any number of threads may open, query and free classes at once, as long
+ * as a single handle is not freed while another thread is using it. Queries change nothing a caller can see; the
+ * only state they update is a handle's cache of what kind each UTF-8 entry is, and they do so atomically. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped whenever this header changes incompatibly */
+#define CFR_API_VERSION 1
+
+#if defined(__GNUC__)
+#define CFR_API __attribute__((visibility("default")))
+#else
+#define CFR_API
+#endif
+
+/* Why a call failed. 0 is success, so results can be tested as booleans. */
+typedef enum {
+    CFR_OK = 0,
+    CFR_ERR_ARGUMENT = 1,  /* a NULL pointer, an index out of range or an unknown option */
+    CFR_ERR_NOMEM = 2,     /* the allocator returned NULL */
+    CFR_ERR_IO = 3,        /* the descriptor could not be read; errno says why */
+    CFR_ERR_NOT_CLASS = 4, /* the input does not start with the class file magic 0xcafebabe */
+    CFR_ERR_MALFORMED = 5, /* the input is a class file the parser cannot make sense of */
+    CFR_ERR_TRUNCATED = 6  /* the input ends part way through the class file */
+} CfrError;
+
+/* Memory for a class comes in large blocks from alloc and goes back through free when the class is freed. Both are
+ * called with ctx, from whichever thread opens or frees the class. free may be NULL if the caller releases everything
+ * alloc returned in bulk, e.g. a per-request pool. */
+typedef struct {
+    void *(*alloc)(void *ctx, size_t size);
+    void (*free)(void *ctx, void *ptr);
+    void *ctx;
+} CfrAllocator;
+
+/* Flags for CfrOptions.flags */
+typedef enum {
+    /* View strings and attributes in the caller's buffer instead of copying them. The buffer must then stay unchanged
+     * until the class is freed. Ignored by cfr_open_fd(), which always keeps its input. */
+    CFR_BORROW = 0x01,
+    /* Fail with CFR_ERR_MALFORMED on constant pool strings that are not well-formed Modified UTF-8, as the JVM does */
+    CFR_STRICT = 0x02
+} CfrFlags;
+
+typedef struct {
+    uint32_t flags;
+    const CfrAllocator *allocator; /* NULL for malloc and free; copied, so it need not outlive the call */
+} CfrOptions;
+
+/* A parsed class file */
+typedef struct CfrClass CfrClass;
+
+/* Bytes of a constant pool string in the class file's Modified UTF-8. Not NUL-terminated. */
+typedef struct {
+    const char *data;
+    size_t length;
+} CfrString;
+
+/* A field or method */
+typedef struct {
+    uint16_t access_flags;
+    CfrString name;
+    CfrString descriptor;
+    uint16_t attributes_count;
+} CfrMember;
+
+typedef struct {
+    CfrString name;
+    const uint8_t *data;
+    uint32_t length;
+} CfrAttribute;
+
+/* What an attribute table belongs to */
+typedef enum {
+    CFR_OWNER_CLASS = 0,
+    CFR_OWNER_FIELD = 1,
+    CFR_OWNER_METHOD = 2
+} CfrOwner;
+
+/* A constant pool entry. tag is the entry's tag byte as in the JVM spec (1 Utf8, 3 Integer, 4 Float, 5 Long, 6 Double,
+ * 7 Class, 8 String, 9 Fieldref, 10 Methodref, 11 InterfaceMethodref, 12 NameAndType, ...), or 0 for the unusable
+ * entry after a Long or Double. References carry the pool indexes they point at. */
+typedef struct {
+    uint8_t tag;
+    union {
+        CfrString utf8;
+        int32_t integer;
+        float flt;
+        int64_t lng;
+        double dbl;
+        struct {
+            uint16_t first; /* class, name, reference kind, or the single index of Class, String and MethodType */
+            uint16_t second; /* name-and-type, descriptor or MethodHandle reference; 0 when there is none */
+        } ref;
+    } value;
+} CfrConstant;
+
+/* CFR_API_VERSION of the library actually loaded */
+CFR_API uint32_t cfr_api_version(void);
+
+/* A static description of err */
+CFR_API const char *cfr_strerror(CfrError err);
+
+/* Parse length bytes at data into a new class. opts may be NULL for the defaults. Returns CFR_OK and sets *cls, or
+ * an error and leaves *cls NULL. */
+CFR_API CfrError cfr_open_buffer(CfrClass **cls, const void *data, size_t length, const CfrOptions *opts);
+
+/* Parse the file open as fd into a new class. A regular file is mapped and parsed from its start, whatever fd's offset;
+ * anything else, such as a pipe, is read onto the heap from where it stands to its end. fd is not closed and may be
+ * closed as soon as this returns. */
+CFR_API CfrError cfr_open_fd(CfrClass **cls, int fd, const CfrOptions *opts);
+
+/* Release cls and everything viewed through it. NULL is ignored. */
+CFR_API void cfr_free(CfrClass *cls);
+
+CFR_API uint16_t cfr_major_version(const CfrClass *cls);
+
+CFR_API uint16_t cfr_minor_version(const CfrClass *cls);
+
+CFR_API uint16_t cfr_access_flags(const CfrClass *cls);
+
+/* The internal name of the class, e.g. "java/lang/String" */
+CFR_API CfrError cfr_name(const CfrClass *cls, CfrString *name);
+
+/* The internal name of the superclass; empty for java/lang/Object, which has none */
+CFR_API CfrError cfr_super_name(const CfrClass *cls, CfrString *name);
+
+CFR_API uint16_t cfr_interfaces_count(const CfrClass *cls);
+
+CFR_API CfrError cfr_interface_name(const CfrClass *cls, uint16_t index, CfrString *name);
+
+CFR_API uint16_t cfr_fields_count(const CfrClass *cls);
+
+CFR_API CfrError cfr_field(const CfrClass *cls, uint16_t index, CfrMember *field);
+
+CFR_API uint16_t cfr_methods_count(const CfrClass *cls);
+
+CFR_API CfrError cfr_method(const CfrClass *cls, uint16_t index, CfrMember *method);
+
+/* Attributes of the class itself (member is ignored) or of the field or method numbered member */
+CFR_API uint16_t cfr_attributes_count(const CfrClass *cls, CfrOwner owner, uint16_t member);
+
+CFR_API CfrError cfr_attribute(const CfrClass *cls, CfrOwner owner, uint16_t member, uint16_t index,
+                               CfrAttribute *attribute);
+
+/* One more than the largest constant pool index, as in the class file */
+CFR_API uint16_t cfr_constant_pool_count(const CfrClass *cls);
+
+CFR_API CfrError cfr_constant(const CfrClass *cls, uint16_t index, CfrConstant *constant);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //CFR_H
@@ -1,353 +1,928 @@
 #include "class.h"
 #include <errno.h>
+#include "mutf8.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-
-/* bigendian_flag = 0 -> Not initialized yet
- * bigendian_flag = 1 -> big endian
- * bigendian_flag = -1 -> little endian
- */
-int bigendian_flag = 0;
+#include "stats.h"
+#include "swap.h"
 
 Class *read_class(Bytecode *bytecode) {
-    if (!is_class(bytecode)) {
+    return read_class_opts(bytecode, NULL);
+}
+
+Class *read_class_opts(Bytecode *bytecode, const ParseOptions *opts) {
+    Class *
+    class;
+    return read_class_err(bytecode, opts, &
+    class) == 0 ?
+    class : NULL;
+}
+
+/* Parse the attribute table of count entries that follows in bytecode. Returns NULL if it runs past the end of
+ * bytecode or memory ran out. */
+static Attribute *parse_attributes(const Class *class, Bytecode *bytecode, uint16_t count) {
+    Attribute *attrs = arena_calloc(
+    class->arena, count, sizeof(Attribute));
+    if (attrs == NULL) {
         return NULL;
     }
-    Class *
-    class = (Class *) malloc(sizeof(Class));
+    int aidx = 0;
+    while (aidx < count) {
+        if (!parse_attribute(
+        class, bytecode, attrs + aidx)) {
+            return NULL;
+        }
+        aidx++;
+    }
+    return attrs;
+}
+
+/* Step over the attribute table of count entries that follows in bytecode by its length prefixes. Returns false if it
+ * runs past the end of bytecode. */
+static bool skip_attributes(Bytecode *bytecode, uint16_t count) {
+    uint16_t i;
+    for (i = 0; i < count; i++) {
+        if (!bytecode_need(bytecode, 6)) {
+            return false;
+        }
+        uint32_t length = load_u4(bytecode->data + bytecode->index + 2);
+        bytecode->index += 6;
+        if (!bytecode_need(bytecode, length)) {
+            return false;
+        }
+        bytecode->index += length;
+    }
+    return true;
+}
 
-    parse_header(bytecode,
-    class);
+/* Parse the access flags, name, descriptor and, if wanted, attributes shared by fields and methods */
+static bool parse_member(const Class *class, Bytecode *bytecode, Field *member) {
+    if (!bytecode_need(bytecode, 8)) {
+        return false;
+    }
+    member->flags = bytecode_u2(bytecode);
+    member->name_idx = bytecode_u2(bytecode);
+    member->desc_idx = bytecode_u2(bytecode);
+    member->attrs_count = bytecode_u2(bytecode);
+    if ((
+    class->sections & PARSE_MEMBER_ATTRIBUTES) == 0) {
+        uint16_t count = member->attrs_count;
+        member->attrs_count = 0;
+        member->attrs = NULL;
+        return skip_attributes(bytecode, count);
+    }
+    member->attrs = parse_attributes(
+    class, bytecode, member->attrs_count);
+    return member->attrs != NULL;
+}
 
-    parse_const_pool(
-    class, class->const_pool_count, bytecode);
+/* Step over the count fields or methods that follow in bytecode. Returns false if they run past the end of bytecode. */
+static bool skip_members(Bytecode *bytecode, uint16_t count) {
+    uint16_t i;
+    for (i = 0; i < count; i++) {
+        if (!bytecode_need(bytecode, 8)) {
+            return false;
+        }
+        bytecode->index += 8;
+        if (!skip_attributes(bytecode, load_u2(bytecode->data + bytecode->index - 2))) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    if (class->pool_size_bytes == 0) {
-        return NULL;
+/* Parse everything after the constant pool into class, stepping over the sections it does not want. Returns false if
+ * it runs past the end of bytecode or memory ran out. */
+static bool parse_members(Class *class, Bytecode *bytecode) {
+    Arena *arena =
+    class->arena;
+    uint32_t sections =
+    class->sections;
+    if (!bytecode_need(bytecode, 8)) {
+        return false;
+    }
+    class->flags = bytecode_u2(bytecode);
+    class->this_class = bytecode_u2(bytecode);
+    class->super_class = bytecode_u2(bytecode);
+    class->interfaces_count = bytecode_u2(bytecode);
+    if (sections & (PARSE_MEMBER_ATTRIBUTES | PARSE_CLASS_ATTRIBUTES)) {
+        class->pool.attribute_kinds = arena_calloc(arena,
+        class->const_pool_count, sizeof(uint8_t));
+        if (class->pool.attribute_kinds == NULL) {
+            return false;
+        }
+    }
+
+    // the interfaces and the fields count after them
+    if (!bytecode_need(bytecode, 2 * (size_t)
+    class->interfaces_count + 2)) {
+        return false;
+    }
+    class->interfaces = arena_calloc(arena,
+    class->interfaces_count, sizeof(uint16_t));
+    if (class->interfaces == NULL) {
+        return false;
     }
-    bytecode_memcpy(&
-    class->flags, bytecode, sizeof(
-    class->flags));
-    class->flags = generic_be16toh(&
-    class->flags);
-    bytecode_memcpy(&
-    class->this_class, bytecode, sizeof(
-    class->this_class));
-    class->this_class = generic_be16toh(&
-    class->this_class);
-    bytecode_memcpy(&
-    class->super_class, bytecode, sizeof(
-    class->super_class));
-    class->super_class = generic_be16toh(&
-    class->super_class);
-    bytecode_memcpy(&
-    class->interfaces_count, bytecode, sizeof(
-    class->interfaces_count));
-    class->interfaces_count = generic_be16toh(&
+    swap_u2(
+    class->interfaces, bytecode->data + bytecode->index,
     class->interfaces_count);
+    bytecode->index += 2 *
+    class->interfaces_count;
+    uint16_t count = bytecode_u2(bytecode);
 
-    class->interfaces = calloc(
-    class->interfaces_count, sizeof(Ref));
     int idx = 0;
-    while (idx < class->interfaces_count) {
-        bytecode_memcpy(&
-        class->interfaces[idx].class_idx, bytecode, sizeof(
-        class->interfaces[idx].class_idx));
-        class->interfaces[idx].class_idx = generic_be16toh(&
-        class->interfaces[idx].class_idx);
-        idx++;
-    }
-    bytecode_memcpy(&
-    class->fields_count, bytecode, sizeof(
-    class->fields_count));
-    class->fields_count = generic_be16toh(&
-    class->fields_count);
-
-    class->fields = calloc(
-    class->fields_count, sizeof(Field));
-    Field *f;
-    idx = 0;
-    while (idx < class->fields_count) {
-        f =
-        class->fields + idx;
-        bytecode_memcpy(&f->flags, bytecode, sizeof(u2));
-        bytecode_memcpy(&f->name_idx, bytecode, sizeof(u2));
-        bytecode_memcpy(&f->desc_idx, bytecode, sizeof(u2));
-        bytecode_memcpy(&f->attrs_count, bytecode, sizeof(u2));
-        f->name_idx = generic_be16toh(&f->name_idx);
-        f->desc_idx = generic_be16toh(&f->desc_idx);
-        f->attrs_count = generic_be16toh(&f->attrs_count);
-        f->attrs = calloc(f->attrs_count, sizeof(Attribute));
-
-        int aidx = 0;
-        while (aidx < f->attrs_count) {
-            parse_attribute(bytecode, f->attrs + aidx);
-            aidx++;
-        }
-        idx++;
-    }
-    bytecode_memcpy(&
-    class->methods_count, bytecode, sizeof(
-    class->methods_count));
-
-    class->methods_count = generic_be16toh(&
-    class->methods_count);
-
-    class->methods = calloc(
-    class->methods_count, sizeof(Method));
-    Method *m;
-    idx = 0;
-    while (idx < class->methods_count) {
-        m =
-        class->methods + idx;
-        bytecode_memcpy(&m->flags, bytecode, sizeof(u2));
-        bytecode_memcpy(&m->name_idx, bytecode, sizeof(u2));
-        bytecode_memcpy(&m->desc_idx, bytecode, sizeof(u2));
-        bytecode_memcpy(&m->attrs_count, bytecode, sizeof(u2));
-
-        m->name_idx = generic_be16toh(&m->name_idx);
-        m->desc_idx = generic_be16toh(&m->desc_idx);
-        m->attrs_count = generic_be16toh(&m->attrs_count);
-        m->attrs = calloc(m->attrs_count, sizeof(Attribute));
-
-        int aidx = 0;
-        while (aidx < m->attrs_count) {
-            parse_attribute(bytecode, m->attrs + aidx);
-            aidx++;
-        }
-        idx++;
-    }
-    bytecode_memcpy(&
-    class->attributes_count, bytecode, sizeof(
-    class->attributes_count));
-
-    class->attributes_count = generic_be16toh(&
-    class->attributes_count);
-
-    class->attributes = calloc(
-    class->attributes_count, sizeof(Attribute));
-    idx = 0;
-    while (idx < class->attributes_count) {
-        parse_attribute(bytecode,
-        class->attributes + idx);
-        idx++;
+    if ((sections & PARSE_FIELDS) == 0) {
+        if (!skip_members(bytecode, count)) {
+            return false;
+        }
+    } else {
+        class->fields_count = count;
+        class->fields = arena_calloc(arena,
+        class->fields_count, sizeof(Field));
+        if (class->fields == NULL) {
+            return false;
+        }
+        while (idx < class->fields_count) {
+            if (!parse_member(
+            class, bytecode, class->fields + idx)) {
+                return false;
+            }
+            idx++;
+        }
+    }
+
+    if (!bytecode_need(bytecode, 2)) {
+        return false;
+    }
+    count = bytecode_u2(bytecode);
+
+    if ((sections & PARSE_METHODS) == 0) {
+        if (!skip_members(bytecode, count)) {
+            return false;
+        }
+    } else {
+        class->methods_count = count;
+        class->methods = arena_calloc(arena,
+        class->methods_count, sizeof(Method));
+        if (class->methods == NULL) {
+            return false;
+        }
+        Field member;
+        idx = 0;
+        while (idx < class->methods_count) {
+            if (!parse_member(
+            class, bytecode, &member)) {
+                return false;
+            }
+            Method *m =
+            class->methods + idx;
+            m->flags = member.flags;
+            m->name_idx = member.name_idx;
+            m->desc_idx = member.desc_idx;
+            m->attrs_count = member.attrs_count;
+            m->attrs = member.attrs;
+            idx++;
+        }
+    }
+
+    if (!bytecode_need(bytecode, 2)) {
+        return false;
     }
+    count = bytecode_u2(bytecode);
+    if ((sections & PARSE_CLASS_ATTRIBUTES) == 0) {
+        return skip_attributes(bytecode, count);
+    }
+    class->attributes_count = count;
+    class->attributes = parse_attributes(
+    class, bytecode, class->attributes_count);
     return
+    class->attributes != NULL;
+}
+
+/* Set up a newly allocated class from arena as opts ask, its payloads pointing into source if that is not NULL */
+static void init_class(Class *class, const ParseOptions *opts, Arena *arena, bool owns_arena, const char *source) {
+    uint32_t flags = opts != NULL ? opts->flags : 0;
+    class->arena = arena;
+    class->owns_arena = owns_arena;
+    class->source = source;
+    class->pool.lazy = (flags & PARSE_LAZY_POOL) != 0;
+    class->pool.strict_utf8 = (flags & PARSE_STRICT_UTF8) != 0;
+    class->sections = opts != NULL && opts->sections != 0 ? opts->sections & PARSE_ALL_SECTIONS : PARSE_ALL_SECTIONS;
+    // a pool whose strings are not wanted has nothing to intern
+    class->pool.symbols = opts != NULL && (flags & PARSE_LAZY_POOL) == 0 && (
+    class->sections & PARSE_POOL_STRINGS) ? opts->symbols : NULL;
+}
+
+int read_class_err(Bytecode *bytecode, const ParseOptions *opts, Class **out) {
+    uint32_t flags = opts != NULL ? opts->flags : 0;
+    if (bytecode->length > INT32_MAX) {
+        // past what Bytecode.index can address
+        return EFBIG;
+    }
+    bytecode->truncated = false;
+    if (!is_class(bytecode)) {
+        return EINVAL;
+    }
+    // size the arena so a typical class fits in its first block: copies of the payloads plus the decoded tables
+    Arena *arena = opts != NULL ? opts->arena : NULL;
+    bool owns_arena = arena == NULL;
+    if (owns_arena) {
+        arena = arena_create(2 * bytecode->length + ARENA_MIN_BLOCK);
+        if (arena == NULL) {
+            return ENOMEM;
+        }
+    }
+    // an arena that had already run out before this class cannot say whether the class ran it out too
+    bool exhausted = arena->exhausted;
+    size_t allocated = arena->allocated;
+    Class *
+    class = (Class *) arena_calloc(arena, 1, sizeof(Class));
+    if (class == NULL) {
+        if (owns_arena) {
+            arena_destroy(arena);
+        }
+        return ENOMEM;
+    }
+    init_class(
+    class, opts, arena, owns_arena, (flags & PARSE_ZERO_COPY) ? bytecode->data : NULL);
+
+    STATS_ENTER(STATS_CONST_POOL);
+    STATS_ADD(STATS_CLASSES, 1);
+    STATS_ADD(STATS_CLASS_BYTES, bytecode->length);
+    int err = 0;
+    if (!parse_header(bytecode,
+    class)) {
+        err = ENODATA;
+    } else {
+        parse_const_pool(
+        class, class->const_pool_count, bytecode);
+        if (class->pool_size_bytes == 0) {
+            bool out_of_memory = (arena->exhausted && !exhausted) ||
+            class->pool.symbols_exhausted;
+            err = bytecode->truncated ? ENODATA : out_of_memory ? ENOMEM : EINVAL;
+        } else {
+            STATS_SWITCH(STATS_MEMBERS);
+            err = parse_members(
+            class, bytecode) ? 0 : bytecode->truncated ? ENODATA : ENOMEM;
+        }
+    }
+    STATS_ADD(STATS_ARENA_BYTES, arena->allocated - allocated);
+    STATS_LEAVE();
+    if (err != 0) {
+        free_class(
+        class);
+        return err;
+    }
+    *out =
     class;
+    return 0;
+}
+
+bool parse_header(Bytecode *bytecode, Class *class) {
+    if (!bytecode_need(bytecode, 6)) {
+        return false;
+    }
+    class->minor_version = bytecode_u2(bytecode);
+    class->major_version = bytecode_u2(bytecode);
+    class->const_pool_count = bytecode_u2(bytecode);
+    return true;
+}
+
+typedef struct {
+    const char *name;
+    uint8_t length;
+    uint8_t kind;
+} AttributeName;
+
+/* The predefined attribute names, placed by a perfect hash of their length and first, middle and last bytes, see
+ * attribute_kind(). The multipliers were found by searching for ones that give every name its own slot; a name added
+ * to AttributeKind needs the search run again if its slot is taken. */
+static const AttributeName ATTRIBUTE_NAMES[64] = {
+        [2] = {"NestHost", 8, ATTR_NEST_HOST},
+        [3] = {"ModulePackages", 14, ATTR_MODULE_PACKAGES},
+        [4] = {"SourceDebugExtension", 20, ATTR_SOURCE_DEBUG_EXTENSION},
+        [6] = {"EnclosingMethod", 15, ATTR_ENCLOSING_METHOD},
+        [10] = {"Exceptions", 10, ATTR_EXCEPTIONS},
+        [13] = {"PermittedSubclasses", 19, ATTR_PERMITTED_SUBCLASSES},
+        [14] = {"RuntimeVisibleAnnotations", 25, ATTR_RUNTIME_VISIBLE_ANNOTATIONS},
+        [15] = {"RuntimeInvisibleParameterAnnotations", 36, ATTR_RUNTIME_INVISIBLE_PARAMETER_ANNOTATIONS},
+        [20] = {"ModuleMainClass", 15, ATTR_MODULE_MAIN_CLASS},
+        [21] = {"NestMembers", 11, ATTR_NEST_MEMBERS},
+        [28] = {"RuntimeVisibleParameterAnnotations", 34, ATTR_RUNTIME_VISIBLE_PARAMETER_ANNOTATIONS},
+        [30] = {"Signature", 9, ATTR_SIGNATURE},
+        [31] = {"ConstantValue", 13, ATTR_CONSTANT_VALUE},
+        [34] = {"StackMapTable", 13, ATTR_STACK_MAP_TABLE},
+        [37] = {"Deprecated", 10, ATTR_DEPRECATED},
+        [38] = {"RuntimeInvisibleAnnotations", 27, ATTR_RUNTIME_INVISIBLE_ANNOTATIONS},
+        [40] = {"InnerClasses", 12, ATTR_INNER_CLASSES},
+        [41] = {"BootstrapMethods", 16, ATTR_BOOTSTRAP_METHODS},
+        [43] = {"Synthetic", 9, ATTR_SYNTHETIC},
+        [45] = {"RuntimeInvisibleTypeAnnotations", 31, ATTR_RUNTIME_INVISIBLE_TYPE_ANNOTATIONS},
+        [48] = {"LocalVariableTable", 18, ATTR_LOCAL_VARIABLE_TABLE},
+        [51] = {"SourceFile", 10, ATTR_SOURCE_FILE},
+        [53] = {"AnnotationDefault", 17, ATTR_ANNOTATION_DEFAULT},
+        [54] = {"MethodParameters", 16, ATTR_METHOD_PARAMETERS},
+        [57] = {"Module", 6, ATTR_MODULE},
+        [58] = {"RuntimeVisibleTypeAnnotations", 29, ATTR_RUNTIME_VISIBLE_TYPE_ANNOTATIONS},
+        [59] = {"Record", 6, ATTR_RECORD},
+        [60] = {"Code", 4, ATTR_CODE},
+        [62] = {"LineNumberTable", 15, ATTR_LINE_NUMBER_TABLE},
+        [63] = {"LocalVariableTypeTable", 22, ATTR_LOCAL_VARIABLE_TYPE_TABLE}
+};
+
+AttributeKind attribute_kind(const char *name, size_t length) {
+    if (length == 0) {
+        return ATTR_UNKNOWN;
+    }
+    const AttributeName *slot = &ATTRIBUTE_NAMES[(length * 17 + (uint8_t) name[0] + (uint8_t) name[length / 2] +
+                                                  (uint8_t) name[length - 1] * 61) & 63];
+    return slot->length == length && memcmp(slot->name, name, length) == 0 ? slot->kind : ATTR_UNKNOWN;
+}
+
+/* The kind of the attribute named by entry name_idx, looked up the first time class uses that name */
+static uint8_t resolve_kind(const Class *class, uint16_t name_idx) {
+    uint8_t *kinds =
+    class->pool.attribute_kinds;
+    if (kinds != NULL && name_idx < class->const_pool_count && kinds[name_idx] != 0) {
+        return kinds[name_idx] - 1;
+    }
+    Item name = get_item(
+    class, name_idx);
+    uint8_t kind = name.tag == STRING_UTF8 ? attribute_kind(name.value.string.value, name.value.string.length)
+                                           : ATTR_UNKNOWN;
+    if (kinds != NULL && name_idx < class->const_pool_count) {
+        kinds[name_idx] = kind + 1;
+    }
+    return kind;
+}
+
+bool parse_attribute(const Class *class, Bytecode *bytecode, Attribute *attr) {
+    STATS_ENTER(STATS_ATTRIBUTES);
+    bool parsed = bytecode_need(bytecode, 6);
+    if (parsed) {
+        attr->name_idx = bytecode_u2(bytecode);
+        attr->kind = resolve_kind(
+        class, attr->name_idx);
+        attr->length = bytecode_u4(bytecode);
+        parsed = bytecode_need(bytecode, attr->length);
+    }
+    if (parsed && class->source != NULL) {
+        attr->info = bytecode->data + bytecode->index;
+        bytecode->index += attr->length;
+    } else if (parsed) {
+        char *info = arena_alloc(
+        class->arena, attr->length + 1);
+        if (info != NULL) {
+            memcpy(info, bytecode->data + bytecode->index, attr->length);
+            info[attr->length] = '\0';
+            bytecode->index += attr->length;
+        }
+        attr->info = info;
+        parsed = info != NULL;
+    }
+    STATS_LEAVE();
+    return parsed;
+}
+
+/* Return a NUL-terminated copy of the length bytes at src, allocated from class's arena */
+static char *copy_payload(const Class *class, const char *src, size_t length) {
+    char *dst = arena_alloc(
+    class->arena, length + 1);
+    if (dst != NULL) {
+        memcpy(dst, src, length);
+        dst[length] = '\0';
+    }
+    return dst;
+}
+
+/* Copy the pool's UTF-8 entries out of class->pool.bytes into one block owned by class. Each copy keeps its big-endian
+ * length prefix and gains a NUL terminator, so slots keep pointing just past a length. */
+static bool detach_strings(Class *class, uint32_t utf8_bytes) {
+    ConstPool *pool = &
+    class->pool;
+    char *strings = arena_alloc(
+    class->arena, utf8_bytes);
+    if (strings == NULL) {
+        return false;
+    }
+    uint32_t offset = 0;
+    uint16_t i;
+    for (i = 1; i < class->const_pool_count; i++) {
+        if (pool->tags[i] == STRING_UTF8) {
+            const char *value = pool->bytes + pool->slots[i];
+            uint16_t length = generic_be16toh((void *) (value - 2));
+            memcpy(strings + offset, value - 2, length + 2);
+            strings[offset + 2 + length] = '\0';
+            pool->slots[i] = offset + 2;
+            offset += length + 3;
+        }
+    }
+    pool->bytes = strings;
+    return true;
+}
+
+static bool detach_attributes(const Class *class, Attribute *attrs, uint16_t count) {
+    uint16_t i;
+    for (i = 0; i < count; i++) {
+        char *info = copy_payload(
+        class, attrs[i].info, attrs[i].length);
+        if (info == NULL) {
+            return false;
+        }
+        attrs[i].info = info;
+    }
+    return true;
+}
+
+void free_class(Class *class) {
+    if (class != NULL && class->owns_arena) {
+        arena_destroy(
+        class->arena);
+    }
+}
+
+bool detach_class(Class *class) {
+    if (class->source == NULL) {
+        return true;
+    }
+    if (class->pool.lazy) {
+        char *bytes = arena_alloc(
+        class->arena, class->pool.raw_bytes);
+        if (bytes == NULL) {
+            return false;
+        }
+        memcpy(bytes, class->pool.bytes, class->pool.raw_bytes);
+        class->pool.bytes = bytes;
+    } else if (class->pool.bytes == class->source && !detach_strings(
+    class, class->pool.utf8_bytes)) {
+        return false;
+    }
+    uint16_t i;
+    for (i = 0; i < class->fields_count; i++) {
+        if (!detach_attributes(
+        class, class->fields[i].attrs, class->fields[i].attrs_count)) {
+            return false;
+        }
+    }
+    for (i = 0; i < class->methods_count; i++) {
+        if (!detach_attributes(
+        class, class->methods[i].attrs, class->methods[i].attrs_count)) {
+            return false;
+        }
+    }
+    if (!detach_attributes(
+    class, class->attributes, class->attributes_count)) {
+        return false;
+    }
+    class->source = NULL;
+    return true;
+}
+
+/* Names of the tags, indexed by tag byte */
+static const char *const CPool_strings[MAX_CPOOL_TAG + 1] = {
+        "Undefined", // 0
+        "String_UTF8",
+        "Undefined", // 2
+        "Integer",
+        "Float",
+        "Long",
+        "Double",
+        "Class",
+        "String",
+        "Field",
+        "Method",
+        "InterfaceMethod",
+        "Name",
+        "Undefined", // 13
+        "Undefined", // 14
+        "MethodHandle",
+        "MethodType",
+        "Dynamic",
+        "InvokeDynamic",
+        "Module",
+        "Package"
+};
+
+/* How an entry's payload becomes its slot, see ConstPool */
+typedef enum {
+    DECODE_UTF8, /* the offset of the string; see parse_const_pool() and index_const_pool() */
+    DECODE_U4, /* 32 bits in host order: a value, the high word of a long or double, or two indexes */
+    DECODE_U2, /* a single index, in the upper 16 bits */
+    DECODE_KIND_U2 /* a MethodHandle's reference kind byte in bits 16 to 23, and its index below it */
+} SlotDecoder;
+
+/* The layout of an entry with a given tag */
+typedef struct {
+    uint8_t width; /* bytes after the tag byte, 0 for tags that are not valid; a UTF-8 entry has its length and then that many more */
+    uint8_t decoder; /* a SlotDecoder */
+    uint8_t entries; /* pool entries taken: 2 for longs and doubles, whose second entry holds the low word */
+} CPoolLayout;
+
+/* Every tag of JVM spec table 4.4-B, indexed by tag byte */
+static const CPoolLayout CPool_layouts[MAX_CPOOL_TAG + 1] = {
+        [STRING_UTF8] = {2, DECODE_UTF8, 1},
+        [INTEGER] = {4, DECODE_U4, 1},
+        [FLOAT] = {4, DECODE_U4, 1},
+        [LONG] = {8, DECODE_U4, 2},
+        [DOUBLE] = {8, DECODE_U4, 2},
+        [CLASS] = {2, DECODE_U2, 1},
+        [STRING] = {2, DECODE_U2, 1},
+        [FIELD] = {4, DECODE_U4, 1},
+        [METHOD] = {4, DECODE_U4, 1},
+        [INTERFACE_METHOD] = {4, DECODE_U4, 1},
+        [NAME] = {4, DECODE_U4, 1},
+        [METHOD_HANDLE] = {3, DECODE_KIND_U2, 1},
+        [METHOD_TYPE] = {2, DECODE_U2, 1},
+        [DYNAMIC] = {4, DECODE_U4, 1},
+        [INVOKE_DYNAMIC] = {4, DECODE_U4, 1},
+        [MODULE] = {2, DECODE_U2, 1},
+        [PACKAGE] = {2, DECODE_U2, 1}
+};
+
+/* The layout of tag, whose width is 0 if the tag is not valid */
+static const CPoolLayout *layout_of(uint8_t tag) {
+    return &CPool_layouts[tag <= MAX_CPOOL_TAG ? tag : 0];
 }
 
-void parse_header(Bytecode *bytecode, Class *class) {
-    bytecode_memcpy(&
-    class->minor_version, bytecode, sizeof(uint16_t));
-    bytecode_memcpy(&
-    class->major_version, bytecode, sizeof(uint16_t));
-    bytecode_memcpy(&
-    class->const_pool_count, bytecode, sizeof(uint16_t));
+/* Decode the slot of an entry with the given layout whose payload starts at p. For longs and doubles this is the high
+ * word. */
+static uint32_t decode_slot(const CPoolLayout *layout, const char *p) {
+    switch (layout->decoder) {
+        case DECODE_U4:
+            return load_u4(p);
+        case DECODE_KIND_U2:
+            return ((uint32_t) (uint8_t) p[0] << 16) | load_u2(p + 1);
+        default:
+            return (uint32_t) load_u2(p) << 16;
+    }
+}
+
+/* Check that UTF-8 entry i of a strict pool is well-formed Modified UTF-8, noting whether it is all ASCII on the way */
+static bool check_utf8(ConstPool *pool, uint16_t i, const char *value, uint16_t length) {
+    bool ascii;
+    if (!mutf8_validate(value, length, &ascii)) {
+        return false;
+    }
+    pool->utf8_kind[i] = ascii ? UTF8_ASCII : UTF8_OTHER;
+    return true;
+}
 
-    // convert the big endian ints to host equivalents
-    class->minor_version = generic_be16toh(&
-    class->minor_version);
-    class->major_version = generic_be16toh(&
-    class->major_version);
-    class->const_pool_count = generic_be16toh(&
-    class->const_pool_count);
+/* Intern UTF-8 entry i, whose length and bytes are next in bytecode, keeping its symbol id in the slot. Returns false
+ * if the symbol table ran out of memory. */
+static bool intern_utf8(ConstPool *pool, uint16_t i, const Bytecode *bytecode) {
+    const char *value = bytecode->data + bytecode->index + 2;
+    uint16_t length = load_u2(bytecode->data + bytecode->index);
+    pool->slots[i] = symbols_intern(pool->symbols, value, length, symbols_hash(value, length));
+    pool->symbols_exhausted = pool->slots[i] == SYMBOL_NONE;
+    return !pool->symbols_exhausted;
 }
 
-void parse_attribute(Bytecode *bytecode, Attribute *attr) {
-    bytecode_memcpy(&attr->name_idx, bytecode, sizeof(u2));
-    bytecode_memcpy(&attr->length, bytecode, sizeof(u4));
-    attr->name_idx = generic_be16toh(&attr->name_idx);
-    attr->length = generic_be32toh(&attr->length);
-    attr->info = calloc(attr->length + 1, sizeof(char));
-    bytecode_memcpy(attr->info, bytecode, sizeof(char) * attr->length);
-    attr->info[attr->length] = '\0';
+/* Record the tag and payload offset of every entry without decoding any of them. Slots are offsets from the first
+ * entry's tag byte, and get_item() decodes from there on each call. */
+static void index_const_pool(Class *class, const uint16_t const_pool_count, Bytecode *bytecode) {
+    ConstPool *pool = &
+    class->pool;
+    const uint8_t *start = (const uint8_t *) bytecode->data + bytecode->index;
+    const uint8_t *end = (const uint8_t *) bytecode->data + bytecode->length;
+    const uint8_t *p = start;
+    uint32_t entries = 0;
+    int i;
+
+    pool->tags = arena_calloc(
+    class->arena, const_pool_count, sizeof(uint8_t));
+    pool->slots = arena_calloc(
+    class->arena, const_pool_count, sizeof(uint32_t));
+    pool->utf8_kind = arena_calloc(
+    class->arena, const_pool_count, sizeof(uint8_t));
+    if (pool->tags == NULL || pool->slots == NULL || pool->utf8_kind == NULL) {
+        class->pool_size_bytes = 0;
+        return;
+    }
+    for (i = 1; i < const_pool_count; i++) {
+        if (p >= end) {
+            bytecode->truncated = true;
+            class->pool_size_bytes = 0;
+            return;
+        }
+        uint8_t tag = *p;
+        const CPoolLayout *layout = layout_of(tag);
+        uint32_t width = layout->width;
+        if (width == 0 || end - p - 1 < width) {
+            bytecode->truncated = width != 0;
+            class->pool_size_bytes = 0;
+            return; // fail fast
+        }
+        if (tag == STRING_UTF8) {
+            width += load_u2(p + 1);
+            if (end - p - 1 < width) {
+                bytecode->truncated = true;
+                class->pool_size_bytes = 0;
+                return;
+            }
+            if (pool->strict_utf8 && !check_utf8(pool, i, (const char *) p + 3, width - 2)) {
+                class->pool_size_bytes = 0;
+                return;
+            }
+        }
+        pool->tags[i] = tag;
+        pool->slots[i] = (p - start) + 1 + (tag == STRING_UTF8 ? 2 : 0);
+        p += 1 + width;
+        entries++;
+        // 8-byte consts take 2 pool entries; the second keeps tag 0
+        i += layout->entries - 1;
+    }
+    pool->raw_bytes = p - start;
+    pool->bytes = (const char *) start;
+    class->pool_size_bytes = pool->raw_bytes - entries; // less the tag bytes, as the eager parse counts it
+    bytecode->index += pool->raw_bytes;
+    if (class->source == NULL) {
+        char *bytes = arena_alloc(
+        class->arena, pool->raw_bytes);
+        if (bytes == NULL) {
+            class->pool_size_bytes = 0;
+            return;
+        }
+        memcpy(bytes, start, pool->raw_bytes);
+        pool->bytes = bytes;
+    }
 }
 
 void parse_const_pool(Class *class, const uint16_t const_pool_count, Bytecode *bytecode) {
+    if (class->pool.lazy) {
+        index_const_pool(
+        class, const_pool_count, bytecode);
+        return;
+    }
     const int MAX_ITEMS = const_pool_count - 1;
     uint32_t table_size_bytes = 0;
+    uint32_t utf8_bytes = 0; // size of the strings block should they need copying
     int i;
-    char tag_byte;
-    Ref r;
+    uint8_t tag_byte;
+    uint16_t u16;
+    ConstPool *pool = &
+    class->pool;
+    bool strings = (
+    class->sections & PARSE_POOL_STRINGS) != 0;
 
-    class->items = calloc(MAX_ITEMS, sizeof(Class));
+    // one spare entry so index 0 and pool indexes line up
+    pool->tags = arena_calloc(
+    class->arena, const_pool_count, sizeof(uint8_t));
+    pool->slots = arena_calloc(
+    class->arena, const_pool_count, sizeof(uint32_t));
+    pool->utf8_kind = arena_calloc(
+    class->arena, const_pool_count, sizeof(uint8_t));
+    if (pool->tags == NULL || pool->slots == NULL || pool->utf8_kind == NULL) {
+        class->pool_size_bytes = 0;
+        return;
+    }
+    // strings kept in a symbol table, or not kept at all, leave nothing in bytes for detach_class() to copy
+    pool->bytes = strings && pool->symbols == NULL ? bytecode->data : NULL;
     for (i = 1; i <= MAX_ITEMS; i++) {
-        bytecode_memcpy(&tag_byte, bytecode, sizeof(char));
-        if (tag_byte < MIN_CPOOL_TAG || tag_byte > MAX_CPOOL_TAG) {
+        if (!bytecode_need(bytecode, 1)) {
+            table_size_bytes = 0;
+            break;
+        }
+        tag_byte = bytecode_u1(bytecode);
+        const CPoolLayout *layout = layout_of(tag_byte);
+        if (layout->width == 0) {
             table_size_bytes = 0;
             break; // fail fast
         }
+        // one check covers the whole entry, a UTF-8 entry's string included once its length is known to be there
+        if (!bytecode_need(bytecode, layout->width) ||
+            (tag_byte == STRING_UTF8 && !bytecode_need(bytecode, 2 + load_u2(bytecode->data + bytecode->index)))) {
+            table_size_bytes = 0;
+            break;
+        }
+        if (tag_byte == STRING_UTF8 && strings && pool->strict_utf8 &&
+            !check_utf8(pool, i, bytecode->data + bytecode->index + 2, load_u2(bytecode->data + bytecode->index))) {
+            table_size_bytes = 0;
+            break;
+        }
+        if (tag_byte == STRING_UTF8 && pool->symbols != NULL && !intern_utf8(pool, i, bytecode)) {
+            table_size_bytes = 0;
+            break;
+        }
 
-        String s;
-        uint16_t ptr_idx = i - 1;
-        Item * item =
-        class->items + ptr_idx;
-        item->tag = tag_byte;
-
-        // Populate item based on tag_byte
-        switch (tag_byte) {
-            case STRING_UTF8: // String prefixed by a uint16 indicating the number of bytes in the encoded string which immediately follows
-                bytecode_memcpy(&s.length, bytecode, sizeof(s.length));
-                s.length = generic_be16toh(&s.length);
-                s.value = malloc(sizeof(char) * s.length);
-                bytecode_memcpy(s.value, bytecode, sizeof(char) * s.length);
-                item->value.string = s;
-                table_size_bytes += 2 + s.length;
-                break;
-            case INTEGER: // Integer: a signed 32-bit two's complement number in big-endian format
-                bytecode_memcpy(&item->value.integer, bytecode, sizeof(item->value.integer));
-                item->value.integer = generic_be32toh(&item->value.integer);
-                table_size_bytes += 4;
-                break;
-            case FLOAT: // Float: a 32-bit single-precision IEEE 754 floating-point number
-                bytecode_memcpy(&item->value.flt, bytecode, sizeof(item->value.flt));
-                item->value.flt = generic_be32toh(&item->value.flt);
-                table_size_bytes += 4;
-                break;
-            case LONG: // Long: a signed 64-bit two's complement number in big-endian format (takes two slots in the constant pool table)
-                bytecode_memcpy(&item->value.lng.high, bytecode, sizeof(item->value.lng.high)); // 4 bytes
-                bytecode_memcpy(&item->value.lng.low, bytecode, sizeof(item->value.lng.low)); // 4 bytes
-                item->value.lng.high = generic_be32toh(&item->value.lng.high);
-                item->value.lng.low = generic_be32toh(&item->value.lng.low);
-                // 8-byte consts take 2 pool entries
-                ++i;
-                table_size_bytes += 8;
-                break;
-            case DOUBLE: // Double: a 64-bit double-precision IEEE 754 floating-point number (takes two slots in the constant pool table)
-                bytecode_memcpy(&item->value.dbl.high, bytecode, sizeof(item->value.dbl.high)); // 4 bytes
-                bytecode_memcpy(&item->value.dbl.low, bytecode, sizeof(item->value.dbl.low)); // 4 bytes
-                item->value.dbl.high = generic_be32toh(&item->value.dbl.high);
-                item->value.dbl.low = generic_be32toh(&item->value.dbl.low);
-                // 8-byte consts take 2 pool entries
-                ++i;
-                table_size_bytes += 8;
-                break;
-            case CLASS: // Class reference: an uint16 within the constant pool to a UTF-8 string containing the fully qualified class name
-                bytecode_memcpy(&r.class_idx, bytecode, sizeof(r.class_idx));
-                r.class_idx = generic_be16toh(&r.class_idx);
-                item->value.ref = r;
-                table_size_bytes += 2;
-                break;
-            case STRING: // String reference: an uint16 within the constant pool to a UTF-8 string
-                bytecode_memcpy(&r.class_idx, bytecode, sizeof(r.class_idx));
-                r.class_idx = generic_be16toh(&r.class_idx);
-                item->value.ref = r;
-                table_size_bytes += 2;
-                break;
-            case FIELD: // Field reference: two uint16 within the pool, 1st pointing to a Class reference, 2nd to a Name and Type descriptor
-                /* FALL THROUGH TO METHOD */
-            case METHOD: // Method reference: two uint16s within the pool, 1st pointing to a Class reference, 2nd to a Name and Type descriptor
-                /* FALL THROUGH TO INTERFACE_METHOD */
-            case INTERFACE_METHOD: // Interface method reference: 2 uint16 within the pool, 1st pointing to a Class reference, 2nd to a Name and Type descriptor
-                bytecode_memcpy(&r.class_idx, bytecode, sizeof(r.class_idx));
-                bytecode_memcpy(&r.name_idx, bytecode, sizeof(r.name_idx));
-                r.class_idx = generic_be16toh(&r.class_idx);
-                r.name_idx = generic_be16toh(&r.name_idx);
-                item->value.ref = r;
-                table_size_bytes += 4;
-                break;
-            case NAME: // Name and type descriptor: 2 uint16 to UTF-8 strings, 1st representing a name (identifier), 2nd a specially encoded type descriptor
-                bytecode_memcpy(&r.class_idx, bytecode, sizeof(r.class_idx));
-                bytecode_memcpy(&r.name_idx, bytecode, sizeof(r.name_idx));
-                r.class_idx = generic_be16toh(&r.class_idx);
-                r.name_idx = generic_be16toh(&r.name_idx);
-                item->value.ref = r;
-                table_size_bytes += 4;
-                break;
-            default:
-                item = NULL;
-                break;
-        }
-        if (item != NULL) class->items[i - 1] = *item;
+        // Populate the slot from the tag's layout, see ConstPool for the encoding
+        const char *payload = bytecode->data + bytecode->index;
+        pool->tags[i] = tag_byte;
+        if (layout->decoder == DECODE_UTF8) {
+            // String prefixed by a uint16 indicating the number of bytes in the encoded string which immediately follows
+            u16 = load_u2(payload);
+            if (pool->bytes != NULL) {
+                pool->slots[i] = bytecode->index + 2;
+                utf8_bytes += 3 + u16;
+            }
+            bytecode->index += 2 + u16;
+            table_size_bytes += 2 + u16;
+            continue;
+        }
+        pool->slots[i] = decode_slot(layout, payload);
+        bytecode->index += layout->width;
+        table_size_bytes += layout->width;
+        if (layout->entries == 2 && i < MAX_ITEMS) {
+            // 8-byte consts take 2 pool entries; the second holds the low word and keeps tag 0
+            ++i;
+            pool->slots[i] = load_u4(payload + 4);
+        }
     }
     class->pool_size_bytes = table_size_bytes;
+    if (table_size_bytes != 0 &&
+    class->source == NULL && pool->bytes != NULL && !detach_strings(
+    class, utf8_bytes)) {
+        class->pool_size_bytes = 0;
+    }
+    class->pool.utf8_bytes = utf8_bytes;
 }
 
 bool is_class(Bytecode *bytecode) {
-    uint32_t magicNum;
-    bytecode_memcpy(&magicNum, bytecode, sizeof(uint32_t));
-    return generic_be32toh(&magicNum) == 0xcafebabe;
+    return bytecode_need(bytecode, 4) && bytecode_u4(bytecode) == 0xcafebabe;
 }
 
+/* The byte order is fixed at compile time, see load_u2() and load_u4() */
 uint16_t generic_be16toh(void *memory) {
-    uint8_t *p = memory;
-    if (bigendian_flag == 0) {
-        bigendian_flag = is_bigendian();
-    }
-    if (bigendian_flag == -1) {
-        return (((uint16_t) p[0]) << 8) |
-               (((uint16_t) p[1]));
-    } else {
-        return (((uint16_t) p[1]) << 8) |
-               (((uint16_t) p[0]));
-    }
+    return load_u2(memory);
 }
 
 uint32_t generic_be32toh(void *memory) {
-    uint8_t *p = memory;
-    if (bigendian_flag == 0) {
-        bigendian_flag = is_bigendian();
-    }
-    if (bigendian_flag == -1) {
-        return (((uint32_t) p[0]) << 24) |
-               (((uint32_t) p[1]) << 16) |
-               (((uint32_t) p[2]) << 8) |
-               (((uint32_t) p[3]));
-    } else {
-        return (((uint32_t) p[3]) << 24) |
-               (((uint32_t) p[2]) << 16) |
-               (((uint32_t) p[1]) << 8) |
-               (((uint32_t) p[0]));
-    }
+    return load_u4(memory);
 }
 
 int is_bigendian() {
-    int a = 1;
-    return ((char *) &a)[3] == 1 ? 1 : -1;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return 1;
+#else
+    return -1;
+#endif
+}
 
+/* Whether UTF-8 entry i is all ASCII, scanning it the first time it is asked for. Every thread finds the same answer,
+ * so a race to store it is harmless. */
+static bool utf8_ascii(const ConstPool *pool, uint16_t i, const String *string) {
+    uint8_t kind = __atomic_load_n(&pool->utf8_kind[i], __ATOMIC_RELAXED);
+    if (kind == UTF8_UNKNOWN) {
+        kind = mutf8_ascii_length(string->value, string->length) == string->length ? UTF8_ASCII : UTF8_OTHER;
+        __atomic_store_n(&pool->utf8_kind[i], kind, __ATOMIC_RELAXED);
+    }
+    return kind == UTF8_ASCII;
+}
+
+Item get_item(const Class *class, const uint16_t cp_idx) {
+    Item item = {.tag = 0};
+    if (cp_idx >= class->const_pool_count) {
+        return item;
+    }
+    const ConstPool *pool = &
+    class->pool;
+    uint32_t slot = pool->slots[cp_idx];
+    uint32_t low = cp_idx + 1 < class->const_pool_count ? pool->slots[cp_idx + 1] : 0;
+    item.tag = pool->tags[cp_idx];
+    if (pool->lazy && item.tag != STRING_UTF8 && item.tag != 0) {
+        const char *p = pool->bytes + slot;
+        slot = decode_slot(layout_of(item.tag), p);
+        if (item.tag == LONG || item.tag == DOUBLE) {
+            low = generic_be32toh((void *) (p + 4));
+        }
+    }
+    switch (item.tag) {
+        case STRING_UTF8:
+            if (pool->symbols != NULL) {
+                item.value.string.symbol = slot;
+                item.value.string.value = symbols_string(pool->symbols, slot, &item.value.string.length,
+                                                         &item.value.string.hash);
+            } else if (pool->bytes != NULL) {
+                item.value.string.symbol = SYMBOL_NONE;
+                item.value.string.value = pool->bytes + slot;
+                item.value.string.length = generic_be16toh((void *) (item.value.string.value - 2));
+            } else {
+                // parsed without PARSE_POOL_STRINGS
+                item.value.string.symbol = SYMBOL_NONE;
+                item.value.string.value = "";
+                item.value.string.length = 0;
+            }
+            item.value.string.ascii = utf8_ascii(pool, cp_idx, &item.value.string);
+            break;
+        case INTEGER:
+            item.value.integer = (int32_t) slot;
+            break;
+        case FLOAT:
+            memcpy(&item.value.flt, &slot, sizeof(item.value.flt));
+            break;
+        case LONG:
+            item.value.lng.high = slot;
+            item.value.lng.low = low;
+            break;
+        case DOUBLE:
+            item.value.dbl.high = slot;
+            item.value.dbl.low = low;
+            break;
+        default: // references
+            item.value.ref.class_idx = slot >> 16;
+            item.value.ref.name_idx = slot & 0xffff;
+            break;
+    }
+    return item;
 }
 
-Item *get_item(const Class *class, const uint16_t cp_idx) {
-    if (cp_idx < class->const_pool_count) return &
-    class->items[cp_idx - 1];
-    else return NULL;
+const char *tag2str(uint8_t tag) {
+    return tag <= MAX_CPOOL_TAG ? CPool_strings[tag] : "Undefined";
 }
 
-Item *get_class_string(const Class *class, const uint16_t index) {
-    Item * i1 = get_item(
+Item get_class_string(const Class *class, const uint16_t index) {
+    Item i1 = get_item(
     class, index);
     return get_item(
-    class, i1->value.ref.class_idx);
+    class, i1.value.ref.class_idx);
+}
+
+/* The UTF-8 entry at index, or a String whose value is NULL if it is not one, as entry 0 never is */
+static String utf8_view(const Class *class, uint16_t index) {
+    Item item = get_item(
+    class, index);
+    String none = {.value = NULL, .symbol = SYMBOL_NONE};
+    return item.tag == STRING_UTF8 ? item.value.string : none;
+}
+
+/* Follow entry i to its strings, see resolve_ref() */
+static ResolvedRef resolve_entry(const Class *class, uint16_t i) {
+    Item item = get_item(
+    class, i);
+    ResolvedRef ref;
+    ref.owner = ref.name = ref.descriptor = utf8_view(
+    class, 0);
+    if (item.tag == CLASS) {
+        ref.owner = utf8_view(
+        class, item.value.ref.class_idx);
+        return ref;
+    }
+    Item name_and_type = item;
+    if (item.tag == FIELD || item.tag == METHOD || item.tag == INTERFACE_METHOD) {
+        // Class -> UTF-8 for the owner, NameAndType -> two UTF-8s for the rest
+        Item owner = get_item(
+        class, item.value.ref.class_idx);
+        if (owner.tag == CLASS) {
+            ref.owner = utf8_view(
+            class, owner.value.ref.class_idx);
+        }
+        name_and_type = get_item(
+        class, item.value.ref.name_idx);
+    }
+    if (name_and_type.tag == NAME) {
+        ref.name = utf8_view(
+        class, name_and_type.value.ref.class_idx);
+        ref.descriptor = utf8_view(
+        class, name_and_type.value.ref.name_idx);
+    }
+    return ref;
+}
+
+ResolvedRef resolve_ref(const Class *class, uint16_t cp_idx) {
+    if (cp_idx >= class->const_pool_count) {
+        return resolve_entry(
+        class, 0);
+    }
+    ResolvedRef *resolved =
+    class->pool.resolved;
+    if (resolved == NULL) {
+        resolved = arena_alloc(
+        class->arena, class->const_pool_count * sizeof(ResolvedRef));
+        if (resolved == NULL) {
+            return resolve_entry(
+            class, cp_idx);
+        }
+        uint16_t i;
+        for (i = 0; i < class->const_pool_count; i++) {
+            resolved[i] = resolve_entry(
+            class, i);
+        }
+        // a cache: building it changes nothing a caller of resolve_ref() can see, so a const Class may hold it
+        ((Class *)
+        class)->pool.resolved = resolved;
+    }
+    return resolved[cp_idx];
 }
 
 double to_double(const Double dbl) {
-    return -dbl.high; //FIXME check the following implementation
-    //unsigned long bits = ((long) generic_be32toh(item->dbl.high) << 32) + generic_be32toh(item->dbl.low);
-    //if (bits == 0x7ff0000000000000L) {
-    //return POSITIVE_INFINITY;
-    //} else if (bits == 0xfff0000000000000L) {
-    //return POSITIVE_INFINITY;
-    //} else if ((bits > 0x7ff0000000000000L && bits < 0x7fffffffffffffffL)
-    //|| (bits > 0xfff0000000000001L && bits < 0xffffffffffffffffL)) {
-    //return NaN;
-    //} else {
-    //int s = ((bits >> 63) == 0) ? 1 : -1;
-    //int e = (int)((bits >> 52) & 0x7ffL);
-    //long m = (e == 0)
-    //? (bits & 0xfffffffffffffL) << 1
-    //: (bits & 0xfffffffffffffL) | 0x10000000000000L;
-    //return s * m * (2 << (e - 1075)); //FIXME this is wrong
-    //}
+    // the words are in host order already; the bits are those of an IEEE 754 double
+    uint64_t bits = (uint64_t) dbl.high << 32 | dbl.low;
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
 }
 
 long to_long(Long lng) {
-    return ((long) generic_be32toh(&lng.high) << 32) + generic_be32toh(&lng.low);
+    return (long) ((uint64_t) lng.high << 32 | lng.low);
 }
 
 void bytecode_memcpy(void *target, Bytecode *bytecode, size_t len) {
+    if (!bytecode_need(bytecode, len)) {
+        memset(target, 0, len);
+        return;
+    }
     memcpy(target, bytecode->data + bytecode->index, len);
     bytecode->index += len;
 }
@@ -379,3 +954,343 @@ char *field2str(const char fld_type) {
     }
 }
 
+
+typedef enum {
+    STREAM_HEADER, /* the magic, versions and pool count */
+    STREAM_POOL_TAG,
+    STREAM_POOL_ENTRY, /* the fixed width after a tag */
+    STREAM_POOL_STRING, /* the bytes of a UTF-8 entry */
+    STREAM_CLASS, /* access flags, this, super and the interfaces count */
+    STREAM_INTERFACES,
+    STREAM_COUNT, /* the count of the fields, the methods or the class attributes */
+    STREAM_MEMBER,
+    STREAM_ATTRIBUTE,
+    STREAM_ATTRIBUTE_BODY,
+    STREAM_DONE
+} StreamState;
+
+/* The tables after the constant pool, in the order they come */
+typedef enum {
+    TABLE_FIELDS,
+    TABLE_METHODS,
+    TABLE_ATTRIBUTES
+} StreamTable;
+
+struct ClassStream {
+    Class *class;
+    int err; /* the error that stopped the parse, or 0 */
+    bool exhausted; /* the arena had run out before the class was started, see read_class_err() */
+    uint8_t state; /* a StreamState */
+    uint32_t attribute_limit;
+    uint32_t want; /* bytes the state still needs before stream_step() can act on them */
+    char *fill; /* where those bytes go, or NULL to step over them */
+    char unit[10]; /* a fixed-width structure, the header being the widest */
+    char *pool; /* the constant pool's encoding so far, parsed once it is whole and then freed */
+    size_t pool_length;
+    size_t pool_capacity;
+    size_t entry; /* the offset in pool of the entry being read */
+    uint32_t pool_index; /* its index */
+    uint8_t table; /* a StreamTable */
+    uint16_t count; /* members in the table */
+    uint16_t index; /* the member being read */
+    Attribute *attrs; /* the attribute table being filled, or NULL if it is stepped over */
+    uint16_t attrs_count;
+    uint16_t attr_index;
+};
+
+/* Read the next n bytes into stream->unit, then act on them in state */
+static void stream_unit(ClassStream *stream, uint8_t state, uint32_t n) {
+    stream->state = state;
+    stream->fill = stream->unit;
+    stream->want = n;
+}
+
+/* Append the next n bytes to the pool's encoding, then act on them in state */
+static int stream_pool_bytes(ClassStream *stream, uint8_t state, uint32_t n) {
+    if (stream->pool_length + n > INT32_MAX) {
+        // past what the Bytecode given to parse_const_pool() can address
+        return EFBIG;
+    }
+    if (stream->pool_length + n > stream->pool_capacity) {
+        size_t capacity = stream->pool_capacity > 0 ? stream->pool_capacity * 2 : ARENA_MIN_BLOCK;
+        while (capacity < stream->pool_length + n) {
+            capacity *= 2;
+        }
+        char *pool = realloc(stream->pool, capacity);
+        if (pool == NULL) {
+            return ENOMEM;
+        }
+        stream->pool = pool;
+        stream->pool_capacity = capacity;
+    }
+    stream->state = state;
+    stream->fill = stream->pool + stream->pool_length;
+    stream->want = n;
+    stream->pool_length += n;
+    return 0;
+}
+
+/* Start on pool entry stream->pool_index, or parse the whole pool once every entry is in */
+static int stream_pool_next(ClassStream *stream) {
+    Class *
+    class = stream->class;
+    if (stream->pool_index < class->const_pool_count) {
+        stream->entry = stream->pool_length;
+        return stream_pool_bytes(stream, STREAM_POOL_TAG, 1);
+    }
+    Bytecode bytecode = {.data = stream->pool, .length = (long) stream->pool_length, .index = 0};
+    parse_const_pool(
+    class, class->const_pool_count, &bytecode);
+    free(stream->pool);
+    stream->pool = NULL;
+    if (class->pool_size_bytes == 0) {
+        return (class->arena->exhausted && !stream->exhausted) ||
+        class->pool.symbols_exhausted ? ENOMEM : EINVAL;
+    }
+    stream_unit(stream, STREAM_CLASS, 8);
+    return 0;
+}
+
+/* Start on member stream->index of the current table, or on the count of the table after it */
+static void stream_member_next(ClassStream *stream) {
+    if (stream->index < stream->count) {
+        stream_unit(stream, STREAM_MEMBER, 8);
+    } else {
+        stream->table++;
+        stream_unit(stream, STREAM_COUNT, 2);
+    }
+}
+
+/* Start on attribute stream->attr_index of the current table, or move on once the table is done */
+static void stream_attribute_next(ClassStream *stream) {
+    if (stream->attr_index < stream->attrs_count) {
+        stream_unit(stream, STREAM_ATTRIBUTE, 6);
+    } else if (stream->table == TABLE_ATTRIBUTES) {
+        stream->state = STREAM_DONE;
+    } else {
+        stream->index++;
+        stream_member_next(stream);
+    }
+}
+
+/* Act on the bytes the state asked for now that they are all in, and ask for the next ones. Returns 0 or the error
+ * that stops the parse. */
+static int stream_step(ClassStream *stream) {
+    Class *
+    class = stream->class;
+    Arena *arena =
+    class->arena;
+    uint32_t sections =
+    class->sections;
+    const char *unit = stream->unit;
+    uint32_t wanted;
+    switch (stream->state) {
+        case STREAM_HEADER:
+            if (load_u4(unit) != 0xcafebabe) {
+                return EINVAL;
+            }
+            class->minor_version = load_u2(unit + 4);
+            class->major_version = load_u2(unit + 6);
+            class->const_pool_count = load_u2(unit + 8);
+            stream->pool_index = 1;
+            return stream_pool_next(stream);
+        case STREAM_POOL_TAG: {
+            const CPoolLayout *layout = layout_of((uint8_t) stream->pool[stream->entry]);
+            if (layout->width == 0) {
+                return EINVAL;
+            }
+            return stream_pool_bytes(stream, STREAM_POOL_ENTRY, layout->width);
+        }
+        case STREAM_POOL_ENTRY: {
+            const char *entry = stream->pool + stream->entry;
+            if ((uint8_t) entry[0] == STRING_UTF8) {
+                return stream_pool_bytes(stream, STREAM_POOL_STRING, load_u2(entry + 1));
+            }
+            stream->pool_index += layout_of((uint8_t) entry[0])->entries;
+            return stream_pool_next(stream);
+        }
+        case STREAM_POOL_STRING:
+            stream->pool_index++;
+            return stream_pool_next(stream);
+        case STREAM_CLASS:
+            class->flags = load_u2(unit);
+            class->this_class = load_u2(unit + 2);
+            class->super_class = load_u2(unit + 4);
+            class->interfaces_count = load_u2(unit + 6);
+            if (sections & (PARSE_MEMBER_ATTRIBUTES | PARSE_CLASS_ATTRIBUTES)) {
+                class->pool.attribute_kinds = arena_calloc(arena,
+                class->const_pool_count, sizeof(uint8_t));
+                if (class->pool.attribute_kinds == NULL) {
+                    return ENOMEM;
+                }
+            }
+            class->interfaces = arena_calloc(arena,
+            class->interfaces_count, sizeof(uint16_t));
+            if (class->interfaces == NULL) {
+                return ENOMEM;
+            }
+            stream->state = STREAM_INTERFACES;
+            stream->fill = (char *)
+            class->interfaces;
+            stream->want = 2 *
+            class->interfaces_count;
+            return 0;
+        case STREAM_INTERFACES:
+            // decoded in place, which swap_u2 allows
+            swap_u2(
+            class->interfaces,
+            class->interfaces,
+            class->interfaces_count);
+            stream->table = TABLE_FIELDS;
+            stream_unit(stream, STREAM_COUNT, 2);
+            return 0;
+        case STREAM_COUNT:
+            stream->count = load_u2(unit);
+            stream->index = 0;
+            if (stream->table == TABLE_FIELDS && (sections & PARSE_FIELDS)) {
+                class->fields_count = stream->count;
+                class->fields = arena_calloc(arena, stream->count, sizeof(Field));
+                if (class->fields == NULL) {
+                    return ENOMEM;
+                }
+            } else if (stream->table == TABLE_METHODS && (sections & PARSE_METHODS)) {
+                class->methods_count = stream->count;
+                class->methods = arena_calloc(arena, stream->count, sizeof(Method));
+                if (class->methods == NULL) {
+                    return ENOMEM;
+                }
+            } else if (stream->table == TABLE_ATTRIBUTES) {
+                stream->attrs = NULL;
+                stream->attrs_count = stream->count;
+                stream->attr_index = 0;
+                if (sections & PARSE_CLASS_ATTRIBUTES) {
+                    class->attributes_count = stream->count;
+                    class->attributes = stream->attrs = arena_calloc(arena, stream->count, sizeof(Attribute));
+                    if (stream->attrs == NULL) {
+                        return ENOMEM;
+                    }
+                }
+                stream_attribute_next(stream);
+                return 0;
+            }
+            stream_member_next(stream);
+            return 0;
+        case STREAM_MEMBER: {
+            Field member = {
+                    .flags = load_u2(unit), .name_idx = load_u2(unit + 2), .desc_idx = load_u2(unit + 4)
+            };
+            // a table the sections leave out is stepped over whole, its attributes included
+            bool wanted_table = (sections & (stream->table == TABLE_FIELDS ? PARSE_FIELDS : PARSE_METHODS)) != 0;
+            stream->attrs = NULL;
+            stream->attrs_count = load_u2(unit + 6);
+            stream->attr_index = 0;
+            if (wanted_table && (sections & PARSE_MEMBER_ATTRIBUTES)) {
+                member.attrs_count = stream->attrs_count;
+                member.attrs = stream->attrs = arena_calloc(arena, stream->attrs_count, sizeof(Attribute));
+                if (stream->attrs == NULL) {
+                    return ENOMEM;
+                }
+            }
+            if (wanted_table && stream->table == TABLE_FIELDS) {
+                class->fields[stream->index] = member;
+            } else if (wanted_table) {
+                Method *m =
+                class->methods + stream->index;
+                m->flags = member.flags;
+                m->name_idx = member.name_idx;
+                m->desc_idx = member.desc_idx;
+                m->attrs_count = member.attrs_count;
+                m->attrs = member.attrs;
+            }
+            stream_attribute_next(stream);
+            return 0;
+        }
+        case STREAM_ATTRIBUTE:
+            wanted = load_u4(unit + 2);
+            stream->state = STREAM_ATTRIBUTE_BODY;
+            stream->fill = NULL;
+            stream->want = wanted;
+            if (stream->attrs != NULL) {
+                Attribute *attr = stream->attrs + stream->attr_index;
+                attr->name_idx = load_u2(unit);
+                attr->kind = resolve_kind(
+                class, attr->name_idx);
+                attr->length = wanted;
+                if (wanted <= stream->attribute_limit) {
+                    char *info = arena_alloc(arena, (size_t) wanted + 1);
+                    if (info == NULL) {
+                        return ENOMEM;
+                    }
+                    info[wanted] = '\0';
+                    attr->info = stream->fill = info;
+                }
+            }
+            return 0;
+        case STREAM_ATTRIBUTE_BODY:
+            stream->attr_index++;
+            stream_attribute_next(stream);
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+ClassStream *class_stream_create(const ParseOptions *opts, uint32_t attribute_limit) {
+    ClassStream *stream = calloc(1, sizeof(ClassStream));
+    if (stream == NULL) {
+        return NULL;
+    }
+    Arena *arena = opts != NULL ? opts->arena : NULL;
+    bool owns_arena = arena == NULL;
+    if (owns_arena && (arena = arena_create(ARENA_MIN_BLOCK)) == NULL) {
+        free(stream);
+        return NULL;
+    }
+    stream->exhausted = arena->exhausted;
+    stream->class = arena_calloc(arena, 1, sizeof(Class));
+    if (stream->class == NULL) {
+        if (owns_arena) {
+            arena_destroy(arena);
+        }
+        free(stream);
+        return NULL;
+    }
+    // there is no one buffer for payloads to point into
+    init_class(stream->class, opts, arena, owns_arena, NULL);
+    stream->attribute_limit = attribute_limit;
+    stream_unit(stream, STREAM_HEADER, 10);
+    return stream;
+}
+
+int class_stream_feed(ClassStream *stream, const char *data, size_t length) {
+    while (stream->err == 0 && stream->state != STREAM_DONE) {
+        if (stream->want == 0) {
+            stream->err = stream_step(stream);
+            continue;
+        }
+        if (length == 0) {
+            break;
+        }
+        size_t n = stream->want < length ? stream->want : length;
+        if (stream->fill != NULL) {
+            memcpy(stream->fill, data, n);
+            stream->fill += n;
+        }
+        stream->want -= n;
+        data += n;
+        length -= n;
+    }
+    return stream->err != 0 ? stream->err : stream->state == STREAM_DONE ? 0 : EAGAIN;
+}
+
+int class_stream_finish(ClassStream *stream, Class **class) {
+    int err = stream->err != 0 ? stream->err : stream->state == STREAM_DONE ? 0 : ENODATA;
+    if (err == 0 && class != NULL) {
+        *class = stream->class;
+    } else {
+        free_class(stream->class);
+    }
+    free(stream->pool);
+    free(stream);
+    return err;
+}
@@ -1,10 +1,13 @@
 #ifndef CLASS_H
 #define CLASS_H
 
+#include "arena.h"
+#include "cursor.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include "symbols.h"
 
 #define u2 uint16_t
 #define u4 uint32_t
@@ -20,10 +23,46 @@ typedef enum {
     ACC_ENUM = 0x4000
 } AccessFlags;
 
+/* The attributes the JVM spec predefines (section 4.7), so consumers can pick attributes out without comparing names */
+typedef enum {
+    ATTR_UNKNOWN = 0, /* any other name, or a name_idx that is not a UTF-8 entry */
+    ATTR_CONSTANT_VALUE,
+    ATTR_CODE,
+    ATTR_STACK_MAP_TABLE,
+    ATTR_BOOTSTRAP_METHODS,
+    ATTR_NEST_HOST,
+    ATTR_NEST_MEMBERS,
+    ATTR_PERMITTED_SUBCLASSES,
+    ATTR_EXCEPTIONS,
+    ATTR_INNER_CLASSES,
+    ATTR_ENCLOSING_METHOD,
+    ATTR_SYNTHETIC,
+    ATTR_SIGNATURE,
+    ATTR_RECORD,
+    ATTR_SOURCE_FILE,
+    ATTR_LINE_NUMBER_TABLE,
+    ATTR_LOCAL_VARIABLE_TABLE,
+    ATTR_LOCAL_VARIABLE_TYPE_TABLE,
+    ATTR_SOURCE_DEBUG_EXTENSION,
+    ATTR_DEPRECATED,
+    ATTR_RUNTIME_VISIBLE_ANNOTATIONS,
+    ATTR_RUNTIME_INVISIBLE_ANNOTATIONS,
+    ATTR_RUNTIME_VISIBLE_PARAMETER_ANNOTATIONS,
+    ATTR_RUNTIME_INVISIBLE_PARAMETER_ANNOTATIONS,
+    ATTR_RUNTIME_VISIBLE_TYPE_ANNOTATIONS,
+    ATTR_RUNTIME_INVISIBLE_TYPE_ANNOTATIONS,
+    ATTR_ANNOTATION_DEFAULT,
+    ATTR_METHOD_PARAMETERS,
+    ATTR_MODULE,
+    ATTR_MODULE_PACKAGES,
+    ATTR_MODULE_MAIN_CLASS
+} AttributeKind;
+
 typedef struct {
     uint16_t name_idx;
+    uint8_t kind; /* an AttributeKind, resolved from the name once per class */
     uint32_t length;
-    char *info;
+    const char *info; /* length bytes; NUL-terminated only when owned by the Class. NULL if a ClassStream stepped over them. */
 } Attribute;
 
 /* A wrapper for FILE structs that also holds the file name.  */
@@ -62,9 +101,13 @@ typedef struct {
 
 typedef struct {
     uint16_t length;
-    char *value;
+    bool ascii; /* the bytes are all ASCII, so the Modified UTF-8 is also standard UTF-8 */
+    const char *value; /* length bytes of Modified UTF-8; NUL-terminated only when owned by the Class or symbols */
+    uint32_t symbol; /* the id in ParseOptions.symbols, or SYMBOL_NONE if the class was parsed without one */
+    uint32_t hash; /* symbols_hash() of the bytes when symbol is set */
 } String;
 
+/* A decoded constant pool entry, as returned by get_item() */
 typedef struct {
     uint8_t tag; // the tag byte
     union {
@@ -77,32 +120,70 @@ typedef struct {
     } value;
 } Item;
 
+/* The strings a Class, Fieldref, Methodref, InterfaceMethodref or NameAndType entry leads to, as returned by
+ * resolve_ref(). The value of any the entry has no use for, or that does not lead to a UTF-8 entry, is NULL. */
+typedef struct {
+    String owner; /* the name of a Class entry, or of a reference's class */
+    String name; /* a reference's or NameAndType's name */
+    String descriptor; /* a reference's or NameAndType's descriptor */
+} ResolvedRef;
+
+/* The constant pool stored column-wise: a dense tag array and a parallel array of 32-bit slots, both indexed by pool index
+ * (entry 0 is unused). A slot holds
+ *  - STRING_UTF8: the offset from bytes to the first byte; the big-endian u2 length sits in the two bytes before it
+ *  - INTEGER, FLOAT: the value's 32 bits in host order
+ *  - LONG, DOUBLE: the high word; the low word is in the next slot, whose tag is 0
+ *  - references: the first index in the upper 16 bits and the second, if any, in the lower 16 bits; a METHOD_HANDLE's
+ *    reference kind counts as its first index
+ * A lazy pool (PARSE_LAZY_POOL) instead keeps every slot as the offset from bytes to the entry's payload, which bytes
+ * points at in its encoded form, and get_item() decodes it when asked.
+ * A pool parsed with a SymbolTable keeps the symbol id in the slot of a UTF-8 entry instead, and the string in the table.
+ * A pool parsed without PARSE_POOL_STRINGS keeps nothing for its UTF-8 entries but their tags, and bytes is NULL.
+ */
+typedef struct {
+    uint8_t *tags;
+    uint32_t *slots;
+    const char *bytes; /* class->source, a copy of every UTF-8 entry with a NUL after each, or a lazy pool's encoding */
+    uint8_t *utf8_kind; /* per entry, a UTF8_KIND once get_item() or a strict parse has looked at a UTF-8 entry */
+    uint32_t utf8_bytes; /* size of the UTF-8 copy */
+    uint32_t raw_bytes; /* size of a lazy pool's encoding */
+    SymbolTable *symbols; /* ParseOptions.symbols, for a pool that is not lazy */
+    ResolvedRef *resolved; /* every entry resolved, built by the first resolve_ref() */
+    uint8_t *attribute_kinds; /* AttributeKind + 1 of each entry used as an attribute name, 0 until it is looked up */
+    bool symbols_exhausted; /* symbols ran out of memory during the parse */
+    bool lazy;
+    bool strict_utf8; /* PARSE_STRICT_UTF8 */
+} ConstPool;
+
 /* The .class structure */
 typedef struct {
     uint16_t minor_version;
     uint16_t major_version;
     uint16_t const_pool_count;
     uint32_t pool_size_bytes;
-    Item *items;
+    ConstPool pool;
     uint16_t flags;
     uint16_t this_class;
     uint16_t super_class;
     uint16_t interfaces_count;
-    Ref *interfaces;
+    uint16_t *interfaces; /* pool indexes of the interfaces' Class entries */
     uint16_t fields_count;
     Field *fields;
     uint16_t methods_count;
     Method *methods;
     uint16_t attributes_count;
     Attribute *attributes;
+    /* The ParseSections parsed; the counts of the others are 0 */
+    uint32_t sections;
+    /* The Bytecode buffer that String and Attribute payloads point into, or NULL if the Class owns copies of them.
+     * When set the buffer must stay mapped and unmodified until the Class is freed or detach_class() is called. */
+    const char *source;
+    /* Every allocation made for the Class, including the Class itself, comes from this arena */
+    Arena *arena;
+    /* True when arena was created for this Class alone and free_class() should release it */
+    bool owns_arena;
 } Class;
 
-typedef struct {
-    char *data;
-    long length;
-    int index;
-} Bytecode;
-
 typedef enum {
     STRING_UTF8 = 1, /* occupies 2+x bytes */
     INTEGER = 3, /* 32bit two's-compliment big endian int */
@@ -115,47 +196,116 @@ typedef enum {
     METHOD = 10, /* Method reference: two indexes within the constant pool, the first pointing to a Class reference, the second to a Name and Type descriptor. */
     INTERFACE_METHOD = 11, /* Interface method reference: two indexes within the constant pool, the first pointing to a Class reference, the second to a Name and Type descriptor. */
     NAME = 12, /* Name and type descriptor: 2 indexes to UTF-8 strings, the first representing a name and the second a specially encoded type descriptor. */
-    METHOD_HANDLE = 15,
-    METHOD_TYPE = 16,
-    INVOKE_DYNAMIC = 18
+    METHOD_HANDLE = 15, /* Method handle: a reference kind byte and an index to a field, method or interface method reference */
+    METHOD_TYPE = 16, /* Method type: an index to a UTF-8 method descriptor */
+    DYNAMIC = 17, /* Dynamically computed constant: an index into the BootstrapMethods attribute and one to a Name and Type */
+    INVOKE_DYNAMIC = 18, /* Dynamically computed call site: laid out as DYNAMIC */
+    MODULE = 19, /* Module: an index to a UTF-8 module name */
+    PACKAGE = 20 /* Package: an index to a UTF-8 package name in internal form */
 } CPool_t;
 
-static char *CPool_strings[] = {
-        "Undefined", // 0
-        "String_UTF8",
-        "Undefined", // 2
-        "Integer",
-        "Float",
-        "Long",
-        "Double",
-        "Class",
-        "String",
-        "Field",
-        "Method",
-        "InterfaceMethod",
-        "Name",
-        "Undefined", // 13
-        "Undefined", // 14
-        "MethodHandle",
-        "MethodType",
-        "InvokeDynamic"
-};
+/* What is known of a UTF-8 entry's bytes. The scan is left to the first get_item() so that parsing never touches
+ * strings nobody asks for. */
+typedef enum {
+    UTF8_UNKNOWN = 0,
+    UTF8_ASCII = 1, /* all ASCII, so the Modified UTF-8 is also standard UTF-8 */
+    UTF8_OTHER = 2
+} UTF8_KIND;
+
+/* Flags for ParseOptions.flags */
+typedef enum {
+    /* Point String and Attribute payloads into the Bytecode buffer rather than copying them out of it */
+    PARSE_ZERO_COPY = 0x01,
+    /* Only index the constant pool's tags and offsets; get_item() decodes entries when they are asked for.
+     * Strings in a lazy pool are never NUL-terminated. */
+    PARSE_LAZY_POOL = 0x02,
+    /* Reject UTF-8 entries that are not well-formed Modified UTF-8, as the JVM does. By default they are kept, and
+     * printers render the malformed bytes as U+FFFD. */
+    PARSE_STRICT_UTF8 = 0x04
+} ParseFlags;
+
+/* Sections of a class for ParseOptions.sections. A section that is not wanted is stepped over by its length
+ * prefixes alone, nothing of it allocated or copied, and reads as empty. */
+typedef enum {
+    /* The UTF-8 entries' strings. Without them a pool that is not lazy keeps each entry's tag but decodes its string
+     * as empty, so attribute names are not known either. */
+    PARSE_POOL_STRINGS = 0x01,
+    PARSE_FIELDS = 0x02,
+    PARSE_METHODS = 0x04,
+    /* The attributes of whichever fields and methods are parsed */
+    PARSE_MEMBER_ATTRIBUTES = 0x08,
+    PARSE_CLASS_ATTRIBUTES = 0x10,
+    PARSE_ALL_SECTIONS = 0x1f
+} ParseSections;
+
+typedef struct {
+    uint32_t flags;
+    /* Allocate the Class from this arena instead of a private one. The caller then releases the Class by resetting or
+     * destroying the arena, typically once per file in a scanning loop. */
+    Arena *arena;
+    /* Intern the constant pool's strings here rather than keep a copy per Class, giving each a symbol id that compares
+     * equal across classes. The table must outlive the Class. Ignored for a lazy pool, which reads no strings up
+     * front. */
+    SymbolTable *symbols;
+    /* The ParseSections wanted, or 0 for all of them. Only the strings are needed for this, super and the interfaces. */
+    uint32_t sections;
+} ParseOptions;
 
 enum RANGES {
     /* The smallest permitted value for a tag byte */
             MIN_CPOOL_TAG = 1,
 
     /* The largest permitted value for a tag byte */
-            MAX_CPOOL_TAG = 18
+            MAX_CPOOL_TAG = 20
 };
 
 
 /* Parse the given opcode array into a Class struct. */
 Class *read_class(Bytecode *bytecode);
 
-/* Parse the attribute properties from opcode array into attr.
+/* As read_class() but with the given options. opts may be NULL for the defaults. */
+Class *read_class_opts(Bytecode *bytecode, const ParseOptions *opts);
+
+/* As read_class_opts() but says why parsing failed. Returns 0 and sets *class on success, EINVAL if bytecode is not a
+ * valid class file, ENODATA if it ends part way through a structure, EFBIG if its length does not fit an int, or
+ * ENOMEM if the arena could not supply the memory. */
+int read_class_err(Bytecode *bytecode, const ParseOptions *opts, Class **class);
+
+/* A class parsed from input pushed to it in pieces of any size, for input that never sits whole in one buffer: a
+ * network stream, a decompressor or a pipe. Only the constant pool is held back until it is complete; everything else
+ * goes straight into the Class as it arrives. */
+typedef struct ClassStream ClassStream;
+
+/* Start a class parsed from input given to class_stream_feed(). opts is as for read_class_opts(), though
+ * PARSE_ZERO_COPY is ignored for want of a buffer to point into. Attribute bodies longer than attribute_limit bytes
+ * are stepped over rather than buffered, their info left NULL; UINT32_MAX keeps them all. Returns NULL if memory ran
+ * out. */
+ClassStream *class_stream_create(const ParseOptions *opts, uint32_t attribute_limit);
+
+/* Parse the length bytes at data, which follow those given before. Returns EAGAIN while the class needs more input,
+ * 0 once it is complete, after which further input is ignored, or the error read_class_err() would give. An error
+ * stops the parse and is returned from then on. */
+int class_stream_feed(ClassStream *stream, const char *data, size_t length);
+
+/* Free stream. Returns 0 and sets *class to the class if it was complete, or else frees the class and returns
+ * ENODATA if input ended part way through it, or the error that stopped the parse. class may be NULL to abandon the
+ * stream and its class. */
+int class_stream_finish(ClassStream *stream, Class **class);
+
+/* Release everything allocated for class in O(1). Does nothing if the class lives in a caller-supplied arena. */
+void free_class(Class *class);
+
+/* Copy every payload still pointing into class->source into class's arena, so the source buffer may be released.
+ * Returns false if memory ran out, in which case class still borrows from the buffer. */
+bool detach_class(Class *class);
+
+/* Parse the attribute properties from opcode array into attr, copying or viewing the payload as class->source dictates.
+ * Returns false if the attribute runs past the end of bytecode or its copy could not be allocated.
  * See section 4.7 of the JVM spec. */
-void parse_attribute(Bytecode *bytecode, Attribute *attr);
+bool parse_attribute(const Class *class, Bytecode *bytecode, Attribute *attr);
+
+/* The AttributeKind of the attribute named by the length bytes at name, ATTR_UNKNOWN if it is not a predefined one */
+AttributeKind attribute_kind(const char *name, size_t length);
 
 /* Parse the constant pool into class from opcode array. index MUST be at the correct seek point i.e. byte offset 11.
  * The number of bytes read is returned. A return value of 0 signifies an invalid constant pool and class may have been changed.
@@ -163,17 +313,23 @@ void parse_attribute(Bytecode *bytecode, Attribute *attr);
  */
 void parse_const_pool(Class *class, const uint16_t const_pool_count, Bytecode *bytecode);
 
-/* Parse the initial section of the given byteopcode array up to and including the constant_pool_size section */
-void parse_header(Bytecode *bytecode, Class *class);
+/* Parse the initial section of the given byteopcode array up to and including the constant_pool_size section.
+ * Returns false if bytecode is too short to hold it. */
+bool parse_header(Bytecode *bytecode, Class *class);
 
 /* Return true if class's first four bytes match 0xcafebabe. */
 bool is_class(Bytecode *bytecode);
 
-/* Return the item pointed to by cp_idx, the index of an item in the constant pool */
-Item *get_item(const Class *class, const uint16_t cp_idx);
+/* Decode the item at cp_idx, the index of an item in the constant pool. The tag is 0 if cp_idx is out of range. */
+Item get_item(const Class *class, const uint16_t cp_idx);
+
+/* Resolve a Class's name by following the class_idx of the item at index */
+Item get_class_string(const Class *class, const uint16_t index);
 
-/* Resolve a Class's name by following class->items[index].ref.class_idx */
-Item *get_class_string(const Class *class, const uint16_t index);
+/* The owner, name and descriptor strings entry cp_idx leads to, every value NULL if cp_idx is out of range. The first
+ * call resolves every entry into a table from class's arena, so it must not race with other calls on the same class;
+ * later calls are one array index. Should memory run out, the entry is resolved on its own instead. */
+ResolvedRef resolve_ref(const Class *class, uint16_t cp_idx);
 
 /* Convert the high and low bits of dbl to a double type */
 double to_double(const Double dbl);
@@ -184,15 +340,14 @@ long to_long(Long lng);
 /* Convert the 2-byte field type to a friendly string e.g. "J" to "long" */
 char *field2str(const char fld_type);
 
-/* Convert tag byte to its string name/label */
-static inline char *tag2str(uint8_t tag) {
-    return CPool_strings[tag];
-}
+/* Convert tag byte to its string name/label, "Undefined" for tags the JVM spec does not define */
+const char *tag2str(uint8_t tag);
 
 /* Write the name and class stats/contents to the given stream. */
 void print_class(const Class *class);
 
-/* Continuously copy bytecode array from memory */
+/* Continuously copy bytecode array from memory. Past the end of bytecode the target is zeroed and bytecode marked
+ * truncated instead. */
 void bytecode_memcpy(void *target, Bytecode *bytecode, size_t len);
 
 uint16_t generic_be16toh(void *memory);
@@ -0,0 +1,226 @@
+#include "classpath.h"
+#include "class.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include "jar.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* Size of the buffer directory entries are read into, many entries per system call */
+#define DENTS_BUFFER (32 * 1024)
+
+/* The record getdents64 fills the buffer with */
+typedef struct {
+    uint64_t d_ino;
+    int64_t d_off;
+    uint16_t d_reclen;
+    uint8_t d_type;
+    char d_name[];
+} Dirent64;
+
+static bool add_file(Classpath *cp, const char *dir, const char *name, uint64_t inode, uint64_t size) {
+    if (cp->files_count == cp->files_capacity) {
+        size_t grown = cp->files_capacity > 0 ? cp->files_capacity * 2 : 256;
+        ClasspathFile *files = realloc(cp->files, grown * sizeof(ClasspathFile));
+        if (files == NULL) {
+            return false;
+        }
+        cp->files = files;
+        cp->files_capacity = grown;
+    }
+    size_t dir_len = strlen(dir), name_len = strlen(name);
+    char *path = malloc(dir_len + name_len + 2);
+    if (path == NULL) {
+        return false;
+    }
+    memcpy(path, dir, dir_len);
+    path[dir_len] = '/';
+    memcpy(path + dir_len + 1, name, name_len + 1);
+    ClasspathFile *file = cp->files + cp->files_count++;
+    file->path = path;
+    file->inode = inode;
+    file->size = size;
+    return true;
+}
+
+static bool add_jar(Classpath *cp, const char *path, size_t len) {
+    if (cp->jars_count == cp->jars_capacity) {
+        size_t grown = cp->jars_capacity > 0 ? cp->jars_capacity * 2 : 16;
+        char **jars = realloc(cp->jars, grown * sizeof(char *));
+        if (jars == NULL) {
+            return false;
+        }
+        cp->jars = jars;
+        cp->jars_capacity = grown;
+    }
+    char *copy = strndup(path, len);
+    if (copy == NULL) {
+        return false;
+    }
+    cp->jars[cp->jars_count++] = copy;
+    return true;
+}
+
+/* Keep the file name in dirfd if its first four bytes are the class file magic. Only those four bytes are read. */
+static bool sniff(Classpath *cp, int dirfd, const char *dir, const char *name) {
+    int fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        return true; // vanished or unreadable: not ours to report
+    }
+    struct stat st;
+    char magic[4];
+    bool kept = true;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && pread(fd, magic, sizeof(magic), 0) == sizeof(magic)) {
+        Bytecode bytecode = {.data = magic, .length = sizeof(magic), .index = 0};
+        if (is_class(&bytecode)) {
+            kept = add_file(cp, dir, name, st.st_ino, st.st_size);
+        } else {
+            cp->skipped++;
+        }
+    }
+    close(fd);
+    return kept;
+}
+
+/* Recursively collect the class files below the directory dirfd, whose path is dir. Takes ownership of dirfd. */
+static int walk(Classpath *cp, int dirfd, const char *dir) {
+    char *buffer = malloc(DENTS_BUFFER);
+    if (buffer == NULL) {
+        close(dirfd);
+        return ENOMEM;
+    }
+    int err = 0;
+    while (err == 0) {
+        long n = syscall(SYS_getdents64, dirfd, buffer, DENTS_BUFFER);
+        if (n <= 0) {
+            err = n < 0 ? errno : 0;
+            break;
+        }
+        long pos = 0;
+        while (pos < n && err == 0) {
+            Dirent64 *d = (Dirent64 *) (buffer + pos);
+            pos += d->d_reclen;
+            const char *name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            uint8_t type = d->d_type;
+            if (type == DT_UNKNOWN) {
+                // some filesystems don't report types; symlinked directories are deliberately not followed
+                struct stat st;
+                if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                    continue;
+                }
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : S_ISLNK(st.st_mode) ? DT_LNK : 0;
+            }
+            if (type == DT_DIR) {
+                int child = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+                if (child < 0) {
+                    continue;
+                }
+                size_t dir_len = strlen(dir), name_len = strlen(name);
+                char *path = malloc(dir_len + name_len + 2);
+                if (path == NULL) {
+                    close(child);
+                    err = ENOMEM;
+                    break;
+                }
+                memcpy(path, dir, dir_len);
+                path[dir_len] = '/';
+                memcpy(path + dir_len + 1, name, name_len + 1);
+                err = walk(cp, child, path);
+                free(path);
+            } else if ((type == DT_REG || type == DT_LNK) && !sniff(cp, dirfd, dir, name)) {
+                err = ENOMEM;
+            }
+        }
+    }
+    free(buffer);
+    close(dirfd);
+    return err;
+}
+
+static int compare_files(const void *a, const void *b) {
+    const ClasspathFile *fa = a, *fb = b;
+    if (fa->inode != fb->inode) {
+        return fa->inode < fb->inode ? -1 : 1;
+    }
+    return fa->size < fb->size ? -1 : fa->size > fb->size;
+}
+
+int classpath_scan(Classpath *cp, const char *classpath) {
+    int first_err = 0;
+    const char *element = classpath;
+    while (true) {
+        const char *end = strchr(element, ':');
+        size_t len = end != NULL ? (size_t) (end - element) : strlen(element);
+        if (len > 0) {
+            char *path = strndup(element, len);
+            if (path == NULL) {
+                return ENOMEM;
+            }
+            // strip trailing slashes so joined paths read naturally
+            while (len > 1 && path[len - 1] == '/') {
+                path[--len] = '\0';
+            }
+            int err = 0;
+            if (is_jar_name(path)) {
+                err = add_jar(cp, path, len) ? 0 : ENOMEM;
+            } else {
+                int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                if (fd >= 0) {
+                    err = walk(cp, fd, path);
+                } else if (errno == ENOTDIR) {
+                    // a lone class file
+                    const char *slash = strrchr(path, '/');
+                    if (slash == NULL) {
+                        err = sniff(cp, AT_FDCWD, ".", path) ? 0 : ENOMEM;
+                    } else {
+                        char *dir = strndup(path, slash - path);
+                        int dirfd = dir != NULL ? open(slash == path ? "/" : dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+                        err = dirfd < 0 ? errno : sniff(cp, dirfd, dir, slash + 1) ? 0 : ENOMEM;
+                        if (dirfd >= 0) {
+                            close(dirfd);
+                        }
+                        free(dir);
+                    }
+                } else {
+                    err = errno;
+                }
+            }
+            free(path);
+            if (err == ENOMEM) {
+                return err;
+            }
+            if (first_err == 0) {
+                first_err = err;
+            }
+        }
+        if (end == NULL) {
+            break;
+        }
+        element = end + 1;
+    }
+    // read in inode order, which on most filesystems approximates on-disk order
+    qsort(cp->files, cp->files_count, sizeof(ClasspathFile), compare_files);
+    return first_err;
+}
+
+void classpath_free(Classpath *cp) {
+    size_t i;
+    for (i = 0; i < cp->files_count; i++) {
+        free(cp->files[i].path);
+    }
+    for (i = 0; i < cp->jars_count; i++) {
+        free(cp->jars[i]);
+    }
+    free(cp->files);
+    free(cp->jars);
+    memset(cp, 0, sizeof(Classpath));
+}
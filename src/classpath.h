@@ -0,0 +1,36 @@
+#ifndef CLASSPATH_H
+#define CLASSPATH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* A class file found while walking a classpath directory */
+typedef struct {
+    char *path;
+    uint64_t inode;
+    uint64_t size;
+} ClasspathFile;
+
+/* The class files and archives a classpath names. Files are ordered by inode so they are read in roughly on-disk
+ * order; archives keep their classpath order. */
+typedef struct {
+    ClasspathFile *files;
+    size_t files_count;
+    size_t files_capacity;
+    char **jars;
+    size_t jars_count;
+    size_t jars_capacity;
+    uint64_t skipped; /* regular files whose first four bytes were not 0xcafebabe */
+} Classpath;
+
+/* Walk every ':' separated element of classpath into cp, which must be zeroed. Directories are searched recursively,
+ * archives are listed and any other file is kept if it starts with the class file magic. Returns 0 on success,
+ * otherwise the errno value of the first element that could not be read. */
+int classpath_scan(Classpath *cp, const char *classpath);
+
+/* Free everything cp holds */
+void classpath_free(Classpath *cp);
+
+#endif //CLASSPATH_H
@@ -0,0 +1,293 @@
+#include "code.h"
+#include "class.h"
+#include "cursor.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "swap.h"
+
+/* The JVM spec caps code_length below this (4.7.3), which keeps every offset and table size below in 32 bits */
+#define MAX_CODE_LENGTH 65536
+
+typedef struct {
+    uint8_t length; /* of the instruction with its operands, 0 where it varies or the opcode is invalid */
+    uint8_t format; /* an OperandFormat */
+} OpcodeInfo;
+
+#define O_NONE {1, OPERANDS_NONE}
+#define O_LOCAL {2, OPERANDS_LOCAL}
+#define O_S1 {2, OPERANDS_S1}
+#define O_S2 {3, OPERANDS_S2}
+#define O_U1 {2, OPERANDS_U1}
+#define O_CP1 {2, OPERANDS_CP1}
+#define O_CP2 {3, OPERANDS_CP2}
+#define O_BR2 {3, OPERANDS_BRANCH2}
+#define O_BR4 {5, OPERANDS_BRANCH4}
+#define O_IINC {3, OPERANDS_IINC}
+#define O_TSW {0, OPERANDS_TABLESWITCH}
+#define O_LSW {0, OPERANDS_LOOKUPSWITCH}
+#define O_WIDE {0, OPERANDS_WIDE}
+#define O_INVI {5, OPERANDS_INVOKEINTERFACE}
+#define O_INVD {5, OPERANDS_INVOKEDYNAMIC}
+#define O_MULTI {4, OPERANDS_MULTIANEWARRAY}
+#define O_BAD {0, OPERANDS_INVALID}
+
+/* Every opcode of JVM spec chapter 6, sixteen to a row. The reserved breakpoint and impdep opcodes may not appear in
+ * a class file, so they are invalid along with the unassigned ones. */
+static const OpcodeInfo OPCODES[256] = {
+        /* 0x00 nop to dconst_1 */
+        O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE,
+        O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE,
+        /* 0x10 bipush, sipush, ldc, ldc_w, ldc2_w, iload to aload, then iload_0 on */
+        O_S1, O_S2, O_CP1, O_CP2, O_CP2, O_LOCAL, O_LOCAL, O_LOCAL,
+        O_LOCAL, O_LOCAL, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE,
+        /* 0x20 the rest of the loads */
+        O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE,
+        O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE,
+        /* 0x30 the last array loads, istore to astore, then istore_0 on */
+        O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_LOCAL, O_LOCAL,
+        O_LOCAL, O_LOCAL, O_LOCAL, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE,
+        /* 0x40 stores, array stores and the stack */
+        O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE,
+        O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE,
+        O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE,
+        O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE,
+        /* 0x60 arithmetic */
+        O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE,
+        O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE,
+        O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE,
+        O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE,
+        /* 0x80 ior to lxor, iinc, then conversions */
+        O_NONE, O_NONE, O_NONE, O_NONE, O_IINC, O_NONE, O_NONE, O_NONE,
+        O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE,
+        /* 0x90 the last conversions, comparisons, then ifeq on */
+        O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE, O_NONE,
+        O_NONE, O_BR2, O_BR2, O_BR2, O_BR2, O_BR2, O_BR2, O_BR2,
+        /* 0xa0 the last ifs, goto, jsr, ret, the switches and the returns */
+        O_BR2, O_BR2, O_BR2, O_BR2, O_BR2, O_BR2, O_BR2, O_BR2,
+        O_BR2, O_LOCAL, O_TSW, O_LSW, O_NONE, O_NONE, O_NONE, O_NONE,
+        /* 0xb0 areturn, return, fields, invokes, new, newarray, anewarray, arraylength, athrow */
+        O_NONE, O_NONE, O_CP2, O_CP2, O_CP2, O_CP2, O_CP2, O_CP2,
+        O_CP2, O_INVI, O_INVD, O_CP2, O_U1, O_CP2, O_NONE, O_NONE,
+        /* 0xc0 checkcast, instanceof, the monitors, wide, multianewarray, ifnull, ifnonnull, goto_w, jsr_w */
+        O_CP2, O_CP2, O_NONE, O_NONE, O_WIDE, O_MULTI, O_BR2, O_BR2,
+        O_BR4, O_BR4, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD,
+        /* 0xd0 on */
+        O_BAD, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD,
+        O_BAD, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD,
+        O_BAD, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD,
+        O_BAD, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD,
+        O_BAD, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD,
+        O_BAD, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD, O_BAD
+};
+
+OperandFormat opcode_format(uint8_t opcode) {
+    return OPCODES[opcode].format;
+}
+
+/* The offset of the first table word of a switch at pc, which is padded to a multiple of four from the code's start */
+static uint32_t switch_base(uint32_t pc) {
+    return pc + 1 + (3 - (pc & 3));
+}
+
+/* The length of the instruction at pc, adding the words its switch table takes to *words. Returns 0 if the opcode
+ * is invalid or the instruction runs past length. */
+static uint32_t instruction_length(const uint8_t *code, uint32_t length, uint32_t pc, uint32_t *words) {
+    const OpcodeInfo *info = &OPCODES[code[pc]];
+    uint64_t size = info->length;
+    if (info->format == OPERANDS_WIDE) {
+        uint8_t format = length - pc >= 2 ? OPCODES[code[pc + 1]].format : OPERANDS_INVALID;
+        size = format == OPERANDS_LOCAL ? 4 : format == OPERANDS_IINC ? 6 : 0;
+    } else if (info->format == OPERANDS_TABLESWITCH || info->format == OPERANDS_LOOKUPSWITCH) {
+        uint32_t base = switch_base(pc);
+        bool table = info->format == OPERANDS_TABLESWITCH;
+        // default and low and high, or default and the pair count
+        if (base > length || length - base < (table ? 12u : 8u)) {
+            return 0;
+        }
+        int64_t entries = table ? (int64_t) (int32_t) load_u4(code + base + 8) - (int32_t) load_u4(code + base + 4) + 1
+                                : (int32_t) load_u4(code + base + 4);
+        if (entries < (table ? 1 : 0) || entries > MAX_CODE_LENGTH) {
+            return 0;
+        }
+        uint32_t table_words = table ? 3 + (uint32_t) entries : 2 + 2 * (uint32_t) entries;
+        size = (uint64_t) (base - pc) + 4 * (uint64_t) table_words;
+        if (size <= length - pc) {
+            *words += table_words;
+        }
+    }
+    return size != 0 && size <= length - pc ? (uint32_t) size : 0;
+}
+
+/* Decode the instruction at pc, whose length has been checked, into insn, filling its switch table at *switches */
+static void decode_instruction(const uint8_t *code, uint32_t pc, Instruction *insn, int32_t **switches,
+                               const int32_t *first) {
+    const uint8_t *p = code + pc + 1;
+    uint8_t format = OPCODES[code[pc]].format;
+    insn->offset = pc;
+    insn->opcode = code[pc];
+    if (format == OPERANDS_WIDE) {
+        insn->wide = true;
+        insn->opcode = p[0];
+        insn->operand = load_u2(p + 1);
+        insn->extra = insn->opcode == OP_IINC ? (int16_t) load_u2(p + 3) : 0;
+        return;
+    }
+    switch (format) {
+        case OPERANDS_LOCAL:
+        case OPERANDS_U1:
+        case OPERANDS_CP1:
+            insn->operand = p[0];
+            break;
+        case OPERANDS_S1:
+            insn->operand = (int8_t) p[0];
+            break;
+        case OPERANDS_S2:
+            insn->operand = (int16_t) load_u2(p);
+            break;
+        case OPERANDS_CP2:
+        case OPERANDS_INVOKEDYNAMIC:
+            insn->operand = load_u2(p);
+            break;
+        case OPERANDS_INVOKEINTERFACE:
+        case OPERANDS_MULTIANEWARRAY:
+            insn->operand = load_u2(p);
+            insn->extra = p[2];
+            break;
+        case OPERANDS_BRANCH2:
+            insn->operand = (int32_t) pc + (int16_t) load_u2(p);
+            break;
+        case OPERANDS_BRANCH4:
+            insn->operand = (int32_t) pc + (int32_t) load_u4(p);
+            break;
+        case OPERANDS_IINC:
+            insn->operand = p[0];
+            insn->extra = (int8_t) p[1];
+            break;
+        case OPERANDS_TABLESWITCH:
+        case OPERANDS_LOOKUPSWITCH: {
+            const uint8_t *base = code + switch_base(pc);
+            int32_t *table = *switches;
+            bool lookup = format == OPERANDS_LOOKUPSWITCH;
+            uint32_t words = lookup ? 2 + 2 * load_u4(base + 4)
+                                    : 3 + (uint32_t) ((int32_t) load_u4(base + 8) - (int32_t) load_u4(base + 4) + 1);
+            swap_u4((uint32_t *) table, base, words);
+            // targets are relative to the switch; the low, high, count and matches are not targets
+            table[0] += (int32_t) pc;
+            uint32_t w;
+            for (w = 3; w < words; w += lookup ? 2 : 1) {
+                table[w] += (int32_t) pc;
+            }
+            insn->operand = (int32_t) (table - first);
+            *switches += words;
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/* Decode the exception table and attributes after the code, which cursor is at */
+static int decode_tail(const Class *class, Bytecode *cursor, Code *code) {
+    Arena *arena =
+    class->arena;
+    if (!bytecode_need(cursor, 2)) {
+        return EINVAL;
+    }
+    code->exceptions_count = bytecode_u2(cursor);
+    if (!bytecode_need(cursor, 8 * (size_t) code->exceptions_count + 2)) {
+        return EINVAL;
+    }
+    code->exceptions = arena_calloc(arena, code->exceptions_count, sizeof(ExceptionHandler));
+    if (code->exceptions == NULL) {
+        return ENOMEM;
+    }
+    uint16_t i;
+    for (i = 0; i < code->exceptions_count; i++) {
+        ExceptionHandler *handler = code->exceptions + i;
+        handler->start_pc = bytecode_u2(cursor);
+        handler->end_pc = bytecode_u2(cursor);
+        handler->handler_pc = bytecode_u2(cursor);
+        handler->catch_type = bytecode_u2(cursor);
+    }
+    code->attributes_count = bytecode_u2(cursor);
+    code->attributes = arena_calloc(arena, code->attributes_count, sizeof(Attribute));
+    if (code->attributes == NULL) {
+        return ENOMEM;
+    }
+    for (i = 0; i < code->attributes_count; i++) {
+        Attribute *attr = code->attributes + i;
+        if (!bytecode_need(cursor, 6)) {
+            return EINVAL;
+        }
+        attr->name_idx = bytecode_u2(cursor);
+        attr->length = bytecode_u4(cursor);
+        if (!bytecode_need(cursor, attr->length)) {
+            return EINVAL;
+        }
+        Item name = get_item(
+        class, attr->name_idx);
+        attr->kind = name.tag == STRING_UTF8 ? attribute_kind(name.value.string.value, name.value.string.length)
+                                             : ATTR_UNKNOWN;
+        attr->info = cursor->data + cursor->index;
+        cursor->index += attr->length;
+    }
+    return 0;
+}
+
+int decode_code_attribute(const Class *class, const Attribute *attr, Code *code) {
+    memset(code, 0, sizeof(Code));
+    if (attr->info == NULL || attr->length < 8 || attr->length > INT32_MAX) {
+        return EINVAL;
+    }
+    const uint8_t *info = (const uint8_t *) attr->info;
+    code->max_stack = load_u2(info);
+    code->max_locals = load_u2(info + 2);
+    code->code_length = load_u4(info + 4);
+    code->code = info + 8;
+    if (code->code_length == 0 || code->code_length >= MAX_CODE_LENGTH || code->code_length > attr->length - 8) {
+        return EINVAL;
+    }
+
+    // a first pass sizes the arrays, so the second fills them without growing any
+    uint32_t pc, count = 0, words = 0, size;
+    for (pc = 0; pc < code->code_length; pc += size) {
+        size = instruction_length(code->code, code->code_length, pc, &words);
+        if (size == 0) {
+            return EINVAL;
+        }
+        count++;
+    }
+    code->instructions_count = count;
+    code->instructions = arena_calloc(
+    class->arena, count, sizeof(Instruction));
+    code->switches = arena_calloc(
+    class->arena, words, sizeof(int32_t));
+    if (code->instructions == NULL || code->switches == NULL) {
+        return ENOMEM;
+    }
+    int32_t *switches = code->switches;
+    uint32_t i, ignored = 0;
+    for (i = 0, pc = 0; i < count; i++) {
+        decode_instruction(code->code, pc, code->instructions + i, &switches, code->switches);
+        pc += instruction_length(code->code, code->code_length, pc, &ignored);
+    }
+
+    Bytecode cursor = {.data = attr->info, .length = attr->length, .index = 8 + (int) code->code_length};
+    return decode_tail(
+    class, &cursor, code);
+}
+
+int decode_code(const Class *class, const Method *method, Code *code) {
+    uint16_t i;
+    for (i = 0; i < method->attrs_count; i++) {
+        if (method->attrs[i].kind == ATTR_CODE) {
+            return decode_code_attribute(
+            class, method->attrs + i, code);
+        }
+    }
+    memset(code, 0, sizeof(Code));
+    return ENOENT;
+}
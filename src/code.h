@@ -0,0 +1,91 @@
+#ifndef CODE_H
+#define CODE_H
+
+#include "class.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A method's Code attribute (JVM spec 4.7.3) decoded into its parts, its instructions one array entry each. Nothing is
+ * decoded while the class is parsed: decode_code() does it for the methods a caller asks about. */
+
+/* How an opcode's operands are laid out, from the opcode table */
+typedef enum {
+    OPERANDS_INVALID, /* not an opcode a class file may hold */
+    OPERANDS_NONE,
+    OPERANDS_LOCAL, /* a local variable index: u1, or u2 after wide */
+    OPERANDS_S1, /* bipush */
+    OPERANDS_S2, /* sipush */
+    OPERANDS_U1, /* newarray's array type */
+    OPERANDS_CP1, /* ldc */
+    OPERANDS_CP2, /* a u2 constant pool index */
+    OPERANDS_BRANCH2, /* an s2 offset */
+    OPERANDS_BRANCH4, /* an s4 offset */
+    OPERANDS_IINC, /* a local and an s1 constant, or a u2 and an s2 after wide */
+    OPERANDS_TABLESWITCH,
+    OPERANDS_LOOKUPSWITCH,
+    OPERANDS_WIDE,
+    OPERANDS_INVOKEINTERFACE, /* a u2 pool index, a u1 count and a zero byte */
+    OPERANDS_INVOKEDYNAMIC, /* a u2 pool index and two zero bytes */
+    OPERANDS_MULTIANEWARRAY /* a u2 pool index and u1 dimensions */
+} OperandFormat;
+
+typedef enum {
+    OP_IINC = 0x84,
+    OP_TABLESWITCH = 0xaa,
+    OP_LOOKUPSWITCH = 0xab,
+    OP_WIDE = 0xc4
+} Opcode;
+
+/* One instruction. operand is by format
+ *  - OPERANDS_LOCAL, OPERANDS_IINC: the local; extra is iinc's constant
+ *  - OPERANDS_S1, OPERANDS_S2, OPERANDS_U1: the immediate value
+ *  - OPERANDS_CP1, OPERANDS_CP2 and the invokes and multianewarray: the pool index; extra is invokeinterface's count
+ *    or multianewarray's dimensions
+ *  - OPERANDS_BRANCH2, OPERANDS_BRANCH4: the offset in code of the target, not relative to the instruction
+ *  - the switches: the index in Code.switches of the instruction's table, see there
+ */
+typedef struct {
+    uint32_t offset; /* of the opcode, or of the wide before it, in code */
+    uint8_t opcode; /* for a wide instruction the opcode it widens */
+    bool wide;
+    int16_t extra;
+    int32_t operand;
+} Instruction;
+
+typedef struct {
+    uint16_t start_pc;
+    uint16_t end_pc;
+    uint16_t handler_pc;
+    uint16_t catch_type; /* a Class entry, or 0 for any exception */
+} ExceptionHandler;
+
+typedef struct {
+    uint16_t max_stack;
+    uint16_t max_locals;
+    uint32_t code_length;
+    const uint8_t *code; /* the bytecode, viewing the attribute's info */
+    uint32_t instructions_count;
+    Instruction *instructions;
+    /* Every switch's table one after another. A tableswitch's is its default target, low, high and then high - low + 1
+     * targets; a lookupswitch's its default target, the number of pairs and then each match and its target. Targets
+     * are offsets in code, like those of branches. */
+    int32_t *switches;
+    uint16_t exceptions_count;
+    ExceptionHandler *exceptions;
+    uint16_t attributes_count;
+    Attribute *attributes; /* nested attributes such as LineNumberTable, viewing the attribute's info */
+} Code;
+
+/* The operand layout of opcode */
+OperandFormat opcode_format(uint8_t opcode);
+
+/* Decode the Code attribute attr of a method of class into code, allocating from class's arena, so the call must not
+ * race with others on the same class. The result views attr's info and lives as long as it does. Returns 0, EINVAL if
+ * the attribute is malformed or its body was not kept, or ENOMEM if the arena ran out. */
+int decode_code_attribute(const Class *class, const Attribute *attr, Code *code);
+
+/* As decode_code_attribute() for method's Code attribute. Returns ENOENT if it has none, as for abstract and native
+ * methods. */
+int decode_code(const Class *class, const Method *method, Code *code);
+
+#endif //CODE_H
@@ -0,0 +1,70 @@
+#ifndef CURSOR_H
+#define CURSOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A read-only view of a class file's bytes. The data is not owned and is never written to.
+ *
+ * Parsers read it a structure at a time: bytecode_need() checks once that the whole structure is there, then the
+ * bytecode_u1/u2/u4() calls for its fields read without further checks. A structure that runs past length sets
+ * truncated instead, and nothing is read. */
+typedef struct {
+    const char *data;
+    long length;
+    int index;
+    bool truncated; /* set once a structure was found to run past length */
+} Bytecode;
+
+/* Big-endian values at p, which need not be aligned. The byte order is known at compile time, so each is a single
+ * load followed on little-endian hosts by a byte swap. */
+static inline uint16_t load_u2(const void *p) {
+    uint16_t value;
+    memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return value;
+#else
+    return __builtin_bswap16(value);
+#endif
+}
+
+static inline uint32_t load_u4(const void *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return value;
+#else
+    return __builtin_bswap32(value);
+#endif
+}
+
+/* Return true if the next n bytes are all within bytecode. Otherwise mark it truncated and return false. */
+static inline bool bytecode_need(Bytecode *bytecode, size_t n) {
+    if ((unsigned long) (bytecode->length - bytecode->index) >= n) {
+        return true;
+    }
+    bytecode->truncated = true;
+    return false;
+}
+
+/* Unchecked reads of the next value, for use after bytecode_need() has covered it */
+static inline uint8_t bytecode_u1(Bytecode *bytecode) {
+    return (uint8_t) bytecode->data[bytecode->index++];
+}
+
+static inline uint16_t bytecode_u2(Bytecode *bytecode) {
+    uint16_t value = load_u2(bytecode->data + bytecode->index);
+    bytecode->index += 2;
+    return value;
+}
+
+static inline uint32_t bytecode_u4(Bytecode *bytecode) {
+    uint32_t value = load_u4(bytecode->data + bytecode->index);
+    bytecode->index += 4;
+    return value;
+}
+
+#endif //CURSOR_H
@@ -0,0 +1,520 @@
+#include "export.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Most columns any table has */
+#define EXPORT_MAX_COLUMNS 12
+
+/* Initial size of each column's buffer */
+#define EXPORT_COLUMN_BLOCK 4096
+
+typedef struct {
+    const char *name;
+    ExportType type;
+} ExportColumn;
+
+typedef struct {
+    const char *name;
+    const ExportColumn *columns;
+    unsigned count;
+    /* the first column is class_id, filled in by export_rows() rather than encoded */
+    bool numbered;
+} ExportTable;
+
+enum {
+    TABLE_CLASSES,
+    TABLE_FIELDS,
+    TABLE_METHODS,
+    TABLE_ATTRIBUTES,
+    TABLE_REFS,
+    TABLE_ERRORS,
+    TABLES_COUNT
+};
+
+static const ExportColumn CLASSES[] = {
+        {"class_id", EXPORT_U32}, {"file", EXPORT_STRING}, {"name", EXPORT_STRING}, {"super", EXPORT_STRING},
+        {"minor_version", EXPORT_U16}, {"major_version", EXPORT_U16}, {"access_flags", EXPORT_U16},
+        {"interfaces", EXPORT_U16}, {"fields", EXPORT_U16}, {"methods", EXPORT_U16}, {"attributes", EXPORT_U16},
+        {"constant_pool", EXPORT_U16}
+};
+
+static const ExportColumn MEMBERS[] = {
+        {"class_id", EXPORT_U32}, {"access_flags", EXPORT_U16}, {"name", EXPORT_STRING},
+        {"descriptor", EXPORT_STRING}, {"attributes", EXPORT_U16}
+};
+
+static const ExportColumn ATTRIBUTES[] = {
+        {"class_id", EXPORT_U32}, {"owner", EXPORT_U8}, {"owner_index", EXPORT_U16}, {"name", EXPORT_STRING},
+        {"length", EXPORT_U32}
+};
+
+static const ExportColumn REFS[] = {
+        {"class_id", EXPORT_U32}, {"pool_index", EXPORT_U16}, {"tag", EXPORT_U8}, {"owner", EXPORT_STRING},
+        {"name", EXPORT_STRING}, {"descriptor", EXPORT_STRING}
+};
+
+static const ExportColumn ERRORS[] = {
+        {"file", EXPORT_STRING}, {"error", EXPORT_STRING}
+};
+
+#define COLUMNS(columns) columns, sizeof(columns) / sizeof(ExportColumn)
+
+static const ExportTable TABLES[TABLES_COUNT] = {
+        {"classes", COLUMNS(CLASSES), true},
+        {"fields", COLUMNS(MEMBERS), true},
+        {"methods", COLUMNS(MEMBERS), true},
+        {"attributes", COLUMNS(ATTRIBUTES), true},
+        {"refs", COLUMNS(REFS), true},
+        {"errors", COLUMNS(ERRORS), false}
+};
+
+/* Every distinct string, numbered in order of first appearance */
+typedef struct {
+    Output bytes;
+    uint32_t *offsets; /* count + 1 of them */
+    uint32_t count;
+    uint32_t offsets_capacity;
+    uint32_t *slots; /* open addressing: id + 1, or 0 for an empty slot */
+    uint32_t slots_count; /* a power of two */
+} Dictionary;
+
+struct Exporter {
+    Output columns[TABLES_COUNT][EXPORT_MAX_COLUMNS];
+    uint64_t rows[TABLES_COUNT];
+    uint32_t classes; /* class ids handed out */
+    Dictionary strings;
+};
+
+static uint32_t hash(const char *data, size_t length) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    size_t i;
+    for (i = 0; i < length; i++) {
+        h = (h ^ (uint8_t) data[i]) * 16777619u;
+    }
+    return h;
+}
+
+/* Double the hash table and reinsert every id */
+static bool rehash(Dictionary *dict) {
+    uint32_t count = dict->slots_count * 2;
+    uint32_t *slots = calloc(count, sizeof(uint32_t));
+    if (slots == NULL) {
+        return false;
+    }
+    uint32_t id;
+    for (id = 0; id < dict->count; id++) {
+        uint32_t start = dict->offsets[id];
+        uint32_t s = hash(dict->bytes.data + start, dict->offsets[id + 1] - start) & (count - 1);
+        while (slots[s] != 0) {
+            s = (s + 1) & (count - 1);
+        }
+        slots[s] = id + 1;
+    }
+    free(dict->slots);
+    dict->slots = slots;
+    dict->slots_count = count;
+    return true;
+}
+
+/* Return the id of the string, adding it if it is new, or UINT32_MAX if memory ran out */
+static uint32_t intern(Dictionary *dict, const char *data, size_t length) {
+    uint32_t mask = dict->slots_count - 1;
+    uint32_t s = hash(data, length) & mask;
+    while (dict->slots[s] != 0) {
+        uint32_t id = dict->slots[s] - 1;
+        uint32_t start = dict->offsets[id];
+        if (dict->offsets[id + 1] - start == length && memcmp(dict->bytes.data + start, data, length) == 0) {
+            return id;
+        }
+        s = (s + 1) & mask;
+    }
+    if (dict->count + 2 > dict->offsets_capacity) {
+        uint32_t grown = dict->offsets_capacity * 2;
+        uint32_t *offsets = realloc(dict->offsets, grown * sizeof(uint32_t));
+        if (offsets == NULL) {
+            return UINT32_MAX;
+        }
+        dict->offsets = offsets;
+        dict->offsets_capacity = grown;
+    }
+    output_bytes(&dict->bytes, data, length);
+    if (dict->bytes.err != 0) {
+        return UINT32_MAX;
+    }
+    uint32_t id = dict->count++;
+    dict->offsets[id + 1] = (uint32_t) dict->bytes.length;
+    dict->slots[s] = id + 1;
+    // keep the table at most half full
+    if (dict->count * 2 > dict->slots_count && !rehash(dict)) {
+        return UINT32_MAX;
+    }
+    return id;
+}
+
+/* Append the low bytes of value to column, least significant first */
+static void put_le(Output *column, uint64_t value, unsigned bytes) {
+    char le[8];
+    unsigned b;
+    for (b = 0; b < bytes; b++) {
+        le[b] = (char) (value >> (8 * b));
+    }
+    output_bytes(column, le, bytes);
+}
+
+/* Table files count what they have written in *written themselves: out->length is no guide to the file position once
+ * a flush or a write too large to buffer has emptied it */
+static void file_bytes(Output *out, uint64_t *written, const char *data, size_t length) {
+    output_bytes(out, data, length);
+    *written += length;
+}
+
+static void file_le(Output *out, uint64_t *written, uint64_t value, unsigned bytes) {
+    put_le(out, value, bytes);
+    *written += bytes;
+}
+
+/* Pad the file to a multiple of 8 bytes */
+static void file_pad(Output *out, uint64_t *written) {
+    static const char ZEROS[8] = {0};
+    file_bytes(out, written, ZEROS, (8 - *written % 8) % 8);
+}
+
+Exporter *export_create(void) {
+    Exporter *exporter = calloc(1, sizeof(Exporter));
+    if (exporter == NULL) {
+        return NULL;
+    }
+    bool ok = true;
+    unsigned t, c;
+    for (t = 0; t < TABLES_COUNT; t++) {
+        for (c = 0; c < TABLES[t].count; c++) {
+            ok &= output_init(&exporter->columns[t][c], -1, EXPORT_COLUMN_BLOCK);
+        }
+    }
+    Dictionary *dict = &exporter->strings;
+    ok &= output_init(&dict->bytes, -1, EXPORT_COLUMN_BLOCK * 16);
+    dict->offsets_capacity = 1024;
+    dict->offsets = calloc(dict->offsets_capacity, sizeof(uint32_t));
+    dict->slots_count = 2048;
+    dict->slots = calloc(dict->slots_count, sizeof(uint32_t));
+    if (!ok || dict->offsets == NULL || dict->slots == NULL) {
+        export_free(exporter);
+        return NULL;
+    }
+    return exporter;
+}
+
+void export_free(Exporter *exporter) {
+    unsigned t, c;
+    for (t = 0; t < TABLES_COUNT; t++) {
+        for (c = 0; c < TABLES[t].count; c++) {
+            output_free(&exporter->columns[t][c]);
+        }
+    }
+    output_free(&exporter->strings.bytes);
+    free(exporter->strings.offsets);
+    free(exporter->strings.slots);
+    free(exporter);
+}
+
+/* Rows travel from encoder to export_rows() as the table number and then each column but class_id, in host order:
+ * integers at their width, strings as a u32 length and the bytes. */
+
+static void encode_u8(Output *out, uint8_t value) {
+    output_char(out, (char) value);
+}
+
+static void encode_u16(Output *out, uint16_t value) {
+    output_bytes(out, (const char *) &value, sizeof(value));
+}
+
+static void encode_u32(Output *out, uint32_t value) {
+    output_bytes(out, (const char *) &value, sizeof(value));
+}
+
+static void encode_str(Output *out, const char *data, size_t length) {
+    encode_u32(out, (uint32_t) length);
+    output_bytes(out, data, length);
+}
+
+/* The constant pool string at index, or the empty string if it is not one */
+static void encode_item_string(Output *out, const Class *class, uint16_t index) {
+    Item item = get_item(
+    class, index);
+    if (item.tag == STRING_UTF8) {
+        encode_str(out, item.value.string.value, item.value.string.length);
+    } else {
+        encode_str(out, "", 0);
+    }
+}
+
+/* A resolved string, or the empty string if its value is NULL */
+static void encode_view(Output *out, String string) {
+    encode_str(out, string.value != NULL ? string.value : "", string.length);
+}
+
+static void encode_file(Output *out, const char *file, const char *entry, size_t entry_length) {
+    size_t length = strlen(file);
+    if (entry == NULL) {
+        encode_str(out, file, length);
+        return;
+    }
+    encode_u32(out, (uint32_t) (length + 2 + entry_length));
+    output_bytes(out, file, length);
+    output_bytes(out, "!/", 2);
+    output_bytes(out, entry, entry_length);
+}
+
+static void encode_attributes(Output *out, const Class *class, uint8_t owner, uint16_t owner_index,
+                              const Attribute *attrs, uint16_t count) {
+    uint16_t a;
+    for (a = 0; a < count; a++) {
+        encode_u8(out, TABLE_ATTRIBUTES);
+        encode_u8(out, owner);
+        encode_u16(out, owner_index);
+        encode_item_string(out,
+        class, attrs[a].name_idx);
+        encode_u32(out, attrs[a].length);
+    }
+}
+
+static void encode_member(Output *out, const Class *class, uint8_t table, uint16_t flags, uint16_t name_idx,
+                          uint16_t desc_idx, uint16_t attrs_count) {
+    encode_u8(out, table);
+    encode_u16(out, flags);
+    encode_item_string(out,
+    class, name_idx);
+    encode_item_string(out,
+    class, desc_idx);
+    encode_u16(out, attrs_count);
+}
+
+static void encode_refs(Output *out, const Class *class) {
+    uint16_t i;
+    for (i = 1; i < class->const_pool_count; i++) {
+        Item item = get_item(
+        class, i);
+        if (item.tag != CLASS && item.tag != FIELD && item.tag != METHOD && item.tag != INTERFACE_METHOD) {
+            continue;
+        }
+        encode_u8(out, TABLE_REFS);
+        encode_u16(out, i);
+        encode_u8(out, item.tag);
+        ResolvedRef ref = resolve_ref(
+        class, i);
+        encode_view(out, ref.owner);
+        encode_view(out, ref.name);
+        encode_view(out, ref.descriptor);
+    }
+}
+
+void export_encode_class(Output *out, const Class *class, const char *file, const char *entry, size_t entry_length) {
+    encode_u8(out, TABLE_CLASSES);
+    encode_file(out, file, entry, entry_length);
+    encode_view(out, resolve_ref(
+    class, class->this_class).owner);
+    encode_view(out, resolve_ref(
+    class, class->super_class).owner);
+    encode_u16(out,
+    class->minor_version);
+    encode_u16(out,
+    class->major_version);
+    encode_u16(out,
+    class->flags);
+    encode_u16(out,
+    class->interfaces_count);
+    encode_u16(out,
+    class->fields_count);
+    encode_u16(out,
+    class->methods_count);
+    encode_u16(out,
+    class->attributes_count);
+    encode_u16(out,
+    class->const_pool_count);
+
+    uint16_t m;
+    for (m = 0; m < class->fields_count; m++) {
+        const Field *field =
+        class->fields + m;
+        encode_member(out,
+        class, TABLE_FIELDS, field->flags, field->name_idx, field->desc_idx, field->attrs_count);
+        encode_attributes(out,
+        class, 1, m, field->attrs, field->attrs_count);
+    }
+    for (m = 0; m < class->methods_count; m++) {
+        const Method *method =
+        class->methods + m;
+        encode_member(out,
+        class, TABLE_METHODS, method->flags, method->name_idx, method->desc_idx, method->attrs_count);
+        encode_attributes(out,
+        class, 2, m, method->attrs, method->attrs_count);
+    }
+    encode_attributes(out,
+    class, 0, 0,
+    class->attributes,
+    class->attributes_count);
+    encode_refs(out,
+    class);
+}
+
+void export_encode_error(Output *out, const char *file, const char *entry, size_t entry_length, const char *error) {
+    encode_u8(out, TABLE_ERRORS);
+    encode_file(out, file, entry, entry_length);
+    encode_str(out, error, strlen(error));
+}
+
+bool export_rows(Exporter *exporter, const char *data, size_t length) {
+    const char *p = data, *end = data + length;
+    while (p < end) {
+        uint8_t t = (uint8_t) *p++;
+        if (t >= TABLES_COUNT) {
+            return false;
+        }
+        const ExportTable *table = TABLES + t;
+        unsigned c = 0;
+        if (table->numbered) {
+            // a classes row starts the next class; the rows after it belong to it
+            uint32_t id = t == TABLE_CLASSES ? exporter->classes++ : exporter->classes - 1;
+            put_le(&exporter->columns[t][c++], id, 4);
+        }
+        for (; c < table->count; c++) {
+            Output *column = &exporter->columns[t][c];
+            uint16_t u16;
+            uint32_t u32, id;
+            // a string's fixed part is its u32 length
+            static const uint8_t WIDTHS[] = {[EXPORT_U8] = 1, [EXPORT_U16] = 2, [EXPORT_U32] = 4, [EXPORT_STRING] = 4};
+            if ((size_t) (end - p) < WIDTHS[table->columns[c].type]) {
+                return false;
+            }
+            switch (table->columns[c].type) {
+                case EXPORT_U8:
+                    output_char(column, *p++);
+                    break;
+                case EXPORT_U16:
+                    memcpy(&u16, p, sizeof(u16));
+                    p += sizeof(u16);
+                    put_le(column, u16, 2);
+                    break;
+                case EXPORT_U32:
+                    memcpy(&u32, p, sizeof(u32));
+                    p += sizeof(u32);
+                    put_le(column, u32, 4);
+                    break;
+                case EXPORT_STRING:
+                    memcpy(&u32, p, sizeof(u32));
+                    p += sizeof(u32);
+                    if ((size_t) (end - p) < u32) {
+                        return false;
+                    }
+                    id = intern(&exporter->strings, p, u32);
+                    if (id == UINT32_MAX) {
+                        return false;
+                    }
+                    p += u32;
+                    put_le(column, id, 4);
+                    break;
+            }
+            if (column->err != 0) {
+                return false;
+            }
+        }
+        exporter->rows[t]++;
+    }
+    return true;
+}
+
+/* Create dir/name.cfrc and bind out to it. Returns 0 or an errno value. */
+static int open_table(Output *out, const char *dir, const char *name) {
+    size_t dir_length = strlen(dir), name_length = strlen(name);
+    char *path = malloc(dir_length + name_length + sizeof("/.cfrc"));
+    if (path == NULL) {
+        return ENOMEM;
+    }
+    memcpy(path, dir, dir_length);
+    path[dir_length] = '/';
+    memcpy(path + dir_length + 1, name, name_length);
+    memcpy(path + dir_length + 1 + name_length, ".cfrc", sizeof(".cfrc"));
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    free(path);
+    if (fd < 0) {
+        return errno;
+    }
+    if (!output_init(out, fd, OUTPUT_BUFFER)) {
+        close(fd);
+        return ENOMEM;
+    }
+    return 0;
+}
+
+/* Flush and close a file opened with open_table(). Returns the first error either hit. */
+static int close_table(Output *out) {
+    int err = output_flush(out);
+    if (close(out->fd) != 0 && err == 0) {
+        err = errno;
+    }
+    output_free(out);
+    return err;
+}
+
+static int write_table(Exporter *exporter, const char *dir, unsigned t) {
+    const ExportTable *table = TABLES + t;
+    Output out;
+    int err = open_table(&out, dir, table->name);
+    if (err != 0) {
+        return err;
+    }
+    uint64_t written = 0;
+    file_bytes(&out, &written, "CFRCOL\0\1", 8);
+    file_le(&out, &written, table->count, 4);
+    file_le(&out, &written, 0, 4);
+    file_le(&out, &written, exporter->rows[t], 8);
+    unsigned c;
+    for (c = 0; c < table->count; c++) {
+        size_t name_length = strlen(table->columns[c].name);
+        file_le(&out, &written, table->columns[c].type, 1);
+        file_le(&out, &written, name_length, 1);
+        file_bytes(&out, &written, table->columns[c].name, name_length);
+    }
+    file_pad(&out, &written);
+    for (c = 0; c < table->count; c++) {
+        const Output *column = &exporter->columns[t][c];
+        file_le(&out, &written, column->length, 8);
+        file_bytes(&out, &written, column->data, column->length);
+        file_pad(&out, &written);
+    }
+    return close_table(&out);
+}
+
+static int write_strings(const Dictionary *dict, const char *dir) {
+    Output out;
+    int err = open_table(&out, dir, "strings");
+    if (err != 0) {
+        return err;
+    }
+    uint64_t written = 0;
+    file_bytes(&out, &written, "CFRSTR\0\1", 8);
+    file_le(&out, &written, dict->count, 8);
+    file_le(&out, &written, dict->bytes.length, 8);
+    uint32_t i;
+    for (i = 0; i <= dict->count; i++) {
+        file_le(&out, &written, dict->offsets[i], 4);
+    }
+    file_pad(&out, &written);
+    file_bytes(&out, &written, dict->bytes.data, dict->bytes.length);
+    return close_table(&out);
+}
+
+int export_write(Exporter *exporter, const char *dir) {
+    int err = 0;
+    unsigned t;
+    for (t = 0; t < TABLES_COUNT && err == 0; t++) {
+        err = write_table(exporter, dir, t);
+    }
+    return err != 0 ? err : write_strings(&exporter->strings, dir);
+}
@@ -0,0 +1,58 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "class.h"
+#include "output.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Bulk export of many classes as column tables, one file per table:
+ *   classes.cfrc     class_id, file, name, super, minor_version, major_version, access_flags, interfaces, fields,
+ *                    methods, attributes, constant_pool
+ *   fields.cfrc      class_id, access_flags, name, descriptor, attributes
+ *   methods.cfrc     class_id, access_flags, name, descriptor, attributes
+ *   attributes.cfrc  class_id, owner (0 class, 1 field, 2 method), owner_index, name, length
+ *   refs.cfrc        class_id, pool_index, tag, owner, name, descriptor: every Class, Fieldref, Methodref and
+ *                    InterfaceMethodref entry with its names resolved
+ *   errors.cfrc      file, error: inputs that could not be read
+ * String columns hold ids into strings.cfrc, a dictionary shared by every table, so each distinct string is stored once.
+ *
+ * All integers are little-endian. A table file is the magic "CFRCOL\0\1", u32 column count, u32 zero, u64 row count,
+ * then per column u8 type (EXPORT_U8, EXPORT_U16, EXPORT_U32 or EXPORT_STRING, a u32 string id), u8 name length and the
+ * name; padding to 8 bytes; then per column u64 byte length and the packed values, each padded to 8 bytes.
+ * strings.cfrc is the magic "CFRSTR\0\1", u64 string count, u64 byte count, u32 offsets (count + 1 of them, each
+ * string runs from its offset to the next), padding to 8 bytes and the string bytes, which are not NUL-terminated. */
+
+/* Types of the values in a column */
+typedef enum {
+    EXPORT_U8 = 1,
+    EXPORT_U16 = 2,
+    EXPORT_U32 = 3,
+    EXPORT_STRING = 4
+} ExportType;
+
+/* Column tables being gathered. Rows are appended on one thread, in the order their classes should appear. */
+typedef struct Exporter Exporter;
+
+/* Create an empty exporter. Returns NULL if memory ran out. */
+Exporter *export_create(void);
+
+/* Encode class's rows into out. Safe to call from any thread: rows only reach the tables through export_rows(), so
+ * workers can encode classes in parallel while one thread numbers and appends them. */
+void export_encode_class(Output *out, const Class *class, const char *file, const char *entry, size_t entry_length);
+
+/* Encode an errors row for an input that could not be read */
+void export_encode_error(Output *out, const char *file, const char *entry, size_t entry_length, const char *error);
+
+/* Append the rows encoded in data to the tables. Returns false if memory ran out or data ends in the middle of a row. */
+bool export_rows(Exporter *exporter, const char *data, size_t length);
+
+/* Write every table and the string dictionary into the existing directory dir.
+ * Returns 0 on success, otherwise an errno value. */
+int export_write(Exporter *exporter, const char *dir);
+
+void export_free(Exporter *exporter);
+
+#endif //EXPORT_H
@@ -0,0 +1,328 @@
+#include "inflate.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_BITS 15 /* longest code DEFLATE allows */
+#define MAX_LITLEN 288 /* literal/length alphabet */
+#define MAX_DIST 30 /* distance alphabet */
+#define FAST_BITS 9 /* codes up to this long decode with one table lookup */
+
+/* A canonical Huffman code. count and symbol decode bit by bit; fast resolves short codes in one step. */
+typedef struct {
+    uint16_t count[MAX_BITS + 1]; /* number of codes of each length */
+    uint16_t symbol[MAX_LITLEN]; /* symbols ordered by code */
+    uint16_t fast[1 << FAST_BITS]; /* (length << 9) | symbol, indexed by the next FAST_BITS input bits; 0 if longer */
+} Huffman;
+
+typedef struct {
+    const uint8_t *in;
+    size_t in_len;
+    size_t in_pos;
+    uint64_t bits; /* unread input bits, least significant first */
+    unsigned bit_count;
+    uint8_t *out;
+    size_t out_len;
+    size_t out_pos;
+} Stream;
+
+static const uint16_t LENGTH_BASE[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t LENGTH_EXTRA[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t DIST_BASE[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+        6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t DIST_EXTRA[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+/* The order code length code lengths are sent in */
+static const uint8_t CLEN_ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static void refill(Stream *s) {
+    while (s->bit_count <= 56 && s->in_pos < s->in_len) {
+        s->bits |= (uint64_t) s->in[s->in_pos++] << s->bit_count;
+        s->bit_count += 8;
+    }
+}
+
+/* Read n (at most 32) bits, or return -1 if the input ran out */
+static int64_t get_bits(Stream *s, unsigned n) {
+    if (s->bit_count < n) {
+        refill(s);
+        if (s->bit_count < n) {
+            return -1;
+        }
+    }
+    uint32_t v = (uint32_t) (s->bits & ((1ULL << n) - 1));
+    s->bits >>= n;
+    s->bit_count -= n;
+    return v;
+}
+
+/* Build h from the code length of each of n symbols. Returns false if the lengths over-subscribe the code space;
+ * incomplete codes are allowed, as a distance code may have a single symbol. */
+static bool build(Huffman *h, const uint8_t *lengths, unsigned n) {
+    uint16_t offs[MAX_BITS + 2];
+    unsigned sym, len;
+    int left = 1;
+
+    memset(h->count, 0, sizeof(h->count));
+    memset(h->fast, 0, sizeof(h->fast));
+    for (sym = 0; sym < n; sym++) {
+        h->count[lengths[sym]]++;
+    }
+    h->count[0] = 0;
+    for (len = 1; len <= MAX_BITS; len++) {
+        left = (left << 1) - h->count[len];
+        if (left < 0) {
+            return false;
+        }
+    }
+    offs[1] = 0;
+    for (len = 1; len <= MAX_BITS; len++) {
+        offs[len + 1] = offs[len] + h->count[len];
+    }
+    for (sym = 0; sym < n; sym++) {
+        if (lengths[sym] != 0) {
+            h->symbol[offs[lengths[sym]]++] = sym;
+        }
+    }
+
+    // codes are assigned in symbol order within each length; input bits arrive reversed, so index fast by the reversal
+    unsigned code = 0, index = 0;
+    for (len = 1; len <= FAST_BITS; len++) {
+        unsigned k;
+        for (k = 0; k < h->count[len]; k++, code++, index++) {
+            unsigned rev = 0, b;
+            for (b = 0; b < len; b++) {
+                rev |= ((code >> b) & 1) << (len - 1 - b);
+            }
+            for (; rev < (1u << FAST_BITS); rev += 1u << len) {
+                h->fast[rev] = (uint16_t) (len << 9 | h->symbol[index]);
+            }
+        }
+        code <<= 1;
+    }
+    return true;
+}
+
+/* Decode one symbol, or return -1 on a bad code or truncated input */
+static int decode(Stream *s, const Huffman *h) {
+    if (s->bit_count < MAX_BITS) {
+        refill(s);
+    }
+    uint16_t entry = h->fast[s->bits & ((1u << FAST_BITS) - 1)];
+    unsigned len = entry >> 9;
+    if (entry != 0 && len <= s->bit_count) {
+        s->bits >>= len;
+        s->bit_count -= len;
+        return entry & 0x1ff;
+    }
+
+    int code = 0, first = 0, index = 0;
+    for (len = 1; len <= MAX_BITS; len++) {
+        int64_t bit = get_bits(s, 1);
+        if (bit < 0) {
+            return -1;
+        }
+        code |= (int) bit;
+        int count = h->count[len];
+        if (code - count < first) {
+            return h->symbol[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static int stored(Stream *s) {
+    // drop to a byte boundary; whole bytes may still be sitting in the bit buffer
+    s->bits >>= s->bit_count & 7;
+    s->bit_count -= s->bit_count & 7;
+    int64_t len = get_bits(s, 16);
+    int64_t nlen = get_bits(s, 16);
+    if (len < 0 || nlen < 0 || len != (~nlen & 0xffff)) {
+        return EINVAL;
+    }
+    if ((size_t) len > s->out_len - s->out_pos) {
+        return EOVERFLOW;
+    }
+    while (len > 0 && s->bit_count >= 8) {
+        s->out[s->out_pos++] = (uint8_t) get_bits(s, 8);
+        len--;
+    }
+    if ((size_t) len > s->in_len - s->in_pos) {
+        return EINVAL;
+    }
+    memcpy(s->out + s->out_pos, s->in + s->in_pos, len);
+    s->out_pos += len;
+    s->in_pos += len;
+    return 0;
+}
+
+static int codes(Stream *s, const Huffman *litlen, const Huffman *dist) {
+    while (true) {
+        int sym = decode(s, litlen);
+        if (sym < 0) {
+            return EINVAL;
+        }
+        if (sym < 256) {
+            if (s->out_pos == s->out_len) {
+                return EOVERFLOW;
+            }
+            s->out[s->out_pos++] = (uint8_t) sym;
+            continue;
+        }
+        if (sym == 256) {
+            return 0;
+        }
+        sym -= 257;
+        if (sym >= 29) {
+            return EINVAL;
+        }
+        int64_t extra = get_bits(s, LENGTH_EXTRA[sym]);
+        int dsym = decode(s, dist);
+        if (extra < 0 || dsym < 0 || dsym >= 30) {
+            return EINVAL;
+        }
+        size_t len = LENGTH_BASE[sym] + extra;
+        int64_t dextra = get_bits(s, DIST_EXTRA[dsym]);
+        if (dextra < 0) {
+            return EINVAL;
+        }
+        size_t distance = DIST_BASE[dsym] + dextra;
+        if (distance > s->out_pos) {
+            return EINVAL;
+        }
+        if (len > s->out_len - s->out_pos) {
+            return EOVERFLOW;
+        }
+        // copies may overlap their own output, which repeats the last distance bytes
+        uint8_t *to = s->out + s->out_pos;
+        const uint8_t *from = to - distance;
+        size_t i;
+        for (i = 0; i < len; i++) {
+            to[i] = from[i];
+        }
+        s->out_pos += len;
+    }
+}
+
+static int fixed(Stream *s) {
+    Huffman litlen, dist;
+    uint8_t lengths[MAX_LITLEN];
+    unsigned sym;
+    for (sym = 0; sym < 144; sym++) lengths[sym] = 8;
+    for (; sym < 256; sym++) lengths[sym] = 9;
+    for (; sym < 280; sym++) lengths[sym] = 7;
+    for (; sym < MAX_LITLEN; sym++) lengths[sym] = 8;
+    build(&litlen, lengths, MAX_LITLEN);
+    for (sym = 0; sym < MAX_DIST; sym++) lengths[sym] = 5;
+    build(&dist, lengths, MAX_DIST);
+    return codes(s, &litlen, &dist);
+}
+
+static int dynamic(Stream *s) {
+    Huffman litlen, dist;
+    uint8_t lengths[MAX_LITLEN + MAX_DIST];
+    int64_t nlen = get_bits(s, 5);
+    int64_t ndist = get_bits(s, 5);
+    int64_t ncode = get_bits(s, 4);
+    if (nlen < 0 || ndist < 0 || ncode < 0) {
+        return EINVAL;
+    }
+    nlen += 257;
+    ndist += 1;
+    ncode += 4;
+    if (nlen > MAX_LITLEN || ndist > MAX_DIST) {
+        return EINVAL;
+    }
+
+    int64_t i;
+    memset(lengths, 0, 19);
+    for (i = 0; i < ncode; i++) {
+        int64_t len = get_bits(s, 3);
+        if (len < 0) {
+            return EINVAL;
+        }
+        lengths[CLEN_ORDER[i]] = (uint8_t) len;
+    }
+    if (!build(&litlen, lengths, 19)) {
+        return EINVAL;
+    }
+
+    i = 0;
+    while (i < nlen + ndist) {
+        int sym = decode(s, &litlen);
+        if (sym < 0) {
+            return EINVAL;
+        }
+        if (sym < 16) {
+            lengths[i++] = (uint8_t) sym;
+            continue;
+        }
+        uint8_t len = 0;
+        int64_t repeat;
+        if (sym == 16) {
+            if (i == 0) {
+                return EINVAL;
+            }
+            len = lengths[i - 1];
+            repeat = get_bits(s, 2) + 3;
+        } else if (sym == 17) {
+            repeat = get_bits(s, 3) + 3;
+        } else {
+            repeat = get_bits(s, 7) + 11;
+        }
+        if (repeat < 3 || i + repeat > nlen + ndist) {
+            return EINVAL;
+        }
+        while (repeat--) {
+            lengths[i++] = len;
+        }
+    }
+    if (lengths[256] == 0) {
+        return EINVAL; // no end-of-block code
+    }
+    if (!build(&litlen, lengths, nlen) || !build(&dist, lengths + nlen, ndist)) {
+        return EINVAL;
+    }
+    return codes(s, &litlen, &dist);
+}
+
+int inflate_raw(uint8_t *dst, size_t dst_len, const uint8_t *src, size_t src_len) {
+    Stream s = {
+            .in = src,
+            .in_len = src_len,
+            .out = dst,
+            .out_len = dst_len,
+    };
+    int64_t last;
+    do {
+        last = get_bits(&s, 1);
+        int64_t type = get_bits(&s, 2);
+        int err;
+        if (last < 0 || type < 0) {
+            return EINVAL;
+        } else if (type == 0) {
+            err = stored(&s);
+        } else if (type == 1) {
+            err = fixed(&s);
+        } else if (type == 2) {
+            err = dynamic(&s);
+        } else {
+            err = EINVAL;
+        }
+        if (err != 0) {
+            return err;
+        }
+    } while (!last);
+    return s.out_pos == dst_len ? 0 : EOVERFLOW;
+}
@@ -0,0 +1,11 @@
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Decompress the raw DEFLATE stream (RFC 1951) in src into dst, which must hold exactly dst_len bytes.
+ * Returns 0 on success, EINVAL if src is corrupt or truncated, or EOVERFLOW if it decodes to anything but dst_len bytes. */
+int inflate_raw(uint8_t *dst, size_t dst_len, const uint8_t *src, size_t src_len);
+
+#endif //INFLATE_H
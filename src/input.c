@@ -0,0 +1,133 @@
+#include "input.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Read fd until EOF into a heap buffer. pread is tried first so seekable devices are read from offset 0;
+ * pipes and sockets fall back to read(). */
+static int read_stream(Input *input, int fd) {
+    size_t capacity = 64 * 1024;
+    size_t length = 0;
+    bool seekable = true;
+    char *data = malloc(capacity);
+    if (data == NULL) {
+        return ENOMEM;
+    }
+    while (true) {
+        if (length == capacity) {
+            if (capacity >= INPUT_MAX_STREAM) {
+                free(data);
+                return EFBIG;
+            }
+            capacity *= 2;
+            char *grown = realloc(data, capacity);
+            if (grown == NULL) {
+                free(data);
+                return ENOMEM;
+            }
+            data = grown;
+        }
+        ssize_t n;
+        if (seekable) {
+            n = pread(fd, data + length, capacity - length, (off_t) length);
+            if (n < 0 && errno == ESPIPE) {
+                seekable = false;
+                continue;
+            }
+        } else {
+            n = read(fd, data + length, capacity - length);
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            int err = errno;
+            free(data);
+            return err;
+        }
+        if (n == 0) {
+            break;
+        }
+        length += n;
+    }
+    input->data = data;
+    input->length = length;
+    input->mapped = false;
+    return 0;
+}
+
+int input_open_fd(Input *input, int fd) {
+    struct stat st;
+    input->data = NULL;
+    input->length = 0;
+    input->mapped = false;
+
+    if (fstat(fd, &st) != 0) {
+        return errno;
+    }
+    if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+        return read_stream(input, fd);
+    }
+
+    posix_fadvise(fd, 0, st.st_size, POSIX_FADV_SEQUENTIAL);
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return read_stream(input, fd);
+    }
+    // the parser walks the file front to back exactly once
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    madvise(map, st.st_size, MADV_WILLNEED);
+
+    input->data = map;
+    input->length = st.st_size;
+    input->mapped = true;
+    return 0;
+}
+
+int input_open(Input *input, const char *file_name) {
+    int fd = open(file_name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        input->data = NULL;
+        input->length = 0;
+        input->mapped = false;
+        return errno;
+    }
+    int err = input_open_fd(input, fd);
+    // a mapping stays valid after its descriptor is closed
+    close(fd);
+    return err;
+}
+
+void input_prefetch(const char *file_name) {
+    int fd = open(file_name, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd >= 0) {
+        // readahead continues after the descriptor is closed
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+}
+
+void input_close(Input *input) {
+    if (input->data != NULL) {
+        if (input->mapped) {
+            munmap((void *) input->data, input->length);
+        } else {
+            free((void *) input->data);
+        }
+    }
+    input->data = NULL;
+    input->length = 0;
+    input->mapped = false;
+}
+
+void input_bytecode(const Input *input, Bytecode *bytecode) {
+    bytecode->data = input->data;
+    bytecode->length = input->length;
+    bytecode->index = 0;
+}
@@ -0,0 +1,35 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include "class.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Largest stream (pipe, character device) that will be buffered in full. Regular files are mapped instead and have no limit. */
+#define INPUT_MAX_STREAM (64L * 1024 * 1024)
+
+/* A read-only view of an input file's contents.
+ * Regular files are mmapped; pipes and special files are read into a heap buffer. */
+typedef struct {
+    const char *data;
+    long length;
+    bool mapped;
+} Input;
+
+/* Open and map file_name into input. Returns 0 on success, otherwise an errno value and input is left empty. */
+int input_open(Input *input, const char *file_name);
+
+/* As input_open() but reads from an already open descriptor. fd is not closed. */
+int input_open_fd(Input *input, int fd);
+
+/* Ask the kernel to start reading file_name into the page cache, so a later input_open() finds it there */
+void input_prefetch(const char *file_name);
+
+/* Unmap or free the data held by input. Any Bytecode viewing it becomes invalid. */
+void input_close(Input *input);
+
+/* Point bytecode at the contents of input without copying them. */
+void input_bytecode(const Input *input, Bytecode *bytecode);
+
+#endif //INPUT_H
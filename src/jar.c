@@ -0,0 +1,226 @@
+#include "jar.h"
+#include <errno.h>
+#include "inflate.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define EOCD_SIGNATURE 0x06054b50
+#define EOCD_SIZE 22
+#define ZIP64_LOCATOR_SIGNATURE 0x07064b50
+#define ZIP64_LOCATOR_SIZE 20
+#define ZIP64_EOCD_SIGNATURE 0x06064b50
+#define ZIP64_EOCD_SIZE 56
+#define CENTRAL_SIGNATURE 0x02014b50
+#define CENTRAL_SIZE 46
+#define LOCAL_SIGNATURE 0x04034b50
+#define LOCAL_SIZE 30
+#define ZIP64_EXTRA_ID 0x0001
+#define FLAG_ENCRYPTED 0x0001
+#define METHOD_STORED 0
+#define METHOD_DEFLATED 8
+
+/* ZIP fields are little-endian */
+static uint16_t le16(const char *p) {
+    const uint8_t *b = (const uint8_t *) p;
+    return (uint16_t) (b[0] | b[1] << 8);
+}
+
+static uint32_t le32(const char *p) {
+    const uint8_t *b = (const uint8_t *) p;
+    return (uint32_t) b[0] | (uint32_t) b[1] << 8 | (uint32_t) b[2] << 16 | (uint32_t) b[3] << 24;
+}
+
+static uint64_t le64(const char *p) {
+    return (uint64_t) le32(p) | (uint64_t) le32(p + 4) << 32;
+}
+
+bool is_jar_name(const char *file_name) {
+    size_t len = strlen(file_name);
+    return len > 4 && (strcasecmp(file_name + len - 4, ".jar") == 0 || strcasecmp(file_name + len - 4, ".zip") == 0);
+}
+
+/* Read the ZIP64 end of central directory record that the locator just before the classic record points to */
+static bool read_zip64_eocd(Jar *jar, uint64_t eocd) {
+    const char *data = jar->input.data;
+    uint64_t length = jar->input.length;
+    if (eocd < ZIP64_LOCATOR_SIZE || length < ZIP64_EOCD_SIZE
+        || le32(data + eocd - ZIP64_LOCATOR_SIZE) != ZIP64_LOCATOR_SIGNATURE) {
+        return false;
+    }
+    uint64_t record = le64(data + eocd - ZIP64_LOCATOR_SIZE + 8);
+    if (record > length - ZIP64_EOCD_SIZE || le32(data + record) != ZIP64_EOCD_SIGNATURE) {
+        return false;
+    }
+    jar->entries = le64(data + record + 32);
+    jar->cd_size = le64(data + record + 40);
+    jar->cd_offset = le64(data + record + 48);
+    return true;
+}
+
+int jar_open(Jar *jar, const char *file_name) {
+    int err = input_open(&jar->input, file_name);
+    if (err != 0) {
+        return err;
+    }
+    const char *data = jar->input.data;
+    uint64_t length = jar->input.length;
+
+    // the end record is last, followed only by a comment of up to 64K
+    uint64_t eocd = 0;
+    bool found = false;
+    if (length >= EOCD_SIZE) {
+        uint64_t limit = length > EOCD_SIZE + 0xffff ? length - EOCD_SIZE - 0xffff : 0;
+        for (eocd = length - EOCD_SIZE; ; eocd--) {
+            if (le32(data + eocd) == EOCD_SIGNATURE && eocd + EOCD_SIZE + le16(data + eocd + 20) == length) {
+                found = true;
+                break;
+            }
+            if (eocd == limit) {
+                break;
+            }
+        }
+    }
+    if (!found) {
+        jar_close(jar);
+        return EINVAL;
+    }
+    jar->entries = le16(data + eocd + 10);
+    jar->cd_size = le32(data + eocd + 12);
+    jar->cd_offset = le32(data + eocd + 16);
+    if (jar->entries == 0xffff || jar->cd_size == 0xffffffff || jar->cd_offset == 0xffffffff) {
+        read_zip64_eocd(jar, eocd);
+    }
+    if (jar->cd_offset > length || jar->cd_size > length - jar->cd_offset) {
+        jar_close(jar);
+        return EINVAL;
+    }
+    return 0;
+}
+
+void jar_close(Jar *jar) {
+    input_close(&jar->input);
+}
+
+/* Replace saturated 32-bit fields with their values from the ZIP64 extra field, which lists only those fields */
+static void read_zip64_extra(JarEntry *entry, const char *extra, uint16_t length) {
+    uint16_t pos = 0;
+    while (pos + 4 <= length) {
+        uint16_t id = le16(extra + pos);
+        uint16_t size = le16(extra + pos + 2);
+        const char *field = extra + pos + 4;
+        const char *end = field + size;
+        if (pos + 4 + size > length) {
+            return;
+        }
+        if (id == ZIP64_EXTRA_ID) {
+            if (entry->size == 0xffffffff && field + 8 <= end) {
+                entry->size = le64(field);
+                field += 8;
+            }
+            if (entry->compressed_size == 0xffffffff && field + 8 <= end) {
+                entry->compressed_size = le64(field);
+                field += 8;
+            }
+            if (entry->local_offset == 0xffffffff && field + 8 <= end) {
+                entry->local_offset = le64(field);
+            }
+            return;
+        }
+        pos += 4 + size;
+    }
+}
+
+bool jar_next(const Jar *jar, JarCursor *cursor, JarEntry *entry) {
+    if (cursor->index >= jar->entries || cursor->offset + CENTRAL_SIZE > jar->cd_size) {
+        return false;
+    }
+    const char *header = jar->input.data + jar->cd_offset + cursor->offset;
+    if (le32(header) != CENTRAL_SIGNATURE) {
+        return false;
+    }
+    uint16_t name_length = le16(header + 28);
+    uint16_t extra_length = le16(header + 30);
+    uint16_t comment_length = le16(header + 32);
+    uint64_t size = CENTRAL_SIZE + name_length + extra_length + comment_length;
+    if (cursor->offset + size > jar->cd_size) {
+        return false;
+    }
+    entry->flags = le16(header + 8);
+    entry->method = le16(header + 10);
+    entry->compressed_size = le32(header + 20);
+    entry->size = le32(header + 24);
+    entry->name_length = name_length;
+    entry->local_offset = le32(header + 42);
+    entry->name = header + CENTRAL_SIZE;
+    read_zip64_extra(entry, entry->name + name_length, extra_length);
+
+    cursor->offset += size;
+    cursor->index++;
+    return true;
+}
+
+bool jar_entry_is_class(const JarEntry *entry) {
+    return entry->name_length > 6 && memcmp(entry->name + entry->name_length - 6, ".class", 6) == 0;
+}
+
+int jar_read(const Jar *jar, const JarEntry *entry, JarBuffer *buffer, Bytecode *bytecode) {
+    const char *data = jar->input.data;
+    uint64_t length = jar->input.length;
+    if (entry->flags & FLAG_ENCRYPTED) {
+        return ENOTSUP;
+    }
+    if (length < LOCAL_SIZE || entry->local_offset > length - LOCAL_SIZE
+        || le32(data + entry->local_offset) != LOCAL_SIGNATURE) {
+        return EINVAL;
+    }
+    // the local header's name and extra field may differ in length from the central directory's copy
+    uint64_t start = entry->local_offset + LOCAL_SIZE + le16(data + entry->local_offset + 26)
+                     + le16(data + entry->local_offset + 28);
+    if (start > length || entry->compressed_size > length - start) {
+        return EINVAL;
+    }
+    const char *payload = data + start;
+    if (entry->size > JAR_MAX_ENTRY) {
+        // past what read_class_err() accepts, so not worth inflating, and sizes up to 2^64 cannot be grown to
+        return EFBIG;
+    }
+
+    if (entry->method == METHOD_STORED) {
+        if (entry->size != entry->compressed_size) {
+            return EINVAL;
+        }
+        bytecode->data = payload;
+    } else if (entry->method == METHOD_DEFLATED) {
+        if (entry->size > buffer->capacity || buffer->data == NULL) {
+            size_t capacity = buffer->capacity > 0 ? buffer->capacity : 64 * 1024;
+            while (capacity < entry->size) {
+                capacity = capacity > JAR_MAX_ENTRY / 2 ? JAR_MAX_ENTRY : capacity * 2;
+            }
+            char *grown = realloc(buffer->data, capacity);
+            if (grown == NULL) {
+                return ENOMEM;
+            }
+            buffer->data = grown;
+            buffer->capacity = capacity;
+        }
+        int err = inflate_raw((uint8_t *) buffer->data, entry->size, (const uint8_t *) payload, entry->compressed_size);
+        if (err != 0) {
+            return err;
+        }
+        bytecode->data = buffer->data;
+    } else {
+        return ENOTSUP;
+    }
+    bytecode->length = entry->size;
+    bytecode->index = 0;
+    return 0;
+}
+
+void jar_buffer_free(JarBuffer *buffer) {
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->capacity = 0;
+}
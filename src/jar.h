@@ -0,0 +1,67 @@
+#ifndef JAR_H
+#define JAR_H
+
+#include "class.h"
+#include "input.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* The largest entry jar_read() reads: the most a Bytecode can address */
+#define JAR_MAX_ENTRY INT32_MAX
+
+/* A JAR or ZIP archive mapped read-only, with its central directory located */
+typedef struct {
+    Input input;
+    uint64_t cd_offset; /* of the first central directory header */
+    uint64_t cd_size;
+    uint64_t entries;
+} Jar;
+
+/* One member of an archive, as recorded in the central directory */
+typedef struct {
+    const char *name; /* not NUL-terminated */
+    uint16_t name_length;
+    uint16_t method; /* 0 stored, 8 deflated */
+    uint16_t flags;
+    uint64_t compressed_size;
+    uint64_t size;
+    uint64_t local_offset; /* of the entry's local file header */
+} JarEntry;
+
+/* Position of a walk over the central directory. Zero it to start from the first entry. */
+typedef struct {
+    uint64_t offset; /* relative to cd_offset */
+    uint64_t index;
+} JarCursor;
+
+/* Growable scratch space for inflated entries. Keep one per thread and reuse it between entries. */
+typedef struct {
+    char *data;
+    size_t capacity;
+} JarBuffer;
+
+/* Return true if file_name ends in .jar or .zip, in any case */
+bool is_jar_name(const char *file_name);
+
+/* Map the archive file_name and locate its central directory. Returns 0 on success, otherwise an errno value. */
+int jar_open(Jar *jar, const char *file_name);
+
+/* Unmap the archive. Entries and Bytecode read from it become invalid. */
+void jar_close(Jar *jar);
+
+/* Store the entry at cursor in entry and advance. Returns false after the last entry or at a corrupt header. */
+bool jar_next(const Jar *jar, JarCursor *cursor, JarEntry *entry);
+
+/* Return true if entry is a .class file */
+bool jar_entry_is_class(const JarEntry *entry);
+
+/* Point bytecode at the uncompressed contents of entry. Stored entries are viewed in place in the mapping; deflated
+ * ones are inflated into buffer, which is grown as needed and is what bytecode then views.
+ * Returns 0 on success, EFBIG for an entry larger than JAR_MAX_ENTRY, otherwise an errno value. */
+int jar_read(const Jar *jar, const JarEntry *entry, JarBuffer *buffer, Bytecode *bytecode);
+
+/* Free a buffer's memory */
+void jar_buffer_free(JarBuffer *buffer);
+
+#endif //JAR_H
@@ -0,0 +1,334 @@
+#include "json.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* U+FFFD, written in place of bytes that are not Modified UTF-8 */
+static const char REPLACEMENT[] = "\xef\xbf\xbd";
+
+static void output_escape(Output *out, uint32_t unit) {
+    static const char HEX[] = "0123456789abcdef";
+    char escape[6] = {'\\', 'u', HEX[(unit >> 12) & 0xf], HEX[(unit >> 8) & 0xf], HEX[(unit >> 4) & 0xf], HEX[unit & 0xf]};
+    output_bytes(out, escape, sizeof(escape));
+}
+
+/* Decode the three byte sequence at p into a UTF-16 code unit. Returns false if p does not hold one. */
+static bool unit3(const uint8_t *p, const uint8_t *end, uint32_t *unit) {
+    if (end - p < 3 || (p[0] & 0xf0) != 0xe0 || (p[1] & 0xc0) != 0x80 || (p[2] & 0xc0) != 0x80) {
+        return false;
+    }
+    *unit = ((uint32_t) (p[0] & 0x0f) << 12) | ((uint32_t) (p[1] & 0x3f) << 6) | (p[2] & 0x3f);
+    return *unit >= 0x800;
+}
+
+/* The body of output_json_string(), without the quotes */
+static void output_json_chars(Output *out, const char *mutf8, size_t length) {
+    const uint8_t *p = (const uint8_t *) mutf8, *end = p + length;
+    while (p < end) {
+        // copy runs that need no escaping in one go
+        const uint8_t *run = p;
+        while (p < end && *p >= 0x20 && *p < 0x80 && *p != '"' && *p != '\\') {
+            p++;
+        }
+        if (p > run) {
+            output_bytes(out, (const char *) run, p - run);
+        }
+        if (p == end) {
+            break;
+        }
+        uint8_t c = *p;
+        uint32_t unit, low;
+        if (c < 0x80) {
+            if (c == '"' || c == '\\') {
+                output_char(out, '\\');
+                output_char(out, (char) c);
+            } else if (c == '\n') {
+                output_bytes(out, "\\n", 2);
+            } else if (c == '\t') {
+                output_bytes(out, "\\t", 2);
+            } else if (c == '\r') {
+                output_bytes(out, "\\r", 2);
+            } else {
+                output_escape(out, c);
+            }
+            p++;
+        } else if ((c & 0xe0) == 0xc0 && end - p >= 2 && (p[1] & 0xc0) == 0x80) {
+            unit = ((uint32_t) (c & 0x1f) << 6) | (p[1] & 0x3f);
+            if (unit == 0) {
+                // Modified UTF-8 encodes NUL in two bytes so strings never contain a zero byte
+                output_escape(out, 0);
+            } else if (unit < 0x80) {
+                output_bytes(out, REPLACEMENT, 3);
+            } else {
+                output_bytes(out, (const char *) p, 2);
+            }
+            p += 2;
+        } else if (unit3(p, end, &unit)) {
+            if (unit >= 0xd800 && unit <= 0xdbff && unit3(p + 3, end, &low) && low >= 0xdc00 && low <= 0xdfff) {
+                // a supplementary character, stored as two encoded surrogates: join them into one 4 byte sequence
+                uint32_t cp = 0x10000 + ((unit - 0xd800) << 10) + (low - 0xdc00);
+                char utf8[4] = {(char) (0xf0 | (cp >> 18)), (char) (0x80 | ((cp >> 12) & 0x3f)),
+                                (char) (0x80 | ((cp >> 6) & 0x3f)), (char) (0x80 | (cp & 0x3f))};
+                output_bytes(out, utf8, 4);
+                p += 6;
+                continue;
+            }
+            if (unit >= 0xd800 && unit <= 0xdfff) {
+                output_escape(out, unit);
+            } else {
+                output_bytes(out, (const char *) p, 3);
+            }
+            p += 3;
+        } else if ((c & 0xf8) == 0xf0 && end - p >= 4 && (p[1] & 0xc0) == 0x80 && (p[2] & 0xc0) == 0x80
+                   && (p[3] & 0xc0) == 0x80 && c <= 0xf4 && (c != 0xf0 || p[1] >= 0x90) && (c != 0xf4 || p[1] < 0x90)) {
+            // not Modified UTF-8, but file names may hold standard 4 byte sequences
+            output_bytes(out, (const char *) p, 4);
+            p += 4;
+        } else {
+            output_bytes(out, REPLACEMENT, 3);
+            p++;
+        }
+    }
+}
+
+void output_json_string(Output *out, const char *mutf8, size_t length) {
+    output_char(out, '"');
+    output_json_chars(out, mutf8, length);
+    output_char(out, '"');
+}
+
+/* Write the constant pool string at index, or null if it is not one */
+static void output_json_item_string(Output *out, const Class *class, uint16_t index) {
+    Item item = get_item(
+    class, index);
+    if (item.tag != STRING_UTF8) {
+        output_str(out, "null");
+        return;
+    }
+    output_json_string(out, item.value.string.value, item.value.string.length);
+}
+
+/* Write the name of the Class entry at index, or null if it is not one or its name is not a string */
+static void output_json_class_name(Output *out, const Class *class, uint16_t index) {
+    Item item = get_item(
+    class, index);
+    if (item.tag != CLASS) {
+        output_str(out, "null");
+        return;
+    }
+    output_json_item_string(out,
+    class, item.value.ref.class_idx);
+}
+
+/* A double with enough digits to read back the same. JSON has no NaN or infinities, so those become null. */
+static void output_json_number(Output *out, double value, int digits) {
+    if (!isfinite(value)) {
+        output_str(out, "null");
+        return;
+    }
+    char text[32];
+    int length = snprintf(text, sizeof(text), "%.*g", digits, value);
+    output_bytes(out, text, (size_t) length < sizeof(text) ? (size_t) length : sizeof(text) - 1);
+}
+
+static void output_json_file(Output *out, const char *file, const char *entry, size_t entry_length) {
+    output_str(out, "{\"file\":\"");
+    output_json_chars(out, file, strlen(file));
+    if (entry != NULL) {
+        output_str(out, "!/");
+        output_json_chars(out, entry, entry_length);
+    }
+    output_char(out, '"');
+}
+
+static void output_json_attributes(Output *out, const Class *class, const Attribute *attrs, uint16_t count) {
+    output_str(out, "\"attributes\":[");
+    uint16_t a;
+    for (a = 0; a < count; a++) {
+        if (a > 0) {
+            output_char(out, ',');
+        }
+        output_str(out, "{\"name\":");
+        output_json_item_string(out,
+        class, attrs[a].name_idx);
+        output_str(out, ",\"length\":");
+        output_uint(out, attrs[a].length);
+        output_char(out, '}');
+    }
+    output_char(out, ']');
+}
+
+/* Fields and methods share a layout */
+static void output_json_member(Output *out, const Class *class, uint16_t flags, uint16_t name_idx, uint16_t desc_idx,
+                               const Attribute *attrs, uint16_t attrs_count) {
+    output_str(out, "{\"access_flags\":");
+    output_uint(out, flags);
+    output_str(out, ",\"name\":");
+    output_json_item_string(out,
+    class, name_idx);
+    output_str(out, ",\"descriptor\":");
+    output_json_item_string(out,
+    class, desc_idx);
+    output_char(out, ',');
+    output_json_attributes(out,
+    class, attrs, attrs_count);
+    output_char(out, '}');
+}
+
+static void output_json_pool(Output *out, const Class *class) {
+    output_str(out, "\"constant_pool\":[");
+    bool first = true;
+    uint16_t i;
+    for (i = 1; i < class->const_pool_count; i++) {
+        Item item = get_item(
+        class, i);
+        if (item.tag == 0) {
+            continue;
+        }
+        if (!first) {
+            output_char(out, ',');
+        }
+        first = false;
+        output_str(out, "{\"index\":");
+        output_uint(out, i);
+        output_str(out, ",\"tag\":\"");
+        output_str(out, tag2str(item.tag));
+        output_char(out, '"');
+        switch (item.tag) {
+            case STRING_UTF8:
+                output_str(out, ",\"value\":");
+                output_json_string(out, item.value.string.value, item.value.string.length);
+                break;
+            case INTEGER:
+                output_str(out, ",\"value\":");
+                output_int(out, item.value.integer);
+                break;
+            case FLOAT:
+                output_str(out, ",\"value\":");
+                output_json_number(out, item.value.flt, 9);
+                break;
+            case LONG:
+                output_str(out, ",\"value\":");
+                output_int(out, to_long(item.value.lng));
+                break;
+            case DOUBLE:
+                output_str(out, ",\"value\":");
+                output_json_number(out, to_double(item.value.dbl), 17);
+                break;
+            case CLASS:
+            case STRING:
+                output_str(out, ",\"ref\":");
+                output_uint(out, item.value.ref.class_idx);
+                break;
+            case FIELD:
+            case METHOD:
+            case INTERFACE_METHOD:
+                output_str(out, ",\"class\":");
+                output_uint(out, item.value.ref.class_idx);
+                output_str(out, ",\"name_and_type\":");
+                output_uint(out, item.value.ref.name_idx);
+                break;
+            case NAME:
+                output_str(out, ",\"name\":");
+                output_uint(out, item.value.ref.class_idx);
+                output_str(out, ",\"descriptor\":");
+                output_uint(out, item.value.ref.name_idx);
+                break;
+            case METHOD_HANDLE:
+                output_str(out, ",\"reference_kind\":");
+                output_uint(out, item.value.ref.class_idx);
+                output_str(out, ",\"ref\":");
+                output_uint(out, item.value.ref.name_idx);
+                break;
+            case METHOD_TYPE:
+                output_str(out, ",\"descriptor\":");
+                output_uint(out, item.value.ref.class_idx);
+                break;
+            case DYNAMIC:
+            case INVOKE_DYNAMIC:
+                output_str(out, ",\"bootstrap_method\":");
+                output_uint(out, item.value.ref.class_idx);
+                output_str(out, ",\"name_and_type\":");
+                output_uint(out, item.value.ref.name_idx);
+                break;
+            case MODULE:
+            case PACKAGE:
+                output_str(out, ",\"name\":");
+                output_uint(out, item.value.ref.class_idx);
+                break;
+            default:
+                break;
+        }
+        output_char(out, '}');
+    }
+    output_char(out, ']');
+}
+
+void output_json_class(Output *out, const Class *class, const char *file, const char *entry, size_t entry_length) {
+    output_json_file(out, file, entry, entry_length);
+    output_str(out, ",\"minor_version\":");
+    output_uint(out,
+    class->minor_version);
+    output_str(out, ",\"major_version\":");
+    output_uint(out,
+    class->major_version);
+    output_str(out, ",\"access_flags\":");
+    output_uint(out,
+    class->flags);
+    output_str(out, ",\"this_class\":");
+    output_json_class_name(out,
+    class, class->this_class);
+    // only java/lang/Object has no super class: entry 0 is not a Class, so it is written as null
+    output_str(out, ",\"super_class\":");
+    output_json_class_name(out,
+    class, class->super_class);
+
+    output_str(out, ",\"interfaces\":[");
+    uint16_t i;
+    for (i = 0; i < class->interfaces_count; i++) {
+        if (i > 0) {
+            output_char(out, ',');
+        }
+        output_json_class_name(out,
+        class, class->interfaces[i]);
+    }
+    output_str(out, "],");
+
+    output_json_pool(out,
+    class);
+
+    output_str(out, ",\"fields\":[");
+    for (i = 0; i < class->fields_count; i++) {
+        const Field *field =
+        class->fields + i;
+        if (i > 0) {
+            output_char(out, ',');
+        }
+        output_json_member(out,
+        class, field->flags, field->name_idx, field->desc_idx, field->attrs, field->attrs_count);
+    }
+    output_str(out, "],\"methods\":[");
+    for (i = 0; i < class->methods_count; i++) {
+        const Method *method =
+        class->methods + i;
+        if (i > 0) {
+            output_char(out, ',');
+        }
+        output_json_member(out,
+        class, method->flags, method->name_idx, method->desc_idx, method->attrs, method->attrs_count);
+    }
+    output_str(out, "],");
+    output_json_attributes(out,
+    class, class->attributes, class->attributes_count);
+    output_char(out, '}');
+}
+
+void output_json_error(Output *out, const char *file, const char *entry, size_t entry_length, const char *error) {
+    output_json_file(out, file, entry, entry_length);
+    output_str(out, ",\"error\":");
+    output_json_string(out, error, strlen(error));
+    output_char(out, '}');
+}
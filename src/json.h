@@ -0,0 +1,22 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include "class.h"
+#include "output.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Write class as one JSON object, without a trailing newline. It came from file or, unless entry is NULL, from the
+ * archive member entry of file. Nothing is allocated: names are resolved and escaped as they are written. */
+void output_json_class(Output *out, const Class *class, const char *file, const char *entry, size_t entry_length);
+
+/* Write the object standing in for a class that could not be read: {"file": ..., "error": ...} */
+void output_json_error(Output *out, const char *file, const char *entry, size_t entry_length, const char *error);
+
+/* Write length bytes of Modified UTF-8 as a quoted JSON string. Encoded NULs and surrogate pairs are converted to
+ * standard UTF-8, lone surrogates are escaped and malformed bytes become U+FFFD. */
+void output_json_string(Output *out, const char *mutf8, size_t length);
+
+#endif //JSON_H
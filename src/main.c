@@ -1,52 +1,575 @@
 #include "class.h"
+#include "classpath.h"
+#include "export.h"
 #include <errno.h>
+#include <getopt.h>
+#include "input.h"
+#include "jar.h"
+#include "json.h"
+#include "output.h"
 #include "print.h"
+#include <pthread.h>
+#include "reader.h"
+#include "stats.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "workers.h"
+
+/* Reports gathered before the emitter writes them out with one writev */
+#define EMIT_BATCH 64
+
+/* How many tasks ahead of the one being parsed a plain file's readahead is requested */
+#define PREFETCH_DISTANCE 16
+
+/* How reports are written: the text of print_class(), one JSON array, one JSON object per line, or rows of column
+ * tables gathered by an Exporter */
+typedef enum {
+    FORMAT_TEXT,
+    FORMAT_JSON,
+    FORMAT_NDJSON,
+    FORMAT_EXPORT
+} Format;
+
+/* One class to report on: a file named on the command line, or a .class entry of an archive */
+typedef struct {
+    char *file_name;
+    Jar *jar; /* NULL for a plain file */
+    JarEntry entry;
+    int err; /* set if the archive could not be opened */
+} Task;
+
+/* A worker's report on one task, waiting in the reorder buffer. Once written it goes back to the spares, and its buffer
+ * takes the next report. */
+typedef struct Report {
+    char *data;
+    size_t length;
+    size_t capacity;
+    struct Report *next; /* in the spares */
+} Report;
+
+/* Everything a run works through: the tasks, the archives they read from and one arena and inflate buffer per thread */
+typedef struct {
+    Task *tasks;
+    size_t count;
+    Jar **jars;
+    size_t jars_count;
+    Arena *arenas;
+    JarBuffer *buffers;
+    uint64_t *bytes; /* class file bytes parsed by each thread */
+    Reader *reader; /* reads plain files ahead of the workers, NULL to map each as it is reached */
+    Output *outputs; /* one in memory per thread, for reports waiting to be emitted */
+    Format format;
+    bool stream; /* write each report as soon as it is emitted, for consumers reading a pipe */
+    Exporter *exporter; /* takes the reports instead of standard output with FORMAT_EXPORT */
+    struct iovec batch[EMIT_BATCH]; /* reports emitted but not yet written */
+    Report *batch_reports[EMIT_BATCH]; /* and the Reports holding them */
+    int batched;
+    size_t batched_bytes;
+    int write_err; /* the first error writing standard output, after which nothing more is written */
+    pthread_mutex_t spares_lock; /* guards spares, which workers take from and the emitter returns to */
+    Report *spares; /* written reports whose buffers are free for another */
+} Scan;
+
+/* Write "Could not <verb> '<file>[!/<entry>]': <error>" */
+static void output_failure(Output *out, Format format, const char *verb, const Task *task, int err) {
+    const char *entry = task->jar != NULL ? task->entry.name : NULL;
+    if (format == FORMAT_EXPORT) {
+        export_encode_error(out, task->file_name, entry, task->entry.name_length, strerror(err));
+        return;
+    } else if (format != FORMAT_TEXT) {
+        output_json_error(out, task->file_name, entry, task->entry.name_length, strerror(err));
+        return;
+    }
+    output_str(out, "Could not ");
+    output_str(out, verb);
+    output_str(out, " '");
+    output_str(out, task->file_name);
+    if (task->jar != NULL) {
+        output_str(out, "!/");
+        output_bytes(out, task->entry.name, task->entry.name_length);
+    }
+    output_str(out, "': ");
+    output_str(out, strerror(err));
+    output_char(out, '\n');
+}
+
+/* Parse bytecode and write its report to out, adding its size to bytes. The arena is reset afterwards. */
+static void process_bytecode(Format format, const Task *task, Bytecode *bytecode, Arena *arena, uint64_t *bytes,
+                             Output *out) {
+    *bytes += bytecode->length;
+    // the input outlives the class, so payloads can be viewed in place
+    ParseOptions opts = {.flags = PARSE_ZERO_COPY, .arena = arena};
+    Class *
+    class = NULL;
+    int err = read_class_err(bytecode, &opts, &
+    class);
+    const char *entry = task->jar != NULL ? task->entry.name : NULL;
+    const char *why = err == ENODATA ? "truncated class file" : "not a valid class file";
+    STATS_ENTER(STATS_PRINT);
+    if (class == NULL && format == FORMAT_EXPORT) {
+        export_encode_error(out, task->file_name, entry, task->entry.name_length, why);
+    } else if (class == NULL && format != FORMAT_TEXT) {
+        output_json_error(out, task->file_name, entry, task->entry.name_length, why);
+    } else if (class == NULL) {
+        output_str(out, "class is null");
+    } else if (format == FORMAT_EXPORT) {
+        export_encode_class(out,
+        class, task->file_name, entry, task->entry.name_length);
+    } else if (format != FORMAT_TEXT) {
+        output_json_class(out,
+        class, task->file_name, entry, task->entry.name_length);
+    } else {
+        // yay, valid!
+        output_class(out,
+        class);
+    }
+    STATS_LEAVE();
+    arena_reset(arena);
+}
+
+/* Write the report on task index of scan, using the arena and buffers of thread worker */
+static void report_task(const Scan *scan, size_t index, unsigned worker, Output *out) {
+    const Task *task = scan->tasks + index;
+    Arena *arena = scan->arenas + worker;
+    uint64_t *bytes = scan->bytes + worker;
+    Bytecode bytecode;
+    if (scan->reader == NULL && index + PREFETCH_DISTANCE < scan->count) {
+        const Task *ahead = scan->tasks + index + PREFETCH_DISTANCE;
+        if (ahead->jar == NULL && ahead->err == 0) {
+            input_prefetch(ahead->file_name);
+        }
+    }
+    if (task->err != 0) {
+        output_failure(out, scan->format, "open", task, task->err);
+    } else if (task->jar != NULL) {
+        STATS_ENTER(STATS_INFLATE);
+        int err = jar_read(task->jar, &task->entry, scan->buffers + worker, &bytecode);
+        STATS_LEAVE();
+        if (err != 0) {
+            output_failure(out, scan->format, "read", task, err);
+            return;
+        }
+        process_bytecode(scan->format, task, &bytecode, arena, bytes, out);
+    } else if (scan->reader != NULL) {
+        STATS_ENTER(STATS_IO);
+        int err = reader_wait(scan->reader, index, &bytecode);
+        STATS_LEAVE();
+        if (err != 0) {
+            output_failure(out, scan->format, "open", task, err);
+        } else {
+            process_bytecode(scan->format, task, &bytecode, arena, bytes, out);
+        }
+        reader_release(scan->reader, index);
+    } else {
+        STATS_ENTER(STATS_IO);
+        Input input;
+        int err = input_open(&input, task->file_name);
+        if (err != 0) {
+            STATS_LEAVE();
+            output_failure(out, scan->format, "open", task, err);
+            return;
+        }
+        input_bytecode(&input, &bytecode);
+        STATS_LEAVE();
+        process_bytecode(scan->format, task, &bytecode, arena, bytes, out);
+        input_close(&input);
+    }
+}
+
+/* Report on task index of scan as one record of its format */
+static void process_task(const Scan *scan, size_t index, unsigned worker, Output *out) {
+    // records reach the output in index order, so each knows whether it opens the array
+    if (scan->format == FORMAT_JSON) {
+        output_str(out, index == 0 ? "[\n" : ",\n");
+    }
+    report_task(scan, index, worker, out);
+    if (scan->format == FORMAT_NDJSON) {
+        output_char(out, '\n');
+    }
+}
+
+/* Append a task to scan, growing its array as needed. Returns false if memory ran out. */
+static bool add_task(Scan *scan, size_t *capacity, Task task) {
+    if (scan->count == *capacity) {
+        size_t grown = *capacity > 0 ? *capacity * 2 : 64;
+        Task *tasks = realloc(scan->tasks, grown * sizeof(Task));
+        if (tasks == NULL) {
+            return false;
+        }
+        scan->tasks = tasks;
+        *capacity = grown;
+    }
+    scan->tasks[scan->count++] = task;
+    return true;
+}
+
+/* Expand the command line into tasks: plain files as they are, archives into one task per .class entry */
+static bool plan_scan(Scan *scan, char **files, size_t count) {
+    size_t capacity = 0;
+    size_t f;
+    scan->jars = calloc(count, sizeof(Jar *));
+    if (scan->jars == NULL) {
+        return false;
+    }
+    for (f = 0; f < count; f++) {
+        Task task = {.file_name = files[f]};
+        if (!is_jar_name(files[f])) {
+            if (!add_task(scan, &capacity, task)) {
+                return false;
+            }
+            continue;
+        }
+        Jar *jar = malloc(sizeof(Jar));
+        if (jar == NULL) {
+            return false;
+        }
+        task.err = jar_open(jar, files[f]);
+        if (task.err != 0) {
+            free(jar);
+            if (!add_task(scan, &capacity, task)) {
+                return false;
+            }
+            continue;
+        }
+        scan->jars[scan->jars_count++] = jar;
+        task.jar = jar;
+        JarCursor cursor = {0};
+        while (jar_next(jar, &cursor, &task.entry)) {
+            if (jar_entry_is_class(&task.entry) && !add_task(scan, &capacity, task)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* Report on task index into a Report for emit(), or return NULL if memory ran out for it or the report was cut short */
+static void *work(void *ctx, unsigned worker, size_t index) {
+    Scan *scan = ctx;
+    Output *out = scan->outputs + worker;
+    process_task(scan, index, worker, out);
+    // the error sticks, so every later report of this worker fails too
+    if (out->err != 0) {
+        return NULL;
+    }
+    pthread_mutex_lock(&scan->spares_lock);
+    Report *report = scan->spares;
+    if (report != NULL) {
+        scan->spares = report->next;
+    }
+    pthread_mutex_unlock(&scan->spares_lock);
+    if (report == NULL && (report = calloc(1, sizeof(Report))) == NULL) {
+        return NULL;
+    }
+    // the report's buffer, if it has one, is where the worker writes its next
+    output_take(out, &report->data, &report->length, &report->capacity);
+    return report;
+}
+
+/* Hand a written report back for a worker to reuse */
+static void release_report(Scan *scan, Report *report) {
+    pthread_mutex_lock(&scan->spares_lock);
+    report->next = scan->spares;
+    scan->spares = report;
+    pthread_mutex_unlock(&scan->spares_lock);
+}
+
+/* Write the batched reports to standard output in one go and release them */
+static void flush_batch(Scan *scan) {
+    struct iovec iov[EMIT_BATCH];
+    memcpy(iov, scan->batch, scan->batched * sizeof(struct iovec));
+    if (scan->write_err == 0) {
+        scan->write_err = output_writev(STDOUT_FILENO, iov, scan->batched);
+    }
+    int b;
+    for (b = 0; b < scan->batched; b++) {
+        release_report(scan, scan->batch_reports[b]);
+    }
+    scan->batched = 0;
+    scan->batched_bytes = 0;
+}
+
+static void emit(void *ctx, size_t index, void *result) {
+    (void) index;
+    Scan *scan = ctx;
+    Report *report = result;
+    if (report == NULL) {
+        // a missing record would leave a gap in the ordered output, so the run cannot go on
+        printf("Out of memory");
+        exit(EXIT_FAILURE);
+    }
+    if (scan->exporter != NULL) {
+        STATS_ENTER(STATS_PRINT);
+        if (!export_rows(scan->exporter, report->data, report->length)) {
+            printf("Out of memory");
+            exit(EXIT_FAILURE);
+        }
+        STATS_LEAVE();
+        release_report(scan, report);
+        return;
+    }
+    scan->batch[scan->batched].iov_base = report->data;
+    scan->batch[scan->batched].iov_len = report->length;
+    scan->batch_reports[scan->batched] = report;
+    scan->batched++;
+    scan->batched_bytes += report->length;
+    if (scan->stream || scan->batched == EMIT_BATCH || scan->batched_bytes >= OUTPUT_BUFFER) {
+        flush_batch(scan);
+    }
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
 int main(int argc, char *args[]) {
-    if (argc == 1) {
+    static const struct option long_options[] = {
+            {"classpath", required_argument, NULL, 'c'},
+            {"counters", no_argument, NULL, 'C'},
+            {"export", required_argument, NULL, 'e'},
+            {"format", required_argument, NULL, 'f'},
+            {"io", required_argument, NULL, 'i'},
+            {"queue-depth", required_argument, NULL, 'q'},
+            {"stats", optional_argument, NULL, 's'},
+            {NULL, 0, NULL, 0}
+    };
+    long jobs = 1;
+    char *classpath = NULL;
+    bool async = false;
+    ReaderBackend backend = READER_AUTO;
+    long depth = READER_DEFAULT_DEPTH;
+    Format format = FORMAT_TEXT;
+    char *export_dir = NULL;
+    bool stats = false;
+    bool stats_json = false;
+    bool counters = false;
+    int opt;
+    bool usage = false;
+    while ((opt = getopt_long(argc, args, "j:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'j':
+                jobs = strtol(optarg, NULL, 10);
+                usage |= jobs < 1;
+                break;
+            case 'c':
+                classpath = optarg;
+                break;
+            case 'C':
+                stats = counters = true;
+                break;
+            case 'e':
+                export_dir = optarg;
+                break;
+            case 'f':
+                format = strcmp(optarg, "json") == 0 ? FORMAT_JSON
+                       : strcmp(optarg, "ndjson") == 0 ? FORMAT_NDJSON : FORMAT_TEXT;
+                usage |= format == FORMAT_TEXT && strcmp(optarg, "text") != 0;
+                break;
+            case 'i':
+                async = strcmp(optarg, "mmap") != 0;
+                backend = strcmp(optarg, "uring") == 0 ? READER_URING
+                        : strcmp(optarg, "threads") == 0 ? READER_THREADS : READER_AUTO;
+                usage |= async && backend == READER_AUTO && strcmp(optarg, "auto") != 0;
+                break;
+            case 'q':
+                depth = strtol(optarg, NULL, 10);
+                usage |= depth < 1;
+                break;
+            case 's':
+                stats = true;
+                stats_json = optarg != NULL && strcmp(optarg, "json") == 0;
+                usage |= optarg != NULL && !stats_json && strcmp(optarg, "table") != 0;
+                break;
+            default:
+                usage = true;
+        }
+        if (usage) {
+            printf("Usage: cfr [-j threads] [--format=text|json|ndjson] [--export=dir] [--io=mmap|auto|uring|threads] "
+                   "[--queue-depth reads] [--stats[=table|json]] [--counters] [--classpath dir:file.jar:..] "
+                   ".class|.jar [.class|.jar ..]\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind == argc && classpath == NULL) {
         printf("Please pass at least 1 .class file to open");
         exit(EXIT_FAILURE);
     }
+    if (stats && stats_start(counters) != 0) {
+        fprintf(stderr, "Could not gather stats: this build was made without CFR_STATS\n");
+        exit(EXIT_FAILURE);
+    }
+    double started = now();
 
-    int i;
-    for (i = 1; i < argc; i++) {
-        char *file_name = args[i];
-        FILE *file = fopen(file_name, "r");
-        fseek(file, 0, SEEK_END);
-        long len = ftell(file);
-        char *data = malloc(len);
-        fseek(file, 0, SEEK_SET);
-        fread(data, 1, len, file);
-        if (!file) {
-            printf("Could not open '%s': %s\n", file_name, strerror(errno));
-            continue;
+    // the classpath's class files come first, in the order they are best read from disk, then its archives
+    Classpath cp = {0};
+    size_t names_count = 0;
+    char **names = NULL;
+    if (classpath != NULL) {
+        int err = classpath_scan(&cp, classpath);
+        if (err == ENOMEM) {
+            printf("Out of memory");
+            exit(EXIT_FAILURE);
+        } else if (err != 0) {
+            fprintf(stderr, "Could not read all of classpath '%s': %s\n", classpath, strerror(err));
         }
-        Bytecode bytecode = {
-                .data = data,
-                .length = len,
-                .index = 0,
-        };
+    }
+    names = malloc((cp.files_count + cp.jars_count + argc - optind) * sizeof(char *));
+    size_t n;
+    for (n = 0; n < cp.files_count; n++) {
+        names[names_count++] = cp.files[n].path;
+    }
+    for (n = 0; n < cp.jars_count; n++) {
+        names[names_count++] = cp.jars[n];
+    }
+    for (n = optind; n < (size_t) argc; n++) {
+        names[names_count++] = args[n];
+    }
 
-        Class *
-        class = read_class(&bytecode);
-        if (class == NULL) {
-            printf("class is null");
-        } else {
-            // yay, valid!
-            print_class(
-            class);
+    Scan scan = {.format = export_dir != NULL ? FORMAT_EXPORT : format};
+    pthread_mutex_init(&scan.spares_lock, NULL);
+    if (export_dir != NULL && (scan.exporter = export_create()) == NULL) {
+        printf("Out of memory");
+        exit(EXIT_FAILURE);
+    }
+    if (names == NULL || !plan_scan(&scan, names, names_count)) {
+        printf("Out of memory");
+        exit(EXIT_FAILURE);
+    }
+
+    // each thread reuses one arena, reset after every class, so memory stays bounded by the largest class
+    scan.arenas = calloc(jobs, sizeof(Arena));
+    scan.buffers = calloc(jobs, sizeof(JarBuffer));
+    scan.bytes = calloc(jobs, sizeof(uint64_t));
+    scan.outputs = calloc(jobs, sizeof(Output));
+    long i;
+    for (i = 0; i < jobs; i++) {
+        if (scan.arenas == NULL || scan.buffers == NULL || scan.bytes == NULL || scan.outputs == NULL
+            || !arena_init(scan.arenas + i, ARENA_MIN_BLOCK * 16) || !output_init(scan.outputs + i, -1, ARENA_MIN_BLOCK)
+            || output_stdout() == NULL) {
+            printf("Out of memory");
+            exit(EXIT_FAILURE);
         }
+    }
 
-        free(
-        class);
-        fclose(file);
+    // read plain files into pooled buffers ahead of the parsers, so the disk and the CPUs are busy at once
+    char **reads = NULL;
+    if (async) {
+        reads = calloc(scan.count > 0 ? scan.count : 1, sizeof(char *));
+        if (reads == NULL) {
+            printf("Out of memory");
+            exit(EXIT_FAILURE);
+        }
+        size_t t;
+        for (t = 0; t < scan.count; t++) {
+            if (scan.tasks[t].jar == NULL && scan.tasks[t].err == 0) {
+                reads[t] = scan.tasks[t].file_name;
+            }
+        }
+        int err = reader_start(&scan.reader, reads, scan.count, backend, depth, depth + jobs);
+        if (err != 0) {
+            fprintf(stderr, "Could not start the %s reader: %s\n", backend == READER_URING ? "io_uring" : "async",
+                    strerror(err));
+            exit(EXIT_FAILURE);
+        }
     }
 
-    exit(EXIT_SUCCESS);
-}
+    // workers build their reports in memory and the emitter writes them out in order; a serial run writes straight
+    // into the buffered standard output
+    Output *out = output_stdout();
+    struct stat st;
+    // NDJSON read through a pipe goes out a record at a time so consumers can start before the scan is done
+    scan.stream = format == FORMAT_NDJSON && fstat(STDOUT_FILENO, &st) == 0 && !S_ISREG(st.st_mode);
+    if (jobs == 1 || run_ordered(jobs, scan.count, work, emit, &scan) != 0) {
+        size_t t;
+        for (t = 0; t < scan.count; t++) {
+            if (scan.exporter != NULL) {
+                // rows go through the same encoding a worker's would
+                emit(&scan, t, work(&scan, 0, t));
+                continue;
+            }
+            process_task(&scan, t, 0, out);
+            if (scan.stream) {
+                output_flush(out);
+            }
+        }
+    }
+    if (scan.exporter != NULL) {
+        int err = export_write(scan.exporter, export_dir);
+        if (err != 0) {
+            fprintf(stderr, "Could not export to '%s': %s\n", export_dir, strerror(err));
+            exit(EXIT_FAILURE);
+        }
+        export_free(scan.exporter);
+    }
+    flush_batch(&scan);
+    if (format == FORMAT_JSON) {
+        output_str(out, scan.count > 0 ? "\n]\n" : "[]\n");
+    }
+    if (output_flush(out) != 0 && scan.write_err == 0) {
+        scan.write_err = out->err;
+    }
+    if (scan.write_err != 0) {
+        fprintf(stderr, "Could not write the output: %s\n", strerror(scan.write_err));
+    }
+
+    if (classpath != NULL) {
+        uint64_t bytes = 0;
+        for (i = 0; i < jobs; i++) {
+            bytes += scan.bytes[i];
+        }
+        double elapsed = now() - started;
+        double mb = bytes / (1024.0 * 1024.0);
+        fprintf(stderr, "Scanned %zu classes, %.1f MB in %.3f s: %.0f files/s, %.1f MB/s\n", scan.count, mb, elapsed,
+                elapsed > 0 ? scan.count / elapsed : 0, elapsed > 0 ? mb / elapsed : 0);
+    }
+
+    if (stats) {
+        Output report;
+        if (output_init(&report, STDERR_FILENO, ARENA_MIN_BLOCK)) {
+            stats_report(&report, stats_json);
+            output_flush(&report);
+            output_free(&report);
+        }
+        stats_stop();
+    }
 
+    if (scan.reader != NULL) {
+        reader_stop(scan.reader);
+    }
+    free(reads);
+    for (i = 0; i < jobs; i++) {
+        arena_destroy(scan.arenas + i);
+        jar_buffer_free(scan.buffers + i);
+        output_free(scan.outputs + i);
+    }
+    size_t j;
+    for (j = 0; j < scan.jars_count; j++) {
+        jar_close(scan.jars[j]);
+        free(scan.jars[j]);
+    }
+    free(scan.jars);
+    free(scan.tasks);
+    free(scan.arenas);
+    free(scan.buffers);
+    free(scan.bytes);
+    free(scan.outputs);
+    while (scan.spares != NULL) {
+        Report *next = scan.spares->next;
+        free(scan.spares->data);
+        free(scan.spares);
+        scan.spares = next;
+    }
+    pthread_mutex_destroy(&scan.spares_lock);
+    output_free(out);
+    free(names);
+    classpath_free(&cp);
+    exit(scan.write_err != 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,214 @@
+#include "mutf8.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define MUTF8_X86 1
+#include <immintrin.h>
+#endif
+
+#define HIGH_BITS 0x8080808080808080ull
+#define LOW_BITS 0x0101010101010101ull
+
+/* The offset of the first byte of the eight at p that is NUL or not ASCII, or 8 */
+static size_t word_stop(const uint8_t *p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    // the top bit of every byte that is not ASCII or, from the lowest one up, is zero
+    uint64_t stops = (word | ((word - LOW_BITS) & ~word)) & HIGH_BITS;
+    return stops != 0 ? (size_t) __builtin_ctzll(stops) / 8 : 8;
+}
+
+/* The first byte from i on that is NUL or not ASCII, or length. Takes eight bytes a step, finishing with a step that
+ * overlaps the one before rather than going byte by byte. */
+static size_t ascii_tail(const uint8_t *p, size_t i, size_t length) {
+    if (length < 8) {
+        while (i < length && p[i] != 0 && p[i] < 0x80) {
+            i++;
+        }
+        return i;
+    }
+    for (; i + 8 <= length; i += 8) {
+        size_t stop = word_stop(p + i);
+        if (stop < 8) {
+            return i + stop;
+        }
+    }
+    // the bytes before i are known to be ASCII, so the first stop in the last eight is at i or later
+    return i < length ? length - 8 + word_stop(p + length - 8) : length;
+}
+
+#ifndef MUTF8_X86
+
+static size_t ascii_scalar(const uint8_t *p, size_t length) {
+    return ascii_tail(p, 0, length);
+}
+
+#else
+
+/* SSE2 is part of x86-64, so this needs no check */
+static size_t ascii_sse2(const uint8_t *p, size_t length) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (p + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, zero)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return ascii_tail(p, i, length);
+}
+
+__attribute__((target("avx2")))
+static size_t ascii_avx2(const uint8_t *p, size_t length) {
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (p + i));
+        unsigned mask = (unsigned) _mm256_movemask_epi8(_mm256_or_si256(v, _mm256_cmpeq_epi8(v, zero)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    // a half step here rather than a call to ascii_sse2(), whose legacy SSE encoding would stall on the dirty upper
+    // halves of the AVX registers
+    if (i + 16 <= length) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (p + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+        i += 16;
+    }
+    return ascii_tail(p, i, length);
+}
+
+#endif
+
+typedef size_t (*AsciiKernel)(const uint8_t *p, size_t length);
+
+/* NULL until the first call picks one. Every thread picks the same, so a race to store it is harmless. */
+static AsciiKernel ascii_kernel;
+
+static AsciiKernel pick_kernel(void) {
+#ifdef MUTF8_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? ascii_avx2 : ascii_sse2;
+#else
+    return ascii_scalar;
+#endif
+}
+
+size_t mutf8_ascii_length(const char *s, size_t length) {
+    if (length < 32) {
+        // most pool strings: not worth a vector
+        return ascii_tail((const uint8_t *) s, 0, length);
+    }
+    AsciiKernel kernel = __atomic_load_n(&ascii_kernel, __ATOMIC_RELAXED);
+    if (kernel == NULL) {
+        kernel = pick_kernel();
+        __atomic_store_n(&ascii_kernel, kernel, __ATOMIC_RELAXED);
+    }
+    return kernel((const uint8_t *) s, length);
+}
+
+static bool continuation(uint8_t c) {
+    return (c & 0xc0) == 0x80;
+}
+
+/* The UTF-16 code unit of the three-byte sequence at p, which has at least three bytes */
+static uint32_t unit3(const uint8_t *p) {
+    return ((uint32_t) (p[0] & 0x0f) << 12) | ((uint32_t) (p[1] & 0x3f) << 6) | (p[2] & 0x3f);
+}
+
+bool mutf8_validate(const char *s, size_t length, bool *ascii) {
+    const uint8_t *p = (const uint8_t *) s;
+    size_t i = mutf8_ascii_length(s, length);
+    *ascii = i == length;
+    while (i < length) {
+        uint8_t c = p[i];
+        if (c != 0 && c < 0x80) {
+            i += mutf8_ascii_length(s + i, length - i);
+        } else if ((c & 0xe0) == 0xc0) {
+            // two bytes for U+0080 to U+07FF, or c0 80 for NUL; nothing else may be written long
+            if (length - i < 2 || !continuation(p[i + 1]) || (c < 0xc2 && (c != 0xc0 || p[i + 1] != 0x80))) {
+                return false;
+            }
+            i += 2;
+        } else if ((c & 0xf0) == 0xe0) {
+            if (length - i < 3 || !continuation(p[i + 1]) || !continuation(p[i + 2]) || unit3(p + i) < 0x800) {
+                return false;
+            }
+            i += 3;
+        } else {
+            // a NUL, a stray continuation byte or the lead of a four-byte form
+            return false;
+        }
+    }
+    return true;
+}
+
+/* The number of bytes at the start of p, up to length, that standard UTF-8 reads the same: ASCII other than NUL, and
+ * well-formed two- and three-byte characters other than an encoded NUL or a surrogate */
+static size_t shared_length(const uint8_t *p, size_t length) {
+    size_t i = 0;
+    while (i < length) {
+        uint8_t c = p[i];
+        if (c != 0 && c < 0x80) {
+            i += mutf8_ascii_length((const char *) p + i, length - i);
+        } else if (c >= 0xc2 && c < 0xe0 && length - i >= 2 && continuation(p[i + 1])) {
+            i += 2;
+        } else if ((c & 0xf0) == 0xe0 && length - i >= 3 && continuation(p[i + 1]) && continuation(p[i + 2]) &&
+                   unit3(p + i) >= 0x800 && (unit3(p + i) < 0xd800 || unit3(p + i) > 0xdfff)) {
+            i += 3;
+        } else {
+            break;
+        }
+    }
+    return i;
+}
+
+/* Whether the three bytes at p, of which there are at least three, encode a surrogate */
+static bool surrogate(const uint8_t *p) {
+    return p[0] == 0xed && p[1] >= 0xa0 && p[1] <= 0xbf && continuation(p[2]);
+}
+
+size_t mutf8_to_utf8(char *dst, size_t capacity, const char *src, size_t length, size_t *consumed) {
+    const uint8_t *p = (const uint8_t *) src;
+    size_t i = 0, written = 0;
+    while (i < length) {
+        // whole characters only, so a run cut short by dst stops with under four bytes of it left
+        size_t run = shared_length(p + i, length - i < capacity - written ? length - i : capacity - written);
+        memcpy(dst + written, src + i, run);
+        written += run;
+        i += run;
+        if (i == length || capacity - written < 4) {
+            break;
+        }
+        if (length - i >= 2 && p[i] == 0xc0 && p[i + 1] == 0x80) {
+            dst[written++] = '\0';
+            i += 2;
+        } else if (length - i >= 6 && surrogate(p + i) && p[i + 1] <= 0xaf && surrogate(p + i + 3) && p[i + 4] >= 0xb0) {
+            // a high and a low surrogate: one character past U+FFFF, which standard UTF-8 writes in four bytes
+            uint32_t cp = 0x10000 + ((unit3(p + i) - 0xd800) << 10) + (unit3(p + i + 3) - 0xdc00);
+            dst[written++] = (char) (0xf0 | (cp >> 18));
+            dst[written++] = (char) (0x80 | ((cp >> 12) & 0x3f));
+            dst[written++] = (char) (0x80 | ((cp >> 6) & 0x3f));
+            dst[written++] = (char) (0x80 | (cp & 0x3f));
+            i += 6;
+        } else {
+            // a lone surrogate, or a byte that is not well-formed after all: stand in for it rather than run past the end
+            memcpy(dst + written, "\xef\xbf\xbd", 3);
+            written += 3;
+            i += length - i >= 3 && surrogate(p + i) ? 3 : 1;
+        }
+    }
+    *consumed = i;
+    return written;
+}
@@ -0,0 +1,26 @@
+#ifndef MUTF8_H
+#define MUTF8_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* The Modified UTF-8 of constant pool strings (JVM spec 4.4.7). It differs from standard UTF-8 in encoding NUL as the
+ * two bytes c0 80 and characters beyond U+FFFF as two three-byte surrogates, and in having no four-byte form. Bytes
+ * 0x01 to 0x7f stand for themselves in both, so an ASCII string needs no conversion. */
+
+/* The number of bytes at the start of s, up to length, that are ASCII other than NUL. Checks 32 bytes a step where
+ * the CPU allows. */
+size_t mutf8_ascii_length(const char *s, size_t length);
+
+/* Return true if the length bytes at s are well-formed Modified UTF-8, setting *ascii if they are all ASCII. Lone
+ * surrogates are accepted, as the JVM accepts them. */
+bool mutf8_validate(const char *s, size_t length, bool *ascii);
+
+/* Convert well-formed Modified UTF-8 at src to standard UTF-8 at dst, whole characters at a time until either runs
+ * out. Lone surrogates become U+FFFD. The output is never longer than the input, so a dst of length bytes takes it
+ * all; a shorter dst needs room for at least four bytes. Sets *consumed to the bytes of src used and returns the bytes
+ * written. */
+size_t mutf8_to_utf8(char *dst, size_t capacity, const char *src, size_t length, size_t *consumed);
+
+#endif //MUTF8_H
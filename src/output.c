@@ -0,0 +1,209 @@
+#include "output.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stats.h"
+#include <unistd.h>
+
+/* Most buffers one writev accepts on Linux */
+#define WRITEV_MAX 1024
+
+/* "00" to "99", so decimals are produced two digits per division */
+static const char DIGIT_PAIRS[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+static __thread Output stdout_output;
+static __thread bool stdout_ready;
+
+bool output_init(Output *out, int fd, size_t capacity) {
+    out->data = malloc(capacity > 0 ? capacity : 1);
+    out->length = 0;
+    out->capacity = capacity > 0 ? capacity : 1;
+    out->fd = fd;
+    out->err = out->data == NULL ? ENOMEM : 0;
+    return out->data != NULL;
+}
+
+Output *output_stdout(void) {
+    if (!stdout_ready) {
+        if (!output_init(&stdout_output, STDOUT_FILENO, OUTPUT_BUFFER)) {
+            return NULL;
+        }
+        stdout_ready = true;
+    }
+    return &stdout_output;
+}
+
+/* Make room for length more bytes, flushing or growing. Returns false if the bytes must be dropped. */
+static bool reserve(Output *out, size_t length) {
+    if (out->err != 0) {
+        return false;
+    }
+    if (out->capacity - out->length >= length) {
+        return true;
+    }
+    if (out->fd >= 0) {
+        if (output_flush(out) != 0) {
+            return false;
+        }
+        if (out->capacity >= length) {
+            return true;
+        }
+    }
+    size_t grown = out->capacity;
+    while (grown - out->length < length) {
+        grown *= 2;
+    }
+    char *data = realloc(out->data, grown);
+    if (data == NULL) {
+        out->err = ENOMEM;
+        return false;
+    }
+    out->data = data;
+    out->capacity = grown;
+    return true;
+}
+
+void output_bytes(Output *out, const char *data, size_t length) {
+    if (out->fd >= 0 && length >= out->capacity && out->err == 0) {
+        // too big to be worth copying: write what is buffered and the bytes together
+        struct iovec iov[2] = {{out->data, out->length}, {(void *) data, length}};
+        out->err = output_writev(out->fd, iov, 2);
+        out->length = 0;
+        return;
+    }
+    if (reserve(out, length)) {
+        memcpy(out->data + out->length, data, length);
+        out->length += length;
+    }
+}
+
+void output_str(Output *out, const char *str) {
+    output_bytes(out, str, strlen(str));
+}
+
+void output_char(Output *out, char c) {
+    if (reserve(out, 1)) {
+        out->data[out->length++] = c;
+    }
+}
+
+void output_uint(Output *out, uint64_t value) {
+    char digits[20];
+    char *p = digits + sizeof(digits);
+    while (value >= 100) {
+        unsigned pair = (unsigned) (value % 100) * 2;
+        value /= 100;
+        *--p = DIGIT_PAIRS[pair + 1];
+        *--p = DIGIT_PAIRS[pair];
+    }
+    if (value >= 10) {
+        *--p = DIGIT_PAIRS[value * 2 + 1];
+        *--p = DIGIT_PAIRS[value * 2];
+    } else {
+        *--p = (char) ('0' + value);
+    }
+    output_bytes(out, p, digits + sizeof(digits) - p);
+}
+
+void output_int(Output *out, int64_t value) {
+    if (value < 0) {
+        output_char(out, '-');
+        // negate in unsigned arithmetic so INT64_MIN survives
+        output_uint(out, -(uint64_t) value);
+    } else {
+        output_uint(out, (uint64_t) value);
+    }
+}
+
+void output_hex(Output *out, uint64_t value) {
+    static const char HEX[] = "0123456789abcdef";
+    char digits[16];
+    char *p = digits + sizeof(digits);
+    do {
+        *--p = HEX[value & 0xf];
+        value >>= 4;
+    } while (value != 0);
+    output_bytes(out, p, digits + sizeof(digits) - p);
+}
+
+void output_double(Output *out, double value) {
+    // rare enough in class files that printf's exact rounding is worth the call
+    char text[512];
+    int length = snprintf(text, sizeof(text), "%f", value);
+    if (length > 0) {
+        output_bytes(out, text, (size_t) length < sizeof(text) ? (size_t) length : sizeof(text) - 1);
+    }
+}
+
+int output_flush(Output *out) {
+    if (out->fd >= 0 && out->length > 0 && out->err == 0) {
+        struct iovec iov = {out->data, out->length};
+        out->err = output_writev(out->fd, &iov, 1);
+        out->length = 0;
+    }
+    return out->err;
+}
+
+void output_take(Output *out, char **data, size_t *length, size_t *capacity) {
+    char *spare = *data;
+    size_t spare_capacity = *capacity;
+    *data = out->data;
+    *length = out->length;
+    *capacity = out->capacity;
+    if (spare == NULL) {
+        output_init(out, out->fd, *capacity);
+        return;
+    }
+    // a reused buffer keeps whatever it has grown to, so steady output needs no allocation at all
+    out->data = spare;
+    out->length = 0;
+    out->capacity = spare_capacity;
+}
+
+void output_free(Output *out) {
+    free(out->data);
+    out->data = NULL;
+    out->length = 0;
+    out->capacity = 0;
+}
+
+int output_writev(int fd, struct iovec *iov, int count) {
+    STATS_ENTER(STATS_WRITE);
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count < WRITEV_MAX ? count : WRITEV_MAX);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            int err = errno;
+            STATS_LEAVE();
+            return err;
+        }
+        STATS_ADD(STATS_OUTPUT_BYTES, n);
+        // skip the buffers written in full and trim the one cut short
+        while (count > 0 && (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    STATS_LEAVE();
+    return 0;
+}
@@ -0,0 +1,61 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+
+/* Size of the buffer behind output_stdout(). An Output bound to a descriptor is flushed whenever it fills. */
+#define OUTPUT_BUFFER (1024 * 1024)
+
+/* A byte sink with its own formatting, so reports are built with plain memcpys instead of stdio calls.
+ * Bound to a descriptor it is written out as it fills; with fd -1 it grows in memory until taken. */
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    int fd;
+    int err; /* first write or allocation error; once set, further output is dropped */
+} Output;
+
+/* Initialise out with a buffer of capacity bytes, flushing to fd or growing in memory if fd is -1.
+ * Returns false if memory ran out. */
+bool output_init(Output *out, int fd, size_t capacity);
+
+/* The calling thread's Output for standard output, created on first use. NULL if memory ran out. */
+Output *output_stdout(void);
+
+void output_bytes(Output *out, const char *data, size_t length);
+
+void output_str(Output *out, const char *str);
+
+void output_char(Output *out, char c);
+
+/* Decimal, as printf's %u and %d */
+void output_uint(Output *out, uint64_t value);
+
+void output_int(Output *out, int64_t value);
+
+/* Lower case hexadecimal without a prefix, as printf's %x */
+void output_hex(Output *out, uint64_t value);
+
+/* As printf's %f */
+void output_double(Output *out, double value);
+
+/* Write everything buffered to the descriptor. Does nothing in memory. Returns 0 or the sticky errno value. */
+int output_flush(Output *out);
+
+/* Hand the bytes gathered in memory to the caller and start out over empty. On entry *data and *capacity give a buffer
+ * the caller is done with for out to start over in, or *data is NULL for a new one; on return they hold the bytes taken,
+ * *length of them, for the caller to free or pass back in. */
+void output_take(Output *out, char **data, size_t *length, size_t *capacity);
+
+void output_free(Output *out);
+
+/* Write count buffers to fd in as few system calls as possible, resuming after short writes.
+ * Returns 0 on success, otherwise an errno value. */
+int output_writev(int fd, struct iovec *iov, int count);
+
+#endif //OUTPUT_H
@@ -1,99 +1,197 @@
 #include "class.h"
+#include "mutf8.h"
+#include "output.h"
+#include "print.h"
+#include <string.h>
+
+/* A string's characters in standard UTF-8, stopping at a NUL byte as printf's %.*s would. Nothing if its value is
+ * NULL. */
+static void output_view(Output *out, String string) {
+    if (string.value == NULL) {
+        return;
+    }
+    const char *value = string.value;
+    size_t length = string.length;
+    if (string.ascii) {
+        output_bytes(out, value, length);
+        return;
+    }
+    const char *nul = memchr(value, '\0', length);
+    if (nul != NULL) {
+        length = nul - value;
+    }
+    char utf8[256];
+    while (length > 0) {
+        size_t consumed;
+        size_t written = mutf8_to_utf8(utf8, sizeof(utf8), value, length, &consumed);
+        output_bytes(out, utf8, written);
+        value += consumed;
+        length -= consumed;
+    }
+}
+
+/* A UTF8 item's characters, see output_view(). Nothing for an item of any other kind. */
+static void output_string(Output *out, Item item) {
+    if (item.tag == STRING_UTF8) {
+        output_view(out, item.value.string);
+    }
+}
+
+/* The length and contents lines shared by every attribute */
+static void output_attribute(Output *out, const Attribute *at) {
+    output_str(out, "\tAttribute length ");
+    output_int(out, (int) at->length);
+    output_str(out, "\n\tAttribute: ");
+    if (at->info != NULL) {
+        const char *nul = at->length > 0 ? memchr(at->info, '\0', at->length) : NULL;
+        output_bytes(out, at->info, nul != NULL ? (size_t) (nul - at->info) : at->length);
+    }
+    output_char(out, '\n');
+}
 
 void print_class(const Class *class) {
+    Output *out = output_stdout();
+    if (out != NULL) {
+        output_class(out,
+        class);
+        output_flush(out);
+    }
+}
 
-    printf("Minor number: %u \n",
+void fprint_class(FILE *stream, const Class *class) {
+    Output out;
+    if (output_init(&out, -1, OUTPUT_BUFFER / 16)) {
+        output_class(&out,
+        class);
+        fwrite(out.data, 1, out.length, stream);
+        output_free(&out);
+    }
+}
+
+void output_class(Output *out, const Class *class) {
+
+    output_str(out, "Minor number: ");
+    output_uint(out,
     class->minor_version);
-    printf("Major number: %u \n",
+    output_str(out, " \nMajor number: ");
+    output_uint(out,
     class->major_version);
-    printf("Constant pool size: %u \n",
+    output_str(out, " \nConstant pool size: ");
+    output_uint(out,
     class->const_pool_count);
-    printf("Constant table size: %ub \n",
+    output_str(out, " \nConstant table size: ");
+    output_uint(out,
     class->pool_size_bytes);
-    printf("Printing constant pool of %d items...\n",
+    output_str(out, "b \nPrinting constant pool of ");
+    output_int(out,
     class->const_pool_count - 1);
+    output_str(out, " items...\n");
 
-    Item *s;
+    Item s;
     uint16_t i = 1; // constant pool indexes start at 1, get_item converts to pointer index
     while (i < class->const_pool_count) {
         s = get_item(
         class, i);
-        printf("Item #%u %s: ", i, tag2str(s->tag));
-        if (s->tag == STRING_UTF8) {
-            printf("%s\n", s->value.string.value);
-        } else if (s->tag == INTEGER) {
-            printf("%d\n", s->value.integer);
-        } else if (s->tag == FLOAT) {
-            printf("%f\n", s->value.flt);
-        } else if (s->tag == LONG) {
-            printf("%ld\n", to_long(s->value.lng));
-        } else if (s->tag == DOUBLE) {
-            printf("%lf\n", to_double(s->value.dbl));
-        } else if (s->tag == CLASS || s->tag == STRING) {
-            printf("%u\n", s->value.ref.class_idx);
-        } else if (s->tag == FIELD || s->tag == METHOD || s->tag == INTERFACE_METHOD || s->tag == NAME) {
-            printf("%u.%u\n", s->value.ref.class_idx, s->value.ref.name_idx);
+        if (s.tag == 0) {
+            // the unusable second entry of a long or double
+            i++;
+            continue;
+        }
+        output_str(out, "Item #");
+        output_uint(out, i);
+        output_char(out, ' ');
+        output_str(out, tag2str(s.tag));
+        output_str(out, ": ");
+        if (s.tag == STRING_UTF8) {
+            output_string(out, s);
+            output_char(out, '\n');
+        } else if (s.tag == INTEGER) {
+            output_int(out, s.value.integer);
+            output_char(out, '\n');
+        } else if (s.tag == FLOAT) {
+            output_double(out, s.value.flt);
+            output_char(out, '\n');
+        } else if (s.tag == LONG) {
+            output_int(out, to_long(s.value.lng));
+            output_char(out, '\n');
+        } else if (s.tag == DOUBLE) {
+            output_double(out, to_double(s.value.dbl));
+            output_char(out, '\n');
+        } else if (s.tag == CLASS || s.tag == STRING || s.tag == METHOD_TYPE || s.tag == MODULE || s.tag == PACKAGE) {
+            output_uint(out, s.value.ref.class_idx);
+            output_char(out, '\n');
+        } else if (s.tag == FIELD || s.tag == METHOD || s.tag == INTERFACE_METHOD || s.tag == NAME ||
+                   s.tag == METHOD_HANDLE || s.tag == DYNAMIC || s.tag == INVOKE_DYNAMIC) {
+            output_uint(out, s.value.ref.class_idx);
+            output_char(out, '.');
+            output_uint(out, s.value.ref.name_idx);
+            output_char(out, '\n');
         }
         i++;
     }
 
-    printf("Access flags: %x\n",
+    output_str(out, "Access flags: ");
+    output_hex(out,
     class->flags);
+    output_char(out, '\n');
 
-    Item * cl_str = get_class_string(
-    class, class->this_class);
-    printf("This class: %s\n", cl_str->value.string.value);
+    output_str(out, "This class: ");
+    output_view(out, resolve_ref(
+    class, class->this_class).owner);
+    output_char(out, '\n');
 
-    cl_str = get_class_string(
-    class, class->super_class);
-    printf("Super class: %s\n", cl_str->value.string.value);
+    output_str(out, "Super class: ");
+    output_view(out, resolve_ref(
+    class, class->super_class).owner);
 
-    printf("Interfaces count: %u\n",
+    output_str(out, "\nInterfaces count: ");
+    output_uint(out,
     class->interfaces_count);
 
-    printf("Printing %u interfaces...\n",
+    output_str(out, "\nPrinting ");
+    output_uint(out,
     class->interfaces_count);
+    output_str(out, " interfaces...\n");
     if (class->interfaces_count > 0) {
-        Ref * iface =
-        class->interfaces;
-        Item *the_class;
         uint16_t idx = 0;
         while (idx < class->interfaces_count) {
-            the_class = get_item(
-            class, iface->class_idx); // the interface class reference
-            Item * item = get_item(
-            class, the_class->value.ref.class_idx);
-            String string = item->value.string;
-            printf("Interface: %s\n", string.value);
+            output_str(out, "Interface: ");
+            output_view(out, resolve_ref(
+            class, class->interfaces[idx]).owner);
+            output_char(out, '\n');
             idx++;
-            iface =
-            class->interfaces + idx; // next Ref
         }
     }
 
-    printf("Printing %d fields...\n",
+    output_str(out, "Printing ");
+    output_int(out,
     class->fields_count);
+    output_str(out, " fields...\n");
 
     if (class->fields_count > 0) {
         Field * field =
         class->fields;
         uint16_t idx = 0;
         while (idx < class->fields_count) {
-            Item * name = get_item(
+            Item name = get_item(
             class, field->name_idx);
-            Item * desc = get_item(
+            Item desc = get_item(
             class, field->desc_idx);
-            printf("%s %s\n", field2str(desc->value.string.value[0]), name->value.string.value);
+            output_str(out, field2str(desc.tag == STRING_UTF8 && desc.value.string.length > 0 ? desc.value.string.value[0] : '\0'));
+            output_char(out, ' ');
+            output_string(out, name);
+            output_char(out, '\n');
             Attribute at;
             if (field->attrs_count > 0) {
                 int aidx = 0;
                 while (aidx < field->attrs_count) {
                     at = field->attrs[aidx];
-                    Item * name = get_item(
+                    Item name = get_item(
                     class, at.name_idx);
-                    printf("\tAttribute name: %s\n", name->value.string.value);
-                    printf("\tAttribute length %d\n", at.length);
-                    printf("\tAttribute: %s\n", at.info);
+                    output_str(out, "\tAttribute name: ");
+                    output_string(out, name);
+                    output_char(out, '\n');
+                    output_attribute(out, &at);
                     aidx++;
                 }
             }
@@ -103,29 +201,34 @@ void print_class(const Class *class) {
         }
     }
 
-    printf("Printing %u methods...\n",
+    output_str(out, "Printing ");
+    output_uint(out,
     class->methods_count);
+    output_str(out, " methods...\n");
     i = 0;
     if (class->methods_count > 0) {
         Method * method =
         class->methods;
         uint16_t idx = 0;
         while (idx < class->methods_count) {
-            Item * name = get_item(
+            Item name = get_item(
             class, method->name_idx);
-            Item * desc = get_item(
+            Item desc = get_item(
             class, method->desc_idx);
-            printf("%s %s\n", name->value.string.value, desc->value.string.value);
+            output_string(out, name);
+            output_char(out, ' ');
+            output_string(out, desc);
+            output_char(out, '\n');
             Attribute at;
             if (method->attrs_count > 0) {
                 int aidx = 0;
                 while (aidx < method->attrs_count) {
                     at = method->attrs[aidx];
-                    Item * name = get_item(
+                    Item name = get_item(
                     class, at.name_idx);
-                    printf("\tAttribute name: %s", name->value.string.value);
-                    printf("\tAttribute length %d\n", at.length);
-                    printf("\tAttribute: %s\n", at.info);
+                    output_str(out, "\tAttribute name: ");
+                    output_string(out, name);
+                    output_attribute(out, &at);
                     aidx++;
                 }
             }
@@ -135,19 +238,21 @@ void print_class(const Class *class) {
         }
     }
 
-    printf("Printing %u attributes...\n",
+    output_str(out, "Printing ");
+    output_uint(out,
     class->attributes_count);
+    output_str(out, " attributes...\n");
     if (class->attributes_count > 0) {
         Attribute at;
         int aidx = 0;
         while (aidx < class->attributes_count) {
             at =
             class->attributes[aidx];
-            Item * name = get_item(
+            Item name = get_item(
             class, at.name_idx);
-            printf("\tAttribute name: %s", name->value.string.value);
-            printf("\tAttribute length %d\n", at.length);
-            printf("\tAttribute: %s\n", at.info);
+            output_str(out, "\tAttribute name: ");
+            output_string(out, name);
+            output_attribute(out, &at);
             aidx++;
         }
     }
@@ -2,11 +2,19 @@
 #define PRINT_H
 
 #include "class.h"
+#include "output.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 
+/* Write a text dump of class to standard output */
 void print_class(const Class *class);
 
+/* As print_class() but into out, which is not flushed */
+void output_class(Output *out, const Class *class);
+
+/* As print_class() but writing to stream */
+void fprint_class(FILE *stream, const Class *class);
+
 #endif //PRINT_H
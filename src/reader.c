@@ -0,0 +1,473 @@
+#include "reader.h"
+#include "input.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/* One pooled buffer and the read filling it */
+typedef struct {
+    char *data;
+    size_t capacity;
+    Input input; /* used instead of data for pipes and special files */
+    int fd;
+    size_t length; /* of the file being read */
+    size_t done; /* bytes read so far */
+    size_t index;
+    struct iovec iov;
+    bool submitted; /* queued on or in flight in the ring */
+    int next_free;
+} ReaderBuffer;
+
+/* Where names[index] stands */
+typedef struct {
+    int err;
+    int buffer; /* -1 until read */
+    bool ready;
+} ReaderEntry;
+
+/* The rings of an io_uring, mapped from the kernel */
+typedef struct {
+    int fd;
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map;
+    size_t cq_map_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+} Ring;
+
+struct Reader {
+    char *const *names;
+    size_t count;
+    ReaderBackend backend;
+    unsigned depth;
+    ReaderBuffer *buffers;
+    unsigned buffers_count;
+    ReaderEntry *entries;
+    Ring ring;
+    pthread_t *threads;
+    unsigned threads_count;
+
+    pthread_mutex_t lock; /* guards everything below and the entries */
+    pthread_cond_t ready; /* an entry became ready */
+    pthread_cond_t released; /* a buffer was returned to the pool */
+    size_t next; /* first name not yet handed to a read */
+    int free_buffer; /* head of the free list, -1 if empty */
+    bool stopping;
+};
+
+static int ring_setup(Ring *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(Ring));
+    ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        return errno;
+    }
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_map_size > ring->sq_map_size) {
+            ring->sq_map_size = ring->cq_map_size;
+        }
+        ring->cq_map_size = 0;
+    }
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                        IORING_OFF_SQ_RING);
+    ring->cq_map = ring->sq_map;
+    if (ring->sq_map != MAP_FAILED && ring->cq_map_size > 0) {
+        ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                            IORING_OFF_CQ_RING);
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                      IORING_OFF_SQES);
+    if (ring->sq_map == MAP_FAILED || ring->cq_map == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        int err = errno;
+        if (ring->sqes != MAP_FAILED) {
+            munmap(ring->sqes, ring->sqes_size);
+        }
+        if (ring->cq_map != MAP_FAILED && ring->cq_map != ring->sq_map) {
+            munmap(ring->cq_map, ring->cq_map_size);
+        }
+        if (ring->sq_map != MAP_FAILED) {
+            munmap(ring->sq_map, ring->sq_map_size);
+        }
+        close(ring->fd);
+        ring->fd = -1;
+        return err;
+    }
+    char *sq = ring->sq_map, *cq = ring->cq_map;
+    ring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) (sq + params.sq_off.array);
+    ring->cq_head = (unsigned *) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+    return 0;
+}
+
+static void ring_teardown(Ring *ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_map != ring->sq_map) {
+        munmap(ring->cq_map, ring->cq_map_size);
+    }
+    munmap(ring->sq_map, ring->sq_map_size);
+    close(ring->fd);
+}
+
+/* Queue a readv of the rest of buffer b's file. Only the submitting thread touches the submission ring. */
+static void ring_queue_read(Ring *ring, ReaderBuffer *buffer, int b) {
+    unsigned tail = *ring->sq_tail;
+    unsigned slot = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = ring->sqes + slot;
+    memset(sqe, 0, sizeof(*sqe));
+    buffer->iov.iov_base = buffer->data + buffer->done;
+    buffer->iov.iov_len = buffer->length - buffer->done;
+    // readv rather than read: it is supported by every kernel that has io_uring at all
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = buffer->fd;
+    sqe->addr = (uint64_t) (uintptr_t) &buffer->iov;
+    sqe->len = 1;
+    sqe->off = buffer->done;
+    sqe->user_data = (uint64_t) b;
+    buffer->submitted = true;
+    ring->sq_array[slot] = slot;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Mark names[index] read into buffer b, or failed with err */
+static void finish(Reader *reader, size_t index, int b, int err) {
+    pthread_mutex_lock(&reader->lock);
+    reader->entries[index].err = err;
+    reader->entries[index].buffer = b;
+    reader->entries[index].ready = true;
+    pthread_cond_broadcast(&reader->ready);
+    pthread_mutex_unlock(&reader->lock);
+}
+
+/* Take a free buffer and the next name to read into it. With block, waits for a consumer to release a buffer if none
+ * is free. Returns the buffer, or -1 if there is nothing left to read (*exhausted is set) or no buffer is free. */
+static int take(Reader *reader, bool block, bool *exhausted) {
+    int b = -1;
+    pthread_mutex_lock(&reader->lock);
+    while (true) {
+        // skipped again after every wait: other threads move next on meanwhile, maybe onto a NULL name
+        bool skipped = false;
+        while (reader->next < reader->count && reader->names[reader->next] == NULL) {
+            reader->entries[reader->next++].ready = true;
+            skipped = true;
+        }
+        if (skipped) {
+            pthread_cond_broadcast(&reader->ready);
+        }
+        if (reader->stopping || reader->next == reader->count || reader->free_buffer >= 0 || !block) {
+            break;
+        }
+        pthread_cond_wait(&reader->released, &reader->lock);
+    }
+    if (reader->stopping || reader->next == reader->count) {
+        *exhausted = true;
+    } else if (reader->free_buffer >= 0) {
+        b = reader->free_buffer;
+        reader->free_buffer = reader->buffers[b].next_free;
+        reader->buffers[b].index = reader->next++;
+    }
+    pthread_mutex_unlock(&reader->lock);
+    return b;
+}
+
+/* Open buffer b's file and size the buffer for it. Returns true if the contents are left to be read; otherwise the
+ * entry has been finished, with an error or by reading a non-regular file in full. */
+static bool prepare(Reader *reader, int b) {
+    ReaderBuffer *buffer = reader->buffers + b;
+    buffer->fd = open(reader->names[buffer->index], O_RDONLY | O_CLOEXEC);
+    if (buffer->fd < 0) {
+        finish(reader, buffer->index, b, errno);
+        return false;
+    }
+    struct stat st;
+    int err = 0;
+    if (fstat(buffer->fd, &st) != 0) {
+        err = errno;
+    } else if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+        // pipes and devices have no size to read up to
+        err = input_open_fd(&buffer->input, buffer->fd);
+    } else if ((size_t) st.st_size > buffer->capacity) {
+        char *grown = realloc(buffer->data, st.st_size);
+        if (grown == NULL) {
+            err = ENOMEM;
+        } else {
+            buffer->data = grown;
+            buffer->capacity = st.st_size;
+        }
+    }
+    if (err != 0 || buffer->input.data != NULL) {
+        close(buffer->fd);
+        finish(reader, buffer->index, b, err);
+        return false;
+    }
+    buffer->length = st.st_size;
+    buffer->done = 0;
+    return true;
+}
+
+/* One of the threads behind READER_THREADS: reads one file at a time with blocking preads */
+static void *pread_thread(void *arg) {
+    Reader *reader = arg;
+    bool exhausted = false;
+    while (true) {
+        int b = take(reader, true, &exhausted);
+        if (b < 0) {
+            break;
+        }
+        if (!prepare(reader, b)) {
+            continue;
+        }
+        ReaderBuffer *buffer = reader->buffers + b;
+        int err = 0;
+        while (buffer->done < buffer->length) {
+            ssize_t n = pread(buffer->fd, buffer->data + buffer->done, buffer->length - buffer->done,
+                              (off_t) buffer->done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                err = n < 0 ? errno : 0;
+                break;
+            }
+            buffer->done += n;
+        }
+        close(buffer->fd);
+        buffer->length = buffer->done;
+        finish(reader, buffer->index, b, err);
+    }
+    return NULL;
+}
+
+/* The thread behind READER_URING: keeps up to depth reads submitted and publishes them as they complete. Should the
+ * ring fail, the reads on it are finished with the error and the rest of the names are read as pread_thread() does. */
+static void *uring_thread(void *arg) {
+    Reader *reader = arg;
+    Ring *ring = &reader->ring;
+    unsigned inflight = 0, queued = 0;
+    bool exhausted = false;
+    while (true) {
+        while (!exhausted && inflight + queued < reader->depth) {
+            int b = take(reader, inflight + queued == 0, &exhausted);
+            if (b < 0) {
+                break;
+            }
+            if (prepare(reader, b)) {
+                ring_queue_read(ring, reader->buffers + b, b);
+                queued++;
+            }
+        }
+        if (inflight + queued == 0) {
+            if (exhausted) {
+                break;
+            }
+            continue;
+        }
+        long n = syscall(__NR_io_uring_enter, ring->fd, queued, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (n < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            // the ring is unusable; nothing on it can be completed any more
+            int err = errno;
+            unsigned b;
+            for (b = 0; b < reader->buffers_count; b++) {
+                ReaderBuffer *buffer = reader->buffers + b;
+                if (buffer->submitted) {
+                    buffer->submitted = false;
+                    close(buffer->fd);
+                    finish(reader, buffer->index, (int) b, err);
+                }
+            }
+            return pread_thread(reader);
+        }
+        if (n > 0) {
+            inflight += n;
+            queued -= n;
+        }
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = ring->cqes + (head & *ring->cq_mask);
+            int b = (int) cqe->user_data;
+            ReaderBuffer *buffer = reader->buffers + b;
+            buffer->submitted = false;
+            inflight--;
+            if (cqe->res > 0) {
+                buffer->done += cqe->res;
+                if (buffer->done < buffer->length) {
+                    ring_queue_read(ring, buffer, b);
+                    queued++;
+                    continue;
+                }
+            }
+            close(buffer->fd);
+            // a file that shrank while being read is reported on as far as it got
+            buffer->length = buffer->done;
+            finish(reader, buffer->index, b, cqe->res < 0 ? -cqe->res : 0);
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+static void free_reader(Reader *reader) {
+    unsigned i;
+    if (reader->buffers != NULL) {
+        for (i = 0; i < reader->buffers_count; i++) {
+            free(reader->buffers[i].data);
+            input_close(&reader->buffers[i].input);
+        }
+    }
+    free(reader->buffers);
+    free(reader->entries);
+    free(reader->threads);
+    pthread_mutex_destroy(&reader->lock);
+    pthread_cond_destroy(&reader->ready);
+    pthread_cond_destroy(&reader->released);
+    free(reader);
+}
+
+int reader_start(Reader **out, char *const *names, size_t count, ReaderBackend backend, unsigned depth,
+                 unsigned buffers) {
+    Reader *reader = calloc(1, sizeof(Reader));
+    if (reader == NULL) {
+        return ENOMEM;
+    }
+    reader->names = names;
+    reader->count = count;
+    reader->depth = depth > 0 ? depth : READER_DEFAULT_DEPTH;
+    // every read in flight needs a buffer of its own, on top of those consumers hold
+    reader->buffers_count = buffers > reader->depth ? buffers : reader->depth + 1;
+    reader->buffers = calloc(reader->buffers_count, sizeof(ReaderBuffer));
+    reader->entries = calloc(count > 0 ? count : 1, sizeof(ReaderEntry));
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->ready, NULL);
+    pthread_cond_init(&reader->released, NULL);
+    if (reader->buffers == NULL || reader->entries == NULL) {
+        free_reader(reader);
+        return ENOMEM;
+    }
+    unsigned i;
+    for (i = 0; i < reader->buffers_count; i++) {
+        reader->buffers[i].next_free = (int) i + 1 < (int) reader->buffers_count ? (int) i + 1 : -1;
+    }
+    size_t e;
+    for (e = 0; e < count; e++) {
+        reader->entries[e].buffer = -1;
+    }
+
+    reader->backend = READER_THREADS;
+    if (backend != READER_THREADS) {
+        int err = ring_setup(&reader->ring, reader->depth);
+        if (err == 0) {
+            reader->backend = READER_URING;
+        } else if (backend == READER_URING) {
+            free_reader(reader);
+            return ENOSYS;
+        }
+    }
+    reader->threads_count = reader->backend == READER_URING ? 1 : reader->depth;
+    reader->threads = calloc(reader->threads_count, sizeof(pthread_t));
+    if (reader->threads == NULL) {
+        if (reader->backend == READER_URING) {
+            ring_teardown(&reader->ring);
+        }
+        free_reader(reader);
+        return ENOMEM;
+    }
+    unsigned started;
+    int err = 0;
+    for (started = 0; started < reader->threads_count; started++) {
+        err = pthread_create(reader->threads + started, NULL,
+                             reader->backend == READER_URING ? uring_thread : pread_thread, reader);
+        if (err != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        if (reader->backend == READER_URING) {
+            ring_teardown(&reader->ring);
+        }
+        free_reader(reader);
+        return err;
+    }
+    reader->threads_count = started;
+    *out = reader;
+    return 0;
+}
+
+ReaderBackend reader_backend(const Reader *reader) {
+    return reader->backend;
+}
+
+int reader_wait(Reader *reader, size_t index, Bytecode *bytecode) {
+    pthread_mutex_lock(&reader->lock);
+    while (!reader->entries[index].ready) {
+        pthread_cond_wait(&reader->ready, &reader->lock);
+    }
+    ReaderEntry entry = reader->entries[index];
+    pthread_mutex_unlock(&reader->lock);
+    bytecode->data = NULL;
+    bytecode->length = 0;
+    bytecode->index = 0;
+    if (entry.err == 0 && entry.buffer >= 0) {
+        ReaderBuffer *buffer = reader->buffers + entry.buffer;
+        if (buffer->input.data != NULL) {
+            input_bytecode(&buffer->input, bytecode);
+        } else {
+            bytecode->data = buffer->data;
+            bytecode->length = (long) buffer->length;
+        }
+    }
+    return entry.err;
+}
+
+void reader_release(Reader *reader, size_t index) {
+    pthread_mutex_lock(&reader->lock);
+    int b = reader->entries[index].buffer;
+    if (b >= 0) {
+        reader->entries[index].buffer = -1;
+        input_close(&reader->buffers[b].input);
+        reader->buffers[b].next_free = reader->free_buffer;
+        reader->free_buffer = b;
+        pthread_cond_signal(&reader->released);
+    }
+    pthread_mutex_unlock(&reader->lock);
+}
+
+void reader_stop(Reader *reader) {
+    pthread_mutex_lock(&reader->lock);
+    reader->stopping = true;
+    pthread_cond_broadcast(&reader->released);
+    pthread_mutex_unlock(&reader->lock);
+    unsigned i;
+    for (i = 0; i < reader->threads_count; i++) {
+        pthread_join(reader->threads[i], NULL);
+    }
+    if (reader->backend == READER_URING) {
+        ring_teardown(&reader->ring);
+    }
+    free_reader(reader);
+}
@@ -0,0 +1,42 @@
+#ifndef READER_H
+#define READER_H
+
+#include "class.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Reads kept in flight when no depth is given */
+#define READER_DEFAULT_DEPTH 32
+
+/* How a Reader issues its reads */
+typedef enum {
+    READER_AUTO,    /* io_uring if the kernel allows it, otherwise threads */
+    READER_URING,   /* one thread submitting to an io_uring */
+    READER_THREADS  /* depth threads each blocking in pread */
+} ReaderBackend;
+
+/* Reads a list of files ahead of their consumers, into buffers recycled from a fixed pool */
+typedef struct Reader Reader;
+
+/* Start reading names[0..count) in order, keeping up to depth reads in flight and buffers files read but not yet
+ * released. NULL names are skipped. names must outlive the reader. Returns 0 and sets *reader on success, otherwise an
+ * errno value; ENOSYS if READER_URING was asked for and the kernel refused it. */
+int reader_start(Reader **reader, char *const *names, size_t count, ReaderBackend backend, unsigned depth,
+                 unsigned buffers);
+
+/* The backend the reader ended up using */
+ReaderBackend reader_backend(const Reader *reader);
+
+/* Block until names[index] has been read and point bytecode at its contents. Returns 0 on success, otherwise the errno
+ * value the file failed with. Either way reader_release() must be called for index. */
+int reader_wait(Reader *reader, size_t index, Bytecode *bytecode);
+
+/* Hand the buffer holding names[index] back to the pool. Any Bytecode viewing it becomes invalid. */
+void reader_release(Reader *reader, size_t index);
+
+/* Finish or cancel outstanding reads, join the reader's threads and free it */
+void reader_stop(Reader *reader);
+
+#endif //READER_H
@@ -0,0 +1,326 @@
+#include "stats.h"
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Hardware events counted per phase, in the order of their group */
+enum {
+    HW_CYCLES,
+    HW_INSTRUCTIONS,
+    HW_CACHE_MISSES,
+    HW_BRANCH_MISSES,
+    HW_EVENTS
+};
+
+static const char *PHASE_NAMES[STATS_PHASES] = {
+        "other", "io", "inflate", "constant_pool", "members", "attributes", "print", "write"
+};
+
+static const char *COUNTER_NAMES[STATS_COUNTERS] = {
+        "classes", "class_bytes", "arena_bytes", "arena_blocks", "output_bytes"
+};
+
+static const char *HW_NAMES[HW_EVENTS] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+
+#ifdef CFR_STATS
+
+static const uint64_t HW_CONFIGS[HW_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+
+/* What one thread has gathered. Only its own thread writes to it; the report reads it once the thread has stopped. */
+typedef struct StatsThread {
+    struct StatsThread *next;
+    StatsPhase phase;
+    uint64_t since; /* when phase was entered, in ns */
+    int fd; /* leader of the thread's perf event group, -1 without counters */
+    uint64_t hw_since[HW_EVENTS]; /* counter values when phase was entered */
+    uint64_t ns[STATS_PHASES];
+    uint64_t hw[STATS_PHASES][HW_EVENTS];
+    uint64_t counters[STATS_COUNTERS];
+} StatsThread;
+
+bool stats_enabled;
+static bool use_counters;
+static int counters_err; /* why the kernel refused the counters, 0 if it did not */
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static StatsThread *threads;
+static __thread StatsThread *local;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int perf_event_open(struct perf_event_attr *attr, int group) {
+    return (int) syscall(SYS_perf_event_open, attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+/* Open the calling thread's counters as one group, so a single read returns all of them. Returns the leader or -1. */
+static int open_counters(void) {
+    int fds[HW_EVENTS];
+    int e;
+    for (e = 0; e < HW_EVENTS; e++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = HW_CONFIGS[e];
+        attr.read_format = PERF_FORMAT_GROUP;
+        // user space only, which an unprivileged process may count on itself
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fds[e] = perf_event_open(&attr, e == 0 ? -1 : fds[0]);
+        if (fds[e] < 0) {
+            __atomic_store_n(&counters_err, errno, __ATOMIC_RELAXED);
+            while (e-- > 0) {
+                close(fds[e]);
+            }
+            return -1;
+        }
+    }
+    return fds[0];
+}
+
+static void read_counters(int fd, uint64_t *values) {
+    struct {
+        uint64_t nr;
+        uint64_t values[HW_EVENTS];
+    } group;
+    if (read(fd, &group, sizeof(group)) == (ssize_t) sizeof(group)) {
+        memcpy(values, group.values, sizeof(group.values));
+    }
+}
+
+/* The calling thread's record, registered on first use */
+static StatsThread *thread_stats(void) {
+    if (local != NULL) {
+        return local;
+    }
+    StatsThread *t = calloc(1, sizeof(StatsThread));
+    if (t == NULL) {
+        return NULL;
+    }
+    t->phase = STATS_OTHER;
+    t->fd = use_counters ? open_counters() : -1;
+    if (t->fd >= 0) {
+        read_counters(t->fd, t->hw_since);
+    }
+    t->since = now_ns();
+    pthread_mutex_lock(&threads_lock);
+    t->next = threads;
+    threads = t;
+    pthread_mutex_unlock(&threads_lock);
+    local = t;
+    return t;
+}
+
+StatsPhase stats_switch(StatsPhase phase) {
+    StatsThread *t = thread_stats();
+    if (t == NULL) {
+        return phase;
+    }
+    uint64_t now = now_ns();
+    t->ns[t->phase] += now - t->since;
+    t->since = now;
+    if (t->fd >= 0) {
+        uint64_t values[HW_EVENTS];
+        memcpy(values, t->hw_since, sizeof(values));
+        read_counters(t->fd, values);
+        int e;
+        for (e = 0; e < HW_EVENTS; e++) {
+            t->hw[t->phase][e] += values[e] - t->hw_since[e];
+            t->hw_since[e] = values[e];
+        }
+    }
+    StatsPhase previous = t->phase;
+    t->phase = phase;
+    return previous;
+}
+
+void stats_count(StatsCounter counter, uint64_t n) {
+    StatsThread *t = thread_stats();
+    if (t != NULL) {
+        t->counters[counter] += n;
+    }
+}
+
+int stats_start(bool counters) {
+    use_counters = counters;
+    stats_enabled = true;
+    return 0;
+}
+
+void stats_stop(void) {
+    stats_enabled = false;
+    pthread_mutex_lock(&threads_lock);
+    while (threads != NULL) {
+        StatsThread *t = threads;
+        threads = t->next;
+        if (t->fd >= 0) {
+            close(t->fd);
+        }
+        free(t);
+    }
+    pthread_mutex_unlock(&threads_lock);
+    local = NULL;
+}
+
+#else
+
+/* Stand-ins for a build without CFR_STATS, so --stats can say why it does nothing */
+typedef struct StatsThread {
+    struct StatsThread *next;
+    uint64_t ns[STATS_PHASES];
+    uint64_t hw[STATS_PHASES][HW_EVENTS];
+    uint64_t counters[STATS_COUNTERS];
+} StatsThread;
+
+static bool use_counters;
+static int counters_err;
+static StatsThread *threads;
+
+int stats_start(bool counters) {
+    (void) counters;
+    return ENOTSUP;
+}
+
+void stats_stop(void) {
+}
+
+#endif
+
+/* Right-align text in width columns */
+static void output_column(Output *out, const char *text, int width) {
+    int pad = width - (int) strlen(text);
+    while (pad-- > 0) {
+        output_char(out, ' ');
+    }
+    output_str(out, text);
+}
+
+static void output_column_uint(Output *out, uint64_t value, int width) {
+    char text[24];
+    snprintf(text, sizeof(text), "%llu", (unsigned long long) value);
+    output_column(out, text, width);
+}
+
+static void output_column_fixed(Output *out, double value, int decimals, const char *unit, int width) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.*f%s", decimals, value, unit);
+    output_column(out, text, width);
+}
+
+void stats_report(Output *out, bool json) {
+#ifdef CFR_STATS
+    if (local != NULL) {
+        // charge the caller's current phase up to now
+        stats_switch(local->phase);
+    }
+#endif
+    StatsThread sum;
+    memset(&sum, 0, sizeof(sum));
+    unsigned thread_count = 0;
+    int p, e;
+    const StatsThread *t;
+    for (t = threads; t != NULL; t = t->next) {
+        for (p = 0; p < STATS_PHASES; p++) {
+            sum.ns[p] += t->ns[p];
+            for (e = 0; e < HW_EVENTS; e++) {
+                sum.hw[p][e] += t->hw[p][e];
+            }
+        }
+        for (p = 0; p < STATS_COUNTERS; p++) {
+            sum.counters[p] += t->counters[p];
+        }
+        thread_count++;
+    }
+    uint64_t total = 0;
+    for (p = 0; p < STATS_PHASES; p++) {
+        total += sum.ns[p];
+    }
+    bool hw = use_counters && counters_err == 0;
+
+    if (json) {
+        output_str(out, "{\"threads\": ");
+        output_uint(out, thread_count);
+        output_str(out, ", \"phases\": {");
+        for (p = 0; p < STATS_PHASES; p++) {
+            output_str(out, p > 0 ? ", \"" : "\"");
+            output_str(out, PHASE_NAMES[p]);
+            output_str(out, "\": {\"ns\": ");
+            output_uint(out, sum.ns[p]);
+            for (e = 0; hw && e < HW_EVENTS; e++) {
+                output_str(out, ", \"");
+                output_str(out, HW_NAMES[e]);
+                output_str(out, "\": ");
+                output_uint(out, sum.hw[p][e]);
+            }
+            output_char(out, '}');
+        }
+        output_str(out, "}, \"counters\": {");
+        for (p = 0; p < STATS_COUNTERS; p++) {
+            output_str(out, p > 0 ? ", \"" : "\"");
+            output_str(out, COUNTER_NAMES[p]);
+            output_str(out, "\": ");
+            output_uint(out, sum.counters[p]);
+        }
+        output_char(out, '}');
+        if (use_counters && !hw) {
+            output_str(out, ", \"hardware_counters_error\": \"");
+            output_str(out, strerror(counters_err));
+            output_char(out, '"');
+        }
+        output_str(out, "}\n");
+        return;
+    }
+
+    output_str(out, "phase            time ms   share");
+    if (hw) {
+        output_str(out, "         cycles   instructions    IPC   cache misses  branch misses");
+    }
+    output_char(out, '\n');
+    for (p = 0; p < STATS_PHASES; p++) {
+        output_str(out, PHASE_NAMES[p]);
+        output_column_fixed(out, sum.ns[p] / 1e6, 3, "", 27 - (int) strlen(PHASE_NAMES[p]));
+        output_column_fixed(out, total > 0 ? 100.0 * sum.ns[p] / total : 0, 1, "%", 8);
+        if (hw) {
+            output_column_uint(out, sum.hw[p][HW_CYCLES], 15);
+            output_column_uint(out, sum.hw[p][HW_INSTRUCTIONS], 15);
+            double cycles = (double) sum.hw[p][HW_CYCLES];
+            output_column_fixed(out, cycles > 0 ? sum.hw[p][HW_INSTRUCTIONS] / cycles : 0, 2, "", 7);
+            output_column_uint(out, sum.hw[p][HW_CACHE_MISSES], 15);
+            output_column_uint(out, sum.hw[p][HW_BRANCH_MISSES], 15);
+        }
+        output_char(out, '\n');
+    }
+    output_str(out, "total");
+    output_column_fixed(out, total / 1e6, 3, "", 22);
+    output_str(out, " over ");
+    output_uint(out, thread_count);
+    output_str(out, thread_count == 1 ? " thread\n" : " threads\n");
+    for (p = 0; p < STATS_COUNTERS; p++) {
+        output_str(out, COUNTER_NAMES[p]);
+        output_column_uint(out, sum.counters[p], 27 - (int) strlen(COUNTER_NAMES[p]));
+        output_char(out, '\n');
+    }
+    if (sum.counters[STATS_CLASSES] > 0) {
+        output_str(out, "arena bytes/class");
+        output_column_fixed(out, (double) sum.counters[STATS_ARENA_BYTES] / sum.counters[STATS_CLASSES], 1, "", 10);
+        output_char(out, '\n');
+    }
+    if (use_counters && !hw) {
+        output_str(out, "Hardware counters unavailable: ");
+        output_str(out, strerror(counters_err));
+        output_char(out, '\n');
+    }
+}
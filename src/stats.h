@@ -0,0 +1,74 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "output.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Phases of a run that time is charged to. Each thread is always in exactly one, so they add up to its whole life. */
+typedef enum {
+    STATS_OTHER,      /* none of the below: set-up, waiting on other threads */
+    STATS_IO,         /* opening, mapping and reading plain files */
+    STATS_INFLATE,    /* finding and inflating archive entries */
+    STATS_CONST_POOL, /* header and parse_const_pool() */
+    STATS_MEMBERS,    /* the class, field and method tables, less their attributes */
+    STATS_ATTRIBUTES, /* parse_attribute() */
+    STATS_PRINT,      /* formatting reports as text, JSON or export rows */
+    STATS_WRITE,      /* writing reports out */
+    STATS_PHASES
+} StatsPhase;
+
+/* Totals kept alongside the phases */
+typedef enum {
+    STATS_CLASSES,      /* class files parsed */
+    STATS_CLASS_BYTES,  /* bytes of those class files */
+    STATS_ARENA_BYTES,  /* arena bytes handed out while parsing */
+    STATS_ARENA_BLOCKS, /* blocks arenas requested from malloc */
+    STATS_OUTPUT_BYTES, /* bytes written out */
+    STATS_COUNTERS
+} StatsCounter;
+
+/* Build with CFR_STATS defined to instrument a run. Otherwise every STATS_ macro expands to nothing. */
+#ifdef CFR_STATS
+
+/* Set by stats_start(); while false the instrumentation costs one predictable branch per phase */
+extern bool stats_enabled;
+
+/* Charge the time since the last switch to the thread's current phase and make phase current. Returns the phase that
+ * was current. Only called while stats_enabled. */
+StatsPhase stats_switch(StatsPhase phase);
+
+/* Add n to counter for the calling thread. Only called while stats_enabled. */
+void stats_count(StatsCounter counter, uint64_t n);
+
+/* Enter phase until the matching STATS_LEAVE() in the same block */
+#define STATS_ENTER(phase) StatsPhase stats_previous_ = stats_enabled ? stats_switch(phase) : STATS_OTHER
+#define STATS_LEAVE() do { if (stats_enabled) stats_switch(stats_previous_); } while (0)
+/* Move from the phase of the enclosing STATS_ENTER() to another, still left by its STATS_LEAVE() */
+#define STATS_SWITCH(phase) do { if (stats_enabled) stats_switch(phase); } while (0)
+#define STATS_ADD(counter, n) do { if (stats_enabled) stats_count(counter, n); } while (0)
+
+#else
+
+#define STATS_ENTER(phase) do { } while (0)
+#define STATS_LEAVE() do { } while (0)
+#define STATS_SWITCH(phase) do { } while (0)
+#define STATS_ADD(counter, n) do { (void) sizeof(n); } while (0)
+
+#endif
+
+/* Start gathering, on every thread that reaches a phase from now on. With counters, each thread also counts cycles,
+ * instructions, cache misses and branch misses through perf_event_open; these are left out, with a note in the
+ * report, if the kernel refuses them. Returns 0 on success, ENOTSUP if built without CFR_STATS. */
+int stats_start(bool counters);
+
+/* Write the totals of every thread so far to out, as a table or as one JSON object. Threads other than the caller
+ * must have stopped. */
+void stats_report(Output *out, bool json);
+
+/* Close the counters of every thread and forget them */
+void stats_stop(void);
+
+#endif //STATS_H
@@ -0,0 +1,160 @@
+#include "swap.h"
+#include "cursor.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    !(defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define SWAP_X86 1
+#include <immintrin.h>
+#endif
+
+/* The kernel in use, SWAP_BEST until the first call resolves it. Every thread resolves it the same way, so a race
+ * to store it is harmless. */
+static SwapKernel active = SWAP_BEST;
+
+static void swap_u2_scalar(uint16_t *dst, const uint8_t *src, size_t count) {
+    size_t i;
+    for (i = 0; i < count; i++) {
+        dst[i] = load_u2(src + 2 * i);
+    }
+}
+
+static void swap_u4_scalar(uint32_t *dst, const uint8_t *src, size_t count) {
+    size_t i;
+    for (i = 0; i < count; i++) {
+        dst[i] = load_u4(src + 4 * i);
+    }
+}
+
+#ifdef SWAP_X86
+
+/* pshufb reorders the bytes within each 16-byte lane; these masks reverse every u2 or u4 */
+#define U2_MASK 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14
+#define U4_MASK 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+
+__attribute__((target("ssse3")))
+static void swap_u2_ssse3(uint16_t *dst, const uint8_t *src, size_t count) {
+    const __m128i mask = _mm_setr_epi8(U2_MASK);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + 2 * i));
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_shuffle_epi8(v, mask));
+    }
+    swap_u2_scalar(dst + i, src + 2 * i, count - i);
+}
+
+__attribute__((target("ssse3")))
+static void swap_u4_ssse3(uint32_t *dst, const uint8_t *src, size_t count) {
+    const __m128i mask = _mm_setr_epi8(U4_MASK);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + 4 * i));
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_shuffle_epi8(v, mask));
+    }
+    swap_u4_scalar(dst + i, src + 4 * i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void swap_u2_avx2(uint16_t *dst, const uint8_t *src, size_t count) {
+    const __m256i mask = _mm256_setr_epi8(U2_MASK, U2_MASK);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (src + 2 * i));
+        _mm256_storeu_si256((__m256i *) (dst + i), _mm256_shuffle_epi8(v, mask));
+    }
+    // the scalar tail may be vectorised with legacy SSE, which stalls on dirty upper halves
+    _mm256_zeroupper();
+    swap_u2_scalar(dst + i, src + 2 * i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void swap_u4_avx2(uint32_t *dst, const uint8_t *src, size_t count) {
+    const __m256i mask = _mm256_setr_epi8(U4_MASK, U4_MASK);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (src + 4 * i));
+        _mm256_storeu_si256((__m256i *) (dst + i), _mm256_shuffle_epi8(v, mask));
+    }
+    // the scalar tail may be vectorised with legacy SSE, which stalls on dirty upper halves
+    _mm256_zeroupper();
+    swap_u4_scalar(dst + i, src + 4 * i, count - i);
+}
+
+#endif
+
+/* The fastest kernel no faster than wanted that the CPU supports */
+static SwapKernel supported(SwapKernel wanted) {
+#ifdef SWAP_X86
+    __builtin_cpu_init();
+    if (wanted >= SWAP_AVX2 && __builtin_cpu_supports("avx2")) {
+        return SWAP_AVX2;
+    }
+    if (wanted >= SWAP_SSSE3 && __builtin_cpu_supports("ssse3")) {
+        return SWAP_SSSE3;
+    }
+#else
+    (void) wanted;
+#endif
+    return SWAP_SCALAR;
+}
+
+static SwapKernel kernel(void) {
+    SwapKernel k = __atomic_load_n(&active, __ATOMIC_RELAXED);
+    if (k == SWAP_BEST) {
+        k = supported(SWAP_BEST);
+        __atomic_store_n(&active, k, __ATOMIC_RELAXED);
+    }
+    return k;
+}
+
+void swap_u2(uint16_t *dst, const void *src, size_t count) {
+    switch (kernel()) {
+#ifdef SWAP_X86
+        case SWAP_AVX2:
+            swap_u2_avx2(dst, src, count);
+            break;
+        case SWAP_SSSE3:
+            swap_u2_ssse3(dst, src, count);
+            break;
+#endif
+        default:
+            swap_u2_scalar(dst, src, count);
+            break;
+    }
+}
+
+void swap_u4(uint32_t *dst, const void *src, size_t count) {
+    switch (kernel()) {
+#ifdef SWAP_X86
+        case SWAP_AVX2:
+            swap_u4_avx2(dst, src, count);
+            break;
+        case SWAP_SSSE3:
+            swap_u4_ssse3(dst, src, count);
+            break;
+#endif
+        default:
+            swap_u4_scalar(dst, src, count);
+            break;
+    }
+}
+
+SwapKernel swap_use(SwapKernel wanted) {
+    SwapKernel k = supported(wanted);
+    __atomic_store_n(&active, k, __ATOMIC_RELAXED);
+    return k;
+}
+
+const char *swap_kernel_name(SwapKernel k) {
+    switch (k) {
+        case SWAP_SCALAR:
+            return "scalar";
+        case SWAP_SSSE3:
+            return "ssse3";
+        case SWAP_AVX2:
+            return "avx2";
+        default:
+            return swap_kernel_name(kernel());
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef SWAP_H
+#define SWAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Bulk decoding of big-endian u2 and u4 tables into host order, a vector at a time where the CPU allows */
+
+/* The implementations to choose from, slowest first */
+typedef enum {
+    SWAP_SCALAR,
+    SWAP_SSSE3, /* 16 bytes a step with pshufb */
+    SWAP_AVX2, /* 32 bytes a step */
+    SWAP_BEST /* the fastest the running CPU supports; the default */
+} SwapKernel;
+
+/* Decode count big-endian u2 values at src, which need not be aligned, into dst. dst may be src itself to decode in
+ * place, but may not otherwise overlap it. */
+void swap_u2(uint16_t *dst, const void *src, size_t count);
+
+/* Decode count big-endian u4 values at src, which need not be aligned, into dst. dst may be src itself to decode in
+ * place, but may not otherwise overlap it. */
+void swap_u4(uint32_t *dst, const void *src, size_t count);
+
+/* Use kernel from now on, or the fastest below it that the CPU supports. Returns the kernel in use. Meant for tests
+ * and benchmarks: the choice is process-wide and every thread sees it. */
+SwapKernel swap_use(SwapKernel kernel);
+
+/* "scalar", "ssse3" or "avx2" */
+const char *swap_kernel_name(SwapKernel kernel);
+
+#endif //SWAP_H
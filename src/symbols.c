@@ -0,0 +1,186 @@
+#include "symbols.h"
+#include "arena.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The table is split into this many stripes by the low bits of the hash, so threads interning different strings
+ * rarely wait on one another. An id keeps the stripe in its low bits. */
+#define SYMBOL_STRIPE_BITS 6
+#define SYMBOL_STRIPES (1u << SYMBOL_STRIPE_BITS)
+
+/* A stripe finds its strings by index through pages of this many, which never move once allocated */
+#define SYMBOL_PAGE_BITS 12
+#define SYMBOL_PAGE (1u << SYMBOL_PAGE_BITS)
+
+/* Pages per stripe, bounding a stripe at SYMBOL_PAGES * SYMBOL_PAGE strings */
+#define SYMBOL_PAGES 1024
+
+/* Slots each stripe starts with */
+#define SYMBOL_SLOTS 64
+
+typedef struct {
+    uint32_t hash;
+    uint16_t length;
+    char value[]; /* length bytes and a NUL */
+} Symbol;
+
+typedef struct {
+    pthread_mutex_t lock; /* guards everything below; pages may also be read without it */
+    Arena arena; /* the Symbols */
+    uint32_t *slots; /* open addressing: a Symbol's index + 1, or 0 for an empty slot */
+    uint32_t slots_count; /* a power of two */
+    uint32_t count;
+    Symbol **pages[SYMBOL_PAGES];
+} Stripe;
+
+struct SymbolTable {
+    Stripe stripes[SYMBOL_STRIPES];
+};
+
+static void free_stripes(SymbolTable *table, unsigned count) {
+    unsigned s, p;
+    for (s = 0; s < count; s++) {
+        Stripe *stripe = &table->stripes[s];
+        for (p = 0; p < SYMBOL_PAGES && stripe->pages[p] != NULL; p++) {
+            free(stripe->pages[p]);
+        }
+        free(stripe->slots);
+        arena_destroy(&stripe->arena);
+        pthread_mutex_destroy(&stripe->lock);
+    }
+    free(table);
+}
+
+SymbolTable *symbols_create(void) {
+    SymbolTable *table = calloc(1, sizeof(SymbolTable));
+    if (table == NULL) {
+        return NULL;
+    }
+    unsigned s;
+    for (s = 0; s < SYMBOL_STRIPES; s++) {
+        Stripe *stripe = &table->stripes[s];
+        pthread_mutex_init(&stripe->lock, NULL);
+        stripe->slots_count = SYMBOL_SLOTS;
+        stripe->slots = calloc(stripe->slots_count, sizeof(uint32_t));
+        if (!arena_init(&stripe->arena, ARENA_MIN_BLOCK) || stripe->slots == NULL) {
+            free_stripes(table, s + 1);
+            return NULL;
+        }
+    }
+    return table;
+}
+
+void symbols_free(SymbolTable *table) {
+    if (table != NULL) {
+        free_stripes(table, SYMBOL_STRIPES);
+    }
+}
+
+uint32_t symbols_hash(const char *data, size_t length) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    size_t i;
+    for (i = 0; i < length; i++) {
+        h = (h ^ (uint8_t) data[i]) * 16777619u;
+    }
+    return h;
+}
+
+static Symbol *symbol_at(const Stripe *stripe, uint32_t index) {
+    Symbol **page = __atomic_load_n(&stripe->pages[index >> SYMBOL_PAGE_BITS], __ATOMIC_ACQUIRE);
+    return page[index & (SYMBOL_PAGE - 1)];
+}
+
+/* Double the stripe's slots and reinsert every index */
+static bool rehash(Stripe *stripe) {
+    uint32_t count = stripe->slots_count * 2;
+    uint32_t *slots = calloc(count, sizeof(uint32_t));
+    if (slots == NULL) {
+        return false;
+    }
+    uint32_t index;
+    for (index = 0; index < stripe->count; index++) {
+        uint32_t s = (symbol_at(stripe, index)->hash >> SYMBOL_STRIPE_BITS) & (count - 1);
+        while (slots[s] != 0) {
+            s = (s + 1) & (count - 1);
+        }
+        slots[s] = index + 1;
+    }
+    free(stripe->slots);
+    stripe->slots = slots;
+    stripe->slots_count = count;
+    return true;
+}
+
+/* The stripe's index of the string, adding it if it is new, or SYMBOL_NONE if there is no room for it */
+static uint32_t intern(Stripe *stripe, const char *data, uint16_t length, uint32_t hash) {
+    // keep the slots at most half full
+    if ((stripe->count + 1) * 2 > stripe->slots_count && !rehash(stripe)) {
+        return SYMBOL_NONE;
+    }
+    uint32_t mask = stripe->slots_count - 1;
+    uint32_t s = (hash >> SYMBOL_STRIPE_BITS) & mask;
+    while (stripe->slots[s] != 0) {
+        Symbol *symbol = symbol_at(stripe, stripe->slots[s] - 1);
+        if (symbol->hash == hash && symbol->length == length && memcmp(symbol->value, data, length) == 0) {
+            return stripe->slots[s] - 1;
+        }
+        s = (s + 1) & mask;
+    }
+    uint32_t index = stripe->count;
+    if (index == SYMBOL_PAGES * SYMBOL_PAGE) {
+        return SYMBOL_NONE;
+    }
+    Symbol **page = stripe->pages[index >> SYMBOL_PAGE_BITS];
+    if (page == NULL) {
+        page = malloc(SYMBOL_PAGE * sizeof(Symbol *));
+        if (page == NULL) {
+            return SYMBOL_NONE;
+        }
+        __atomic_store_n(&stripe->pages[index >> SYMBOL_PAGE_BITS], page, __ATOMIC_RELEASE);
+    }
+    Symbol *symbol = arena_alloc(&stripe->arena, sizeof(Symbol) + length + 1);
+    if (symbol == NULL) {
+        return SYMBOL_NONE;
+    }
+    symbol->hash = hash;
+    symbol->length = length;
+    memcpy(symbol->value, data, length);
+    symbol->value[length] = '\0';
+    page[index & (SYMBOL_PAGE - 1)] = symbol;
+    stripe->slots[s] = index + 1;
+    stripe->count++;
+    return index;
+}
+
+uint32_t symbols_intern(SymbolTable *table, const char *data, uint16_t length, uint32_t hash) {
+    uint32_t s = hash & (SYMBOL_STRIPES - 1);
+    Stripe *stripe = &table->stripes[s];
+    pthread_mutex_lock(&stripe->lock);
+    uint32_t index = intern(stripe, data, length, hash);
+    pthread_mutex_unlock(&stripe->lock);
+    return index != SYMBOL_NONE ? (index << SYMBOL_STRIPE_BITS) | s : SYMBOL_NONE;
+}
+
+const char *symbols_string(const SymbolTable *table, uint32_t id, uint16_t *length, uint32_t *hash) {
+    const Symbol *symbol = symbol_at(&table->stripes[id & (SYMBOL_STRIPES - 1)], id >> SYMBOL_STRIPE_BITS);
+    *length = symbol->length;
+    *hash = symbol->hash;
+    return symbol->value;
+}
+
+void symbols_usage(SymbolTable *table, uint32_t *count, size_t *bytes) {
+    *count = 0;
+    *bytes = 0;
+    unsigned s;
+    for (s = 0; s < SYMBOL_STRIPES; s++) {
+        Stripe *stripe = &table->stripes[s];
+        pthread_mutex_lock(&stripe->lock);
+        *count += stripe->count;
+        *bytes += stripe->arena.allocated;
+        pthread_mutex_unlock(&stripe->lock);
+    }
+}
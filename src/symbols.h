@@ -0,0 +1,35 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A table of strings shared by every class parsed with it (ParseOptions.symbols). Each distinct string is stored once
+ * and numbered, so strings from different classes are equal exactly when their ids are. Any number of threads may
+ * intern and look up at once: the table is split into stripes by hash, each behind its own lock, and lookups by id
+ * take no lock at all. Strings stay until the table is freed. */
+typedef struct SymbolTable SymbolTable;
+
+/* Returned by symbols_intern() when memory ran out, and the symbol of strings from classes parsed without a table */
+#define SYMBOL_NONE UINT32_MAX
+
+/* Returns NULL if memory ran out */
+SymbolTable *symbols_create(void);
+
+/* Free the table and every string in it. Classes parsed with it must not be used afterwards. */
+void symbols_free(SymbolTable *table);
+
+/* The hash symbols_intern() expects for the length bytes at data */
+uint32_t symbols_hash(const char *data, size_t length);
+
+/* Return the id of the length bytes at data, whose symbols_hash() is hash, adding them if they are new */
+uint32_t symbols_intern(SymbolTable *table, const char *data, uint16_t length, uint32_t hash);
+
+/* The NUL-terminated string numbered id, setting *length and *hash. The id must have come from symbols_intern(),
+ * on this thread or on one this thread has since synchronised with. */
+const char *symbols_string(const SymbolTable *table, uint32_t id, uint16_t *length, uint32_t *hash);
+
+/* The number of distinct strings and the bytes held for them, for reporting */
+void symbols_usage(SymbolTable *table, uint32_t *count, size_t *bytes);
+
+#endif //SYMBOLS_H
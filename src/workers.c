@@ -0,0 +1,208 @@
+#include "workers.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* The indexes a worker has claimed but not started, [lo, hi). The owner takes from lo, thieves take the upper half. */
+typedef struct {
+    pthread_mutex_t lock;
+    size_t lo;
+    size_t hi;
+} Deque;
+
+typedef struct {
+    WorkFn work;
+    void *ctx;
+    unsigned threads;
+    size_t count;
+    size_t window;
+    Deque *deques;
+
+    pthread_mutex_t lock; /* guards everything below */
+    pthread_cond_t progress; /* a result was published or emitted */
+    size_t next; /* first index not yet handed to a worker */
+    size_t emitted; /* results emitted so far */
+    void **results;
+    bool *done;
+} Run;
+
+typedef struct {
+    Run *run;
+    unsigned id;
+} Worker;
+
+static bool pop(Deque *deque, size_t *index) {
+    bool found = false;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->lo < deque->hi) {
+        *index = deque->lo++;
+        found = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+/* Move the upper half of some other worker's deque into self's. */
+static bool steal(Run *run, unsigned self) {
+    unsigned i;
+    for (i = 1; i < run->threads; i++) {
+        Deque *victim = run->deques + (self + i) % run->threads;
+        size_t lo = 0, hi = 0;
+        pthread_mutex_lock(&victim->lock);
+        if (victim->lo < victim->hi) {
+            lo = victim->lo + (victim->hi - victim->lo) / 2;
+            hi = victim->hi;
+            victim->hi = lo;
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (lo < hi) {
+            Deque *own = run->deques + self;
+            pthread_mutex_lock(&own->lock);
+            own->lo = lo;
+            own->hi = hi;
+            pthread_mutex_unlock(&own->lock);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Refill self's deque from the shared queue. Sets *blocked if work remains but the reorder window is full. */
+static bool claim(Run *run, unsigned self, bool *blocked) {
+    size_t lo = 0, hi = 0;
+    pthread_mutex_lock(&run->lock);
+    *blocked = false;
+    if (run->next < run->count) {
+        if (run->next < run->emitted + run->window) {
+            lo = run->next;
+            hi = lo + WORKERS_CHUNK < run->count ? lo + WORKERS_CHUNK : run->count;
+            run->next = hi;
+        } else {
+            *blocked = true;
+        }
+    }
+    pthread_mutex_unlock(&run->lock);
+    if (lo < hi) {
+        Deque *own = run->deques + self;
+        pthread_mutex_lock(&own->lock);
+        own->lo = lo;
+        own->hi = hi;
+        pthread_mutex_unlock(&own->lock);
+        return true;
+    }
+    return false;
+}
+
+static void *worker_main(void *arg) {
+    Worker *worker = arg;
+    Run *run = worker->run;
+    Deque *own = run->deques + worker->id;
+    while (true) {
+        size_t index;
+        if (pop(own, &index)) {
+            void *result = run->work(run->ctx, worker->id, index);
+            pthread_mutex_lock(&run->lock);
+            run->results[index] = result;
+            run->done[index] = true;
+            pthread_cond_broadcast(&run->progress);
+            pthread_mutex_unlock(&run->lock);
+            continue;
+        }
+        bool blocked;
+        if (claim(run, worker->id, &blocked) || steal(run, worker->id)) {
+            continue;
+        }
+        if (!blocked) {
+            break; // every index has been started
+        }
+        // wait for the emitter to drain the reorder buffer before claiming further ahead
+        pthread_mutex_lock(&run->lock);
+        while (run->next < run->count && run->next >= run->emitted + run->window) {
+            pthread_cond_wait(&run->progress, &run->lock);
+        }
+        pthread_mutex_unlock(&run->lock);
+    }
+    return NULL;
+}
+
+int run_ordered(unsigned threads, size_t count, WorkFn work, EmitFn emit, void *ctx) {
+    if (threads == 0) {
+        threads = 1;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    Run run = {
+            .work = work,
+            .ctx = ctx,
+            .threads = threads,
+            .count = count,
+            .window = (size_t) threads * WORKERS_WINDOW,
+            .next = 0,
+            .emitted = 0,
+    };
+    run.deques = calloc(threads, sizeof(Deque));
+    run.results = calloc(count, sizeof(void *));
+    run.done = calloc(count, sizeof(bool));
+    Worker *workers = calloc(threads, sizeof(Worker));
+    pthread_t *tids = calloc(threads, sizeof(pthread_t));
+    if (run.deques == NULL || run.results == NULL || run.done == NULL || workers == NULL || tids == NULL) {
+        free(run.deques);
+        free(run.results);
+        free(run.done);
+        free(workers);
+        free(tids);
+        return ENOMEM;
+    }
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.progress, NULL);
+
+    unsigned i, started = 0;
+    for (i = 0; i < threads; i++) {
+        pthread_mutex_init(&run.deques[i].lock, NULL);
+    }
+    int err = 0;
+    for (i = 0; i < threads; i++) {
+        workers[i].run = &run;
+        workers[i].id = started;
+        err = pthread_create(tids + started, NULL, worker_main, workers + i);
+        if (err != 0) {
+            break;
+        }
+        started++;
+    }
+    // the workers that did start steal each other's work, so fewer threads only costs speed
+    if (started > 0) {
+        err = 0;
+        pthread_mutex_lock(&run.lock);
+        while (run.emitted < count) {
+            size_t index = run.emitted;
+            while (!run.done[index]) {
+                pthread_cond_wait(&run.progress, &run.lock);
+            }
+            pthread_mutex_unlock(&run.lock);
+            emit(ctx, index, run.results[index]);
+            pthread_mutex_lock(&run.lock);
+            run.emitted++;
+            pthread_cond_broadcast(&run.progress);
+        }
+        pthread_mutex_unlock(&run.lock);
+        for (i = 0; i < started; i++) {
+            pthread_join(tids[i], NULL);
+        }
+    }
+
+    for (i = 0; i < threads; i++) {
+        pthread_mutex_destroy(&run.deques[i].lock);
+    }
+    pthread_mutex_destroy(&run.lock);
+    pthread_cond_destroy(&run.progress);
+    free(run.deques);
+    free(run.results);
+    free(run.done);
+    free(workers);
+    free(tids);
+    return err;
+}
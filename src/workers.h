@@ -0,0 +1,26 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Indexes a worker takes from the shared queue at a time. Idle workers steal half of a busy worker's remainder. */
+#define WORKERS_CHUNK 8
+
+/* Results per thread that may wait in the reorder buffer before workers stop taking new indexes */
+#define WORKERS_WINDOW 64
+
+/* Process index on the worker numbered worker (0 <= worker < threads). The return value is passed to the EmitFn. */
+typedef void *(*WorkFn)(void *ctx, unsigned worker, size_t index);
+
+/* Consume the result for index. Called on the thread that called run_ordered(), in increasing index order. */
+typedef void (*EmitFn)(void *ctx, size_t index, void *result);
+
+/* Run work over indexes [0, count) on threads work-stealing threads and emit each result in index order, so the
+ * output matches a serial loop. Returns 0 on success, or an errno value if no thread could be started, in which
+ * case nothing has been run. */
+int run_ordered(unsigned threads, size_t count, WorkFn work, EmitFn emit, void *ctx);
+
+#endif //WORKERS_H
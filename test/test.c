@@ -1,9 +1,25 @@
 #include "../src/class.h"
 #include "../src/class.c"
+#include "../src/cfr.h"
+#include "../src/classpath.h"
+#include "../src/code.h"
+#include "../src/export.h"
+#include "../src/inflate.h"
+#include "../src/json.h"
+#include "../src/mutf8.h"
+#include "../src/output.h"
+#include "../src/print.h"
+#include "../src/reader.h"
+#include "../src/swap.h"
+#include "../src/symbols.h"
+#include "../src/workers.h"
 #include <math.h>
+#include <pthread.h>
 #include "tap.h"
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 int main(void) {
 	dbl();
@@ -11,6 +27,28 @@ int main(void) {
 	fields();
 	empty();
 	test_field2str();
+	zero_copy();
+	arena();
+	const_pool();
+	attribute_kinds();
+	resolved_refs();
+	pool_tags();
+	sections();
+	class_stream();
+	code();
+	lazy_pool();
+	truncated();
+	swap();
+	mutf8();
+	symbols();
+	ordered();
+	reader();
+	classpath();
+	test_inflate();
+	output();
+	json();
+	export();
+	library();
 	return exit_status();
 }	
 
@@ -51,122 +89,122 @@ void dbl() {
 	ok(31 == c->const_pool_count, "Constant pool count is 31"); // two for double type, plus # of items is 1 less than this member's value
 	ok(0 == c->attributes_count, "Attributes count = 0");
 
-	const Item *desc = get_item(c, c->fields[0].desc_idx);
-	ok(desc != NULL, "Field descriptor Item is in the constant pool");
-	ok('D' == desc->value.string.value[0], "Field type tag is D");
+	const Item desc = get_item(c, c->fields[0].desc_idx);
+	ok(desc.tag != 0, "Field descriptor Item is in the constant pool");
+	ok('D' == desc.value.string.value[0], "Field type tag is D");
 
 	ok(1 == c->fields[0].attrs_count, "Attribute count for field 0 is 1");
 
-	const Item *attr_name = get_item(c, c->fields[0].attrs[0].name_idx);
-	ok(strcmp("ConstantValue", attr_name->value.string.value) == 0, "First attribute in first field has name ConstantValue");
+	const Item attr_name = get_item(c, c->fields[0].attrs[0].name_idx);
+	ok(strcmp("ConstantValue", attr_name.value.string.value) == 0, "First attribute in first field has name ConstantValue");
 
 	// Constant pool content tests; could probably make a recursive function but this way is explicit & simpler
-	Item *i = get_item(c, 1);
-	ok(17 == i->value.ref.name_idx, " 1 = Methodref			   6");
-	ok(6 == i->value.ref.class_idx, " 1 = Methodref          17         //  java/lang/Object.\"<init>\":()V");
+	Item i = get_item(c, 1);
+	ok(17 == i.value.ref.name_idx, " 1 = Methodref			   6");
+	ok(6 == i.value.ref.class_idx, " 1 = Methodref          17         //  java/lang/Object.\"<init>\":()V");
 
 	i = get_item(c, 2);
-	ok(18 == i->value.ref.class_idx, " 2 = Fieldref           18        //  java/lang/System.out:Ljava/io/PrintStream;");
-	ok(19 == i->value.ref.name_idx, " 2 = Fieldref           19        //  java/lang/System.out:Ljava/io/PrintStream;");
+	ok(18 == i.value.ref.class_idx, " 2 = Fieldref           18        //  java/lang/System.out:Ljava/io/PrintStream;");
+	ok(19 == i.value.ref.name_idx, " 2 = Fieldref           19        //  java/lang/System.out:Ljava/io/PrintStream;");
 
 	i = get_item(c, 3);
-	ok(20 == i->value.ref.class_idx, " 3 = String             20            //  Hello world1.0");
+	ok(20 == i.value.ref.class_idx, " 3 = String             20            //  Hello world1.0");
 
 	i = get_item(c, 4);
-	ok(21 == i->value.ref.class_idx, " 4 = Methodref         21        //  java/io/PrintStream.println:(Ljava/lang/String;)V");
-	ok(22 == i->value.ref.name_idx, " 4 = Methodref          22        //  java/io/PrintStream.println:(Ljava/lang/String;)V");
+	ok(21 == i.value.ref.class_idx, " 4 = Methodref         21        //  java/io/PrintStream.println:(Ljava/lang/String;)V");
+	ok(22 == i.value.ref.name_idx, " 4 = Methodref          22        //  java/io/PrintStream.println:(Ljava/lang/String;)V");
 
 	i = get_item(c, 5);
-	iok(23, i->value.ref.class_idx, " 5 = Class              23            //  DoubleTest");
+	iok(23, i.value.ref.class_idx, " 5 = Class              23            //  DoubleTest");
 
 	i = get_item(c, 6);
-	iok(24, i->value.ref.class_idx, " 6 = Class              24            //  java/lang/Object");
+	iok(24, i.value.ref.class_idx, " 6 = Class              24            //  java/lang/Object");
 
 	i = get_item(c, 7);
-	ok(0 == strcmp("d", i->value.string.value), " 7 = Utf8               d");
+	ok(0 == strcmp("d", i.value.string.value), " 7 = Utf8               d");
 
 	i = get_item(c, 8);
-	ok(0 == strcmp("D", i->value.string.value), " 8 = Utf8               D");
+	ok(0 == strcmp("D", i.value.string.value), " 8 = Utf8               D");
 
 	i = get_item(c, 9);
-	ok(0 == strcmp("ConstantValue", i->value.string.value), " 9 = Utf8               ConstantValue");
+	ok(0 == strcmp("ConstantValue", i.value.string.value), " 9 = Utf8               ConstantValue");
 
 	i = get_item(c, 10);
-	ok(1.0 == to_double(i->value.dbl), " 10 = Double             1.0d");
+	ok(1.0 == to_double(i.value.dbl), " 10 = Double             1.0d");
 
 	i = get_item(c, 12);
-	strok("<init>", i->value.string.value, " 12 = Utf8               <init>");
+	strok("<init>", i.value.string.value, " 12 = Utf8               <init>");
 
 	i = get_item(c, 13);
-	strok("()V", i->value.string.value, " 13 = Utf8               ()V");
+	strok("()V", i.value.string.value, " 13 = Utf8               ()V");
 
 	i = get_item(c, 14);
-	strok("Code", i->value.string.value, " 14 = Utf8               Code");
+	strok("Code", i.value.string.value, " 14 = Utf8               Code");
 
 	i = get_item(c, 15);
-	strok("main", i->value.string.value, " 15 = Utf8               main");
+	strok("main", i.value.string.value, " 15 = Utf8               main");
 
 	i = get_item(c, 16);
-	strok("([Ljava/lang/String;)V", i->value.string.value, " 16 = Utf8               ([Ljava/lang/String;)V");
+	strok("([Ljava/lang/String;)V", i.value.string.value, " 16 = Utf8               ([Ljava/lang/String;)V");
 
 	i = get_item(c, 17);
-	ok(12 == i->value.ref.class_idx, " 17 = NameAndType        12          \"<init>\":()V");
-	ok(13 == i->value.ref.name_idx, " 17 = NameAndType        13          \"<init>\":()V");
+	ok(12 == i.value.ref.class_idx, " 17 = NameAndType        12          \"<init>\":()V");
+	ok(13 == i.value.ref.name_idx, " 17 = NameAndType        13          \"<init>\":()V");
 
 	i = get_item(c, 18);
-	ok(25 == i->value.ref.class_idx, " 18 = Class              25              java/lang/System");
+	ok(25 == i.value.ref.class_idx, " 18 = Class              25              java/lang/System");
 
 	i = get_item(c, 19);
-	ok(26 == i->value.ref.class_idx, " 19 = NameAndType        26          out:Ljava/io/PrintStream;");
-	ok(27 == i->value.ref.name_idx, " 19 = NameAndType        27          out:Ljava/io/PrintStream;");
+	ok(26 == i.value.ref.class_idx, " 19 = NameAndType        26          out:Ljava/io/PrintStream;");
+	ok(27 == i.value.ref.name_idx, " 19 = NameAndType        27          out:Ljava/io/PrintStream;");
 
 	i = get_item(c, 20);
-	strok("Hello world1.0", i->value.string.value, " 20 = Utf8               Hello world1.0");
+	strok("Hello world1.0", i.value.string.value, " 20 = Utf8               Hello world1.0");
 
 	i = get_item(c, 21);
-	ok(28 == i->value.ref.class_idx, " 21 = Class              28              java/io/PrintStream");
+	ok(28 == i.value.ref.class_idx, " 21 = Class              28              java/io/PrintStream");
 
 	i = get_item(c, 22);
-	ok(29 == i->value.ref.class_idx, " 22 = NameAndType        29          println:(Ljava/lang/String;)V");
-	ok(30 == i->value.ref.name_idx, " 22 = NameAndType        30          println:(Ljava/lang/String;)V");
+	ok(29 == i.value.ref.class_idx, " 22 = NameAndType        29          println:(Ljava/lang/String;)V");
+	ok(30 == i.value.ref.name_idx, " 22 = NameAndType        30          println:(Ljava/lang/String;)V");
 
 	i = get_item(c, 23);
-	strok("DoubleTest", i->value.string.value, " 23 = Utf8               DoubleTest");
+	strok("DoubleTest", i.value.string.value, " 23 = Utf8               DoubleTest");
 
 	i = get_item(c, 24);
-	strok("java/lang/Object", i->value.string.value, " 24 = Utf8               java/lang/Object");
+	strok("java/lang/Object", i.value.string.value, " 24 = Utf8               java/lang/Object");
 
 	i = get_item(c, 25);
-	strok("java/lang/System", i->value.string.value, " 25 = Utf8               java/lang/System");
+	strok("java/lang/System", i.value.string.value, " 25 = Utf8               java/lang/System");
 
 	i = get_item(c, 26);
-	strok("out", i->value.string.value, " 26 = Utf8               out");
+	strok("out", i.value.string.value, " 26 = Utf8               out");
 
 	i = get_item(c, 27);
-	strok("Ljava/io/PrintStream;", i->value.string.value, " 27 = Utf8               Ljava/io/PrintStream;");
+	strok("Ljava/io/PrintStream;", i.value.string.value, " 27 = Utf8               Ljava/io/PrintStream;");
 
 	i = get_item(c, 28);
-	strok("java/io/PrintStream", i->value.string.value, " 28 = Utf8               java/io/PrintStream");
+	strok("java/io/PrintStream", i.value.string.value, " 28 = Utf8               java/io/PrintStream");
 
 	i = get_item(c, 29);
-	strok("println", i->value.string.value, " 29 = Utf8               println");
+	strok("println", i.value.string.value, " 29 = Utf8               println");
 
 	i = get_item(c, 30);
-	strok("(Ljava/lang/String;)V", i->value.string.value, " 30 = Utf8               (Ljava/lang/String;)V");
+	strok("(Ljava/lang/String;)V", i.value.string.value, " 30 = Utf8               (Ljava/lang/String;)V");
 
 	const Method *method = c->methods;
-	const Item *m1name = get_item(c, c->methods[0].name_idx);
-	const Item *m2name = get_item(c, c->methods[1].name_idx);
+	const Item m1name = get_item(c, c->methods[0].name_idx);
+	const Item m2name = get_item(c, c->methods[1].name_idx);
 	ok(c->methods_count == 2, "Methods count == 2, main() and constructor");
-	ok(0 == strcmp("<init>", m1name->value.string.value), "First method's name is <init>");
-	ok(0 == strcmp("main", m2name->value.string.value), "Second method's name is main");
+	ok(0 == strcmp("<init>", m1name.value.string.value), "First method's name is <init>");
+	ok(0 == strcmp("main", m2name.value.string.value), "Second method's name is main");
 	ok(1 == method->attrs_count, "init method attribute count is 1");
 
 	// Test that attribute 1 (index 0) has the name "Code"
-	const Item *m1attr1 = get_item(c, method->attrs[0].name_idx);
-	ok(0 == strcmp("Code", m1attr1->value.string.value), "Attribute #1 of method #1 has name Code");
+	const Item m1attr1 = get_item(c, method->attrs[0].name_idx);
+	ok(0 == strcmp("Code", m1attr1.value.string.value), "Attribute #1 of method #1 has name Code");
 	ok(1 == c->methods[1].attrs_count, "main method attribute count is 1");
-	free(c);
+	free_class(c);
 }
 
 void empty() {
@@ -182,7 +220,7 @@ void empty() {
 	ok(10 == c->const_pool_count, "Constant pool count is 10");
 	ok(0 == c->attributes_count, "Attributes count = 0");
 
-	free(c);
+	free_class(c);
 }
 
 void test_long() {
@@ -197,12 +235,12 @@ void test_long() {
 	iok(15, c->const_pool_count, "Constant pool count is 15");
 	iok(0, c->attributes_count, "Attributes count = 0");
 	
-	iok(10, c->items[1].tag, "Item #1 tag byte is 10");
-	strok(1, c->items[7].tag, "Item #7's tag byte is 1");
-	strok("ConstantValue", c->items[7].value.string.value, "Item #7 is 'ConstantValue' UTF8");
-	lok(1.0, to_long(c->items[8].value.lng), "Long constant pool item value is 1.0");
-	strok("<init>", c->items[10].value.string.value, "Item #10 is '<init>' UTF8");
-	free(c);
+	iok(10, get_item(c, 2).tag, "Item #1 tag byte is 10");
+	strok(1, get_item(c, 8).tag, "Item #7's tag byte is 1");
+	strok("ConstantValue", get_item(c, 8).value.string.value, "Item #7 is 'ConstantValue' UTF8");
+	lok(1.0, to_long(get_item(c, 9).value.lng), "Long constant pool item value is 1.0");
+	strok("<init>", get_item(c, 11).value.string.value, "Item #10 is '<init>' UTF8");
+	free_class(c);
 }
 
 void fields() {
@@ -227,6 +265,1067 @@ void test_field2str() {
 	ok("array" == field2str('['), "[ == array");
 }
 
+/* A minimal class: Foo extends java/lang/Object with a SourceFile attribute of Foo.java */
+static const unsigned char MINIMAL_CLASS[] = {
+	0xca, 0xfe, 0xba, 0xbe, 0x00, 0x00, 0x00, 0x33, 0x00, 0x07,
+	0x01, 0x00, 0x03, 'F', 'o', 'o',
+	0x07, 0x00, 0x01,
+	0x01, 0x00, 0x10, 'j', 'a', 'v', 'a', '/', 'l', 'a', 'n', 'g', '/', 'O', 'b', 'j', 'e', 'c', 't',
+	0x07, 0x00, 0x03,
+	0x01, 0x00, 0x0a, 'S', 'o', 'u', 'r', 'c', 'e', 'F', 'i', 'l', 'e',
+	0x01, 0x00, 0x08, 'F', 'o', 'o', '.', 'j', 'a', 'v', 'a',
+	0x00, 0x21, 0x00, 0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x01, 0x00, 0x05, 0x00, 0x00, 0x00, 0x02, 0x00, 0x06
+};
+
+/* Return a Bytecode reading a private copy of MINIMAL_CLASS */
+Bytecode minimal_bytecode(void) {
+	char *data = malloc(sizeof(MINIMAL_CLASS));
+	memcpy(data, MINIMAL_CLASS, sizeof(MINIMAL_CLASS));
+	Bytecode bytecode = {.data = data, .length = sizeof(MINIMAL_CLASS), .index = 0};
+	return bytecode;
+}
+
+void zero_copy() {
+	printh("Zero copy");
+	Bytecode bytecode = minimal_bytecode();
+	ParseOptions opts = {.flags = PARSE_ZERO_COPY};
+	Class *c = read_class_opts(&bytecode, &opts);
+	ok(c != NULL, "C is not NULL");
+	ok(c->source == bytecode.data, "Class borrows the bytecode buffer");
+
+	Item name = get_class_string(c, c->this_class);
+	ok(name.value.string.value == bytecode.data + 13, "This class name points into the buffer");
+	ok(3 == name.value.string.length, "This class name is 3 bytes");
+	ok(c->attributes[0].info == bytecode.data + bytecode.length - 2, "SourceFile payload points into the buffer");
+
+	ok(detach_class(c), "Class detaches from its buffer");
+	ok(c->source == NULL, "Detached class has no source");
+	memset((char *) bytecode.data, 0, bytecode.length);
+	free((char *) bytecode.data);
+	name = get_class_string(c, c->this_class);
+	strok("Foo", (char *) name.value.string.value, "This class name survives the buffer");
+	ok(6 == generic_be16toh((void *) c->attributes[0].info), "SourceFile payload survives the buffer");
+	free_class(c);
+}
+
+void arena() {
+	printh("Arena");
+	Arena arena;
+	ok(arena_init(&arena, 64), "Arena initialises");
+	int *small = arena_alloc(&arena, sizeof(int));
+	ok(((uintptr_t) small % ARENA_ALIGN) == 0, "Allocations are aligned");
+	char *big = arena_alloc(&arena, ARENA_MIN_BLOCK * 4);
+	ok(big != NULL, "Allocation larger than a block succeeds");
+	ok(2 == arena.blocks, "Arena grew a second block");
+	arena_reset(&arena);
+	ok(1 == arena.blocks, "Reset leaves a single block");
+	ok(0 == arena.allocated, "Reset forgets every allocation");
+
+	Bytecode bytecode = minimal_bytecode();
+	ParseOptions opts = {.arena = &arena};
+	Class *c = read_class_opts(&bytecode, &opts);
+	ok(c != NULL, "C is not NULL");
+	ok(c->arena == &arena && !c->owns_arena, "Class lives in the caller's arena");
+	ok(1 == arena.blocks, "Class fits in the reset block");
+	strok("Foo", (char *) get_class_string(c, c->this_class).value.string.value, "This class name is Foo");
+	free_class(c);
+	arena_reset(&arena);
+	bytecode.index = 0;
+	c = read_class_opts(&bytecode, &opts);
+	ok(c != NULL, "Class parses again after a reset");
+	arena_destroy(&arena);
+	free((char *) bytecode.data);
+}
+
+void const_pool() {
+	printh("Constant pool");
+	Bytecode bytecode = minimal_bytecode();
+	Class *c = read_class(&bytecode);
+	ok(c != NULL, "C is not NULL");
+	ok(0 == c->pool.tags[0], "Entry 0 is unused");
+	ok(STRING_UTF8 == c->pool.tags[1] && CLASS == c->pool.tags[2], "Tags are stored densely by pool index");
+	ok(0 == get_item(c, 7).tag, "Out of range index decodes to tag 0");
+	Item i = get_item(c, 4);
+	iok(3, i.value.ref.class_idx, "4 = Class #3");
+	i = get_item(c, 6);
+	ok(8 == i.value.string.length && '\0' == i.value.string.value[8], "Copied strings are NUL-terminated");
+	free_class(c);
+	free((char *) bytecode.data);
+}
+
+void attribute_kinds() {
+	printh("Attribute kinds");
+	static const char *const NAMES[] = {
+		"ConstantValue", "Code", "StackMapTable", "BootstrapMethods", "NestHost", "NestMembers", "PermittedSubclasses",
+		"Exceptions", "InnerClasses", "EnclosingMethod", "Synthetic", "Signature", "Record", "SourceFile",
+		"LineNumberTable", "LocalVariableTable", "LocalVariableTypeTable", "SourceDebugExtension", "Deprecated",
+		"RuntimeVisibleAnnotations", "RuntimeInvisibleAnnotations", "RuntimeVisibleParameterAnnotations",
+		"RuntimeInvisibleParameterAnnotations", "RuntimeVisibleTypeAnnotations", "RuntimeInvisibleTypeAnnotations",
+		"AnnotationDefault", "MethodParameters", "Module", "ModulePackages", "ModuleMainClass"
+	};
+	int k, found = 1;
+	for (k = 0; k < (int) (sizeof(NAMES) / sizeof(NAMES[0])); k++) {
+		found &= (int) attribute_kind(NAMES[k], strlen(NAMES[k])) == k + 1;
+	}
+	ok(found, "Every predefined name has its own kind");
+	ok(ATTR_UNKNOWN == attribute_kind("Cod", 3) && ATTR_UNKNOWN == attribute_kind("Codex", 5) &&
+	   ATTR_UNKNOWN == attribute_kind("", 0), "Other names are unknown");
+	Bytecode bytecode = minimal_bytecode();
+	Class *c = read_class(&bytecode);
+	ok(c != NULL && ATTR_SOURCE_FILE == c->attributes[0].kind, "Parsed attributes carry their kind");
+	free_class(c);
+	free((char *) bytecode.data);
+}
+
+void resolved_refs() {
+	printh("Resolved references");
+	static const unsigned char REFS_CLASS[] = {
+		0xca, 0xfe, 0xba, 0xbe, 0x00, 0x00, 0x00, 0x33, 0x00, 0x07,
+		0x01, 0x00, 0x03, 'F', 'o', 'o',
+		0x07, 0x00, 0x01,
+		0x01, 0x00, 0x03, 'r', 'u', 'n',
+		0x01, 0x00, 0x03, '(', ')', 'V',
+		0x0c, 0x00, 0x03, 0x00, 0x04,
+		0x0a, 0x00, 0x02, 0x00, 0x05,
+		0x00, 0x21, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+	};
+	Bytecode bytecode = {.data = (const char *) REFS_CLASS, .length = sizeof(REFS_CLASS), .index = 0};
+	Class *c = read_class(&bytecode);
+	ok(c != NULL && NULL == c->pool.resolved, "Nothing is resolved while parsing");
+	ResolvedRef method = resolve_ref(c, 6);
+	ok(c->pool.resolved != NULL, "The first lookup resolves the pool");
+	ok(3 == method.owner.length && 0 == memcmp("Foo", method.owner.value, 3), "Method owner resolves");
+	ok(3 == method.name.length && 0 == memcmp("run", method.name.value, 3), "Method name resolves");
+	ok(3 == method.descriptor.length && 0 == memcmp("()V", method.descriptor.value, 3), "Method descriptor resolves");
+	ResolvedRef name_and_type = resolve_ref(c, 5), class_ref = resolve_ref(c, 2);
+	ok(NULL == name_and_type.owner.value && name_and_type.name.value == method.name.value, "NameAndType has no owner");
+	ok(class_ref.owner.value == method.owner.value && NULL == class_ref.name.value, "Class has only an owner");
+	ok(NULL == resolve_ref(c, 1).owner.value && NULL == resolve_ref(c, 99).owner.value,
+	   "Other entries and bad indexes resolve to nothing");
+	free_class(c);
+}
+
+void pool_tags() {
+	printh("Constant pool tags");
+	static const unsigned char TAGS_CLASS[] = {
+		0xca, 0xfe, 0xba, 0xbe, 0x00, 0x00, 0x00, 0x37, 0x00, 0x0a,
+		0x01, 0x00, 0x03, 'F', 'o', 'o',
+		0x07, 0x00, 0x01,
+		0x0f, 0x06, 0x00, 0x02,
+		0x10, 0x00, 0x01,
+		0x11, 0x00, 0x00, 0x00, 0x06,
+		0x0c, 0x00, 0x01, 0x00, 0x01,
+		0x12, 0x00, 0x00, 0x00, 0x06,
+		0x13, 0x00, 0x01,
+		0x14, 0x00, 0x01,
+		0x00, 0x21, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+	};
+	static const uint8_t TAGS[] = {
+		0, STRING_UTF8, CLASS, METHOD_HANDLE, METHOD_TYPE, DYNAMIC, NAME, INVOKE_DYNAMIC, MODULE, PACKAGE
+	};
+	Bytecode bytecode = {.data = (const char *) TAGS_CLASS, .length = sizeof(TAGS_CLASS), .index = 0};
+	Class *eager = read_class(&bytecode);
+	bytecode.index = 0;
+	ParseOptions opts = {.flags = PARSE_LAZY_POOL | PARSE_ZERO_COPY};
+	Class *lazy = read_class_opts(&bytecode, &opts);
+	ok(eager != NULL && lazy != NULL, "Every loadable tag parses");
+	ok(eager != NULL && 0 == memcmp(TAGS, eager->pool.tags, sizeof(TAGS)), "Tags follow the pool");
+	int same = eager != NULL && lazy != NULL;
+	uint16_t k;
+	for (k = 3; same && k < sizeof(TAGS); k++) {
+		Item a = get_item(eager, k), b = get_item(lazy, k);
+		same = a.tag == b.tag && a.value.ref.class_idx == b.value.ref.class_idx && a.value.ref.name_idx == b.value.ref.name_idx;
+	}
+	ok(same, "Lazy entries decode as eager ones do");
+	Item handle = get_item(eager, 3), dynamic = get_item(eager, 7);
+	ok(6 == handle.value.ref.class_idx && 2 == handle.value.ref.name_idx, "MethodHandle is kind 6 of #2");
+	ok(0 == dynamic.value.ref.class_idx && 6 == dynamic.value.ref.name_idx, "InvokeDynamic is bootstrap 0 with #6");
+	iok(2, eager->this_class, "Members after the pool are parsed");
+	free_class(eager);
+	free_class(lazy);
+
+	// 2 is not a tag, and its width is unknown, so the pool cannot be read past it
+	char bad[sizeof(TAGS_CLASS)];
+	memcpy(bad, TAGS_CLASS, sizeof(bad));
+	bad[23] = 0x02;
+	uint32_t flags;
+	int rejected = 1;
+	for (flags = 0; flags <= PARSE_LAZY_POOL; flags += PARSE_LAZY_POOL) {
+		Bytecode invalid = {.data = bad, .length = sizeof(bad), .index = 0};
+		ParseOptions bad_opts = {.flags = flags};
+		Class *c = NULL;
+		rejected &= EINVAL == read_class_err(&invalid, &bad_opts, &c) && NULL == c;
+	}
+	ok(rejected, "An unknown tag is rejected");
+}
+
+/* Foo with a field x and a method x()V, each with a Synthetic attribute, and a SourceFile attribute */
+static const unsigned char MEMBERS_CLASS[] = {
+	0xca, 0xfe, 0xba, 0xbe, 0x00, 0x00, 0x00, 0x33, 0x00, 0x08,
+	0x01, 0x00, 0x03, 'F', 'o', 'o',
+	0x07, 0x00, 0x01,
+	0x01, 0x00, 0x01, 'x',
+	0x01, 0x00, 0x01, 'I',
+	0x01, 0x00, 0x09, 'S', 'y', 'n', 't', 'h', 'e', 't', 'i', 'c',
+	0x01, 0x00, 0x0a, 'S', 'o', 'u', 'r', 'c', 'e', 'F', 'i', 'l', 'e',
+	0x01, 0x00, 0x03, '(', ')', 'V',
+	0x00, 0x21, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x01, 0x00, 0x02, 0x00, 0x03, 0x00, 0x04, 0x00, 0x01, 0x00, 0x05, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x01, 0x00, 0x01, 0x00, 0x03, 0x00, 0x07, 0x00, 0x01, 0x00, 0x05, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x01, 0x00, 0x06, 0x00, 0x00, 0x00, 0x02, 0x00, 0x01
+};
+
+void sections() {
+	printh("Selected sections");
+	Bytecode bytecode = {.data = (const char *) MEMBERS_CLASS, .length = sizeof(MEMBERS_CLASS), .index = 0};
+	Class *c = read_class(&bytecode);
+	ok(c != NULL && PARSE_ALL_SECTIONS == c->sections, "Every section is parsed by default");
+	ok(c != NULL && 1 == c->fields_count && 1 == c->methods_count && 1 == c->attributes_count &&
+	   ATTR_SYNTHETIC == c->methods[0].attrs[0].kind, "The whole class is there");
+	free_class(c);
+
+	bytecode.index = 0;
+	ParseOptions opts = {.sections = PARSE_POOL_STRINGS};
+	c = read_class_opts(&bytecode, &opts);
+	ok(c != NULL && sizeof(MEMBERS_CLASS) == bytecode.index, "Unwanted sections are stepped over");
+	ok(c != NULL && 0 == c->fields_count && 0 == c->methods_count && 0 == c->attributes_count && NULL == c->fields,
+	   "Unwanted sections are empty");
+	ok(c != NULL && NULL == c->pool.attribute_kinds, "No attribute names are looked up");
+	strok("Foo", c != NULL ? (char *) get_class_string(c, c->this_class).value.string.value : "", "This class is Foo");
+	free_class(c);
+
+	bytecode.index = 0;
+	opts.sections = PARSE_METHODS;
+	c = read_class_opts(&bytecode, &opts);
+	ok(c != NULL && 1 == c->methods_count && 0 == c->methods[0].attrs_count && NULL == c->methods[0].attrs,
+	   "Methods come without their attributes");
+	ok(c != NULL && 7 == c->methods[0].desc_idx && STRING_UTF8 == c->pool.tags[7], "Method descriptors are kept");
+	ok(c != NULL && NULL == c->pool.bytes && 0 == get_item(c, 7).value.string.length, "Unwanted strings read as empty");
+	ok(c != NULL && detach_class(c), "A class without strings detaches");
+	free_class(c);
+
+	// every prefix still reads as truncated, so stepping over a section checks its lengths
+	int wrong = 0;
+	size_t length;
+	for (length = 4; length < sizeof(MEMBERS_CLASS); length++) {
+		Bytecode prefix = {.data = (const char *) MEMBERS_CLASS, .length = length, .index = 0};
+		ParseOptions none = {.sections = PARSE_POOL_STRINGS};
+		Class *p = NULL;
+		wrong += ENODATA != read_class_err(&prefix, &none, &p) || p != NULL;
+	}
+	iok(0, wrong, "Every prefix is reported truncated with sections stepped over");
+}
+
+void class_stream() {
+	printh("Class stream");
+	Bytecode bytecode = {.data = (const char *) MEMBERS_CLASS, .length = sizeof(MEMBERS_CLASS), .index = 0};
+	Class *whole = read_class(&bytecode), *c = NULL;
+
+	// a byte at a time, the worst a stream can be split
+	ClassStream *stream = class_stream_create(NULL, UINT32_MAX);
+	ok(stream != NULL, "Stream is created");
+	int waiting = 0;
+	size_t i;
+	for (i = 0; i + 1 < sizeof(MEMBERS_CLASS); i++) {
+		waiting += EAGAIN == class_stream_feed(stream, (const char *) MEMBERS_CLASS + i, 1);
+	}
+	iok((int) sizeof(MEMBERS_CLASS) - 1, waiting, "Stream waits for more until the last byte");
+	iok(0, class_stream_feed(stream, (const char *) MEMBERS_CLASS + i, 1), "The last byte completes the class");
+	iok(0, class_stream_feed(stream, "extra", 5), "Input after the class is ignored");
+	iok(0, class_stream_finish(stream, &c), "Finished stream gives its class");
+	ok(c != NULL && NULL == c->source && whole->pool_size_bytes == c->pool_size_bytes, "Pool matches a whole parse");
+	strok("Foo", c != NULL ? (char *) get_class_string(c, c->this_class).value.string.value : "", "This class is Foo");
+	ok(c != NULL && 1 == c->fields_count && 1 == c->methods_count && 1 == c->attributes_count &&
+	   7 == c->methods[0].desc_idx && ATTR_SYNTHETIC == c->fields[0].attrs[0].kind, "Members match a whole parse");
+	ok(c != NULL && 2 == c->attributes[0].length && 0 == memcmp(whole->attributes[0].info, c->attributes[0].info, 2),
+	   "Attribute bodies are kept");
+	free_class(c);
+
+	// uneven pieces, keeping no attribute body
+	stream = class_stream_create(NULL, 0);
+	int err = EAGAIN;
+	for (i = 0; i < sizeof(MEMBERS_CLASS) && EAGAIN == err; i += 7) {
+		err = class_stream_feed(stream, (const char *) MEMBERS_CLASS + i,
+		                        sizeof(MEMBERS_CLASS) - i < 7 ? sizeof(MEMBERS_CLASS) - i : 7);
+	}
+	iok(0, err, "Pieces of any size complete the class");
+	ok(0 == class_stream_finish(stream, &c) && 2 == c->attributes[0].length && NULL == c->attributes[0].info,
+	   "Bodies over the limit are stepped over");
+	free_class(c);
+
+	ParseOptions opts = {.sections = PARSE_POOL_STRINGS, .flags = PARSE_LAZY_POOL};
+	stream = class_stream_create(&opts, UINT32_MAX);
+	class_stream_feed(stream, (const char *) MEMBERS_CLASS, sizeof(MEMBERS_CLASS));
+	ok(0 == class_stream_finish(stream, &c) && 0 == c->methods_count && c->pool.lazy &&
+	   1 == get_item(c, 2).value.ref.class_idx, "Options apply to streamed classes");
+	free_class(c);
+
+	// a table left out of the sections takes nothing from the arena, its member attributes included
+	Arena *streamed = arena_create(ARENA_MIN_BLOCK), *parsed = arena_create(ARENA_MIN_BLOCK);
+	ParseOptions no_methods = {.sections = PARSE_ALL_SECTIONS & ~PARSE_METHODS, .arena = streamed};
+	stream = class_stream_create(&no_methods, UINT32_MAX);
+	class_stream_feed(stream, (const char *) MEMBERS_CLASS, sizeof(MEMBERS_CLASS));
+	err = class_stream_finish(stream, &c);
+	no_methods.arena = parsed;
+	bytecode.index = 0;
+	Class *masked = NULL;
+	ok(0 == err && 0 == read_class_err(&bytecode, &no_methods, &masked) && 0 == c->methods_count &&
+	   1 == c->fields[0].attrs_count, "A masked table is stepped over in a stream");
+	iok((int) parsed->allocated, (int) streamed->allocated, "A masked table takes no more memory than in a whole parse");
+	free_class(c);
+	free_class(masked);
+	arena_destroy(streamed);
+	arena_destroy(parsed);
+
+	int wrong = 0;
+	size_t length;
+	for (length = 0; length < sizeof(MEMBERS_CLASS); length++) {
+		stream = class_stream_create(NULL, UINT32_MAX);
+		c = NULL;
+		wrong += EAGAIN != class_stream_feed(stream, (const char *) MEMBERS_CLASS, length) ||
+		         ENODATA != class_stream_finish(stream, &c) ||
+		         c != NULL;
+	}
+	iok(0, wrong, "Every prefix is reported truncated");
+
+	stream = class_stream_create(NULL, UINT32_MAX);
+	ok(EINVAL == class_stream_feed(stream, "\xca\xfe\xba\xbf\0\0\0\x33\0\x07", 10) &&
+	   EINVAL == class_stream_feed(stream, (const char *) MEMBERS_CLASS, sizeof(MEMBERS_CLASS)),
+	   "Bad input stops the stream");
+	ok(EINVAL == class_stream_finish(stream, NULL), "Finishing reports why it stopped");
+	free_class(whole);
+}
+
+void code() {
+	printh("Code");
+	static const unsigned char CODE[] = {
+		0x00, 0x04, 0x01, 0x2d, 0x00, 0x00, 0x00, 0x42,
+		0x10, 0xfb, // 0: bipush -5
+		0xaa, 0x00, // 2: tableswitch, padded to 4
+		0x00, 0x00, 0x00, 0x3f, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x16,
+		0x00, 0x00, 0x00, 0x2a,
+		0xab, 0x00, 0x00, 0x00, // 24: lookupswitch, padded to 28
+		0x00, 0x00, 0x00, 0x29, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00, 0x14,
+		0xc4, 0x84, 0x01, 0x2c, 0xff, 0xfe, // 44: wide iinc 300 -2
+		0xc4, 0x15, 0x01, 0x02, // 50: wide iload 258
+		0x84, 0x01, 0x03, // 54: iinc 1 3
+		0xb9, 0x00, 0x09, 0x02, 0x00, // 57: invokeinterface #9 2
+		0xa7, 0xff, 0xc2, // 62: goto 0
+		0xb1, // 65: return
+		0x00, 0x01, 0x00, 0x00, 0x00, 0x18, 0x00, 0x3e, 0x00, 0x00,
+		0x00, 0x01, 0x00, 0x05, 0x00, 0x00, 0x00, 0x02, 0x00, 0x06
+	};
+	Bytecode bytecode = minimal_bytecode();
+	Class *c = read_class(&bytecode);
+	Attribute attr = {.kind = ATTR_CODE, .length = sizeof(CODE), .info = (const char *) CODE};
+	Code code;
+	iok(0, decode_code_attribute(c, &attr, &code), "Code decodes");
+	ok(4 == code.max_stack && 301 == code.max_locals && 66 == code.code_length, "Header is read");
+	iok(9, (int) code.instructions_count, "Every instruction is found");
+	Instruction *insn = code.instructions;
+	ok(0x10 == insn[0].opcode && -5 == insn[0].operand, "bipush is signed");
+	ok(24 == insn[2].offset && 44 == insn[3].offset, "Switches step over their padding and tables");
+	const int32_t *table = code.switches + insn[1].operand;
+	ok(65 == table[0] && 1 == table[1] && 2 == table[2] && 24 == table[3] && 44 == table[4],
+	   "tableswitch targets are offsets in the code");
+	table = code.switches + insn[2].operand;
+	ok(65 == table[0] && 1 == table[1] && 7 == table[2] && 44 == table[3], "lookupswitch pairs are decoded");
+	ok(insn[3].wide && 0x84 == insn[3].opcode && 300 == insn[3].operand && -2 == insn[3].extra, "wide iinc is decoded");
+	ok(insn[4].wide && 0x15 == insn[4].opcode && 258 == insn[4].operand && 54 == insn[5].offset, "wide iload is decoded");
+	ok(!insn[5].wide && 1 == insn[5].operand && 3 == insn[5].extra, "iinc is decoded");
+	ok(9 == insn[6].operand && 2 == insn[6].extra && 0 == insn[7].operand, "Pool indexes, counts and branches are decoded");
+	ok(1 == code.exceptions_count && 24 == code.exceptions[0].end_pc && 62 == code.exceptions[0].handler_pc,
+	   "Exception table is decoded");
+	ok(1 == code.attributes_count && ATTR_SOURCE_FILE == code.attributes[0].kind &&
+	   code.attributes[0].info == (const char *) CODE + sizeof(CODE) - 2, "Nested attributes view the body");
+
+	char bad[sizeof(CODE)];
+	memcpy(bad, CODE, sizeof(bad));
+	bad[8 + 65] = (char) 0xca;
+	attr.info = bad;
+	int rejected = EINVAL == decode_code_attribute(c, &attr, &code);
+	memcpy(bad, CODE, sizeof(bad));
+	bad[8 + 51] = 0x00;
+	rejected &= EINVAL == decode_code_attribute(c, &attr, &code);
+	memcpy(bad, CODE, sizeof(bad));
+	bad[7] = 0x20;
+	rejected &= EINVAL == decode_code_attribute(c, &attr, &code);
+	attr.info = (const char *) CODE;
+	attr.length = sizeof(CODE) - 1;
+	rejected &= EINVAL == decode_code_attribute(c, &attr, &code);
+	ok(rejected, "Reserved opcodes, bad wides, cut switches and short bodies are rejected");
+	free_class(c);
+	free((char *) bytecode.data);
+
+	bytecode = (Bytecode) {.data = (const char *) MEMBERS_CLASS, .length = sizeof(MEMBERS_CLASS), .index = 0};
+	c = read_class(&bytecode);
+	iok(ENOENT, decode_code(c, c->methods, &code), "A method without code has none to decode");
+	free_class(c);
+}
+
+void lazy_pool() {
+	printh("Lazy constant pool");
+	Bytecode bytecode = minimal_bytecode();
+	Class *eager = read_class(&bytecode);
+	bytecode.index = 0;
+	ParseOptions opts = {.flags = PARSE_LAZY_POOL | PARSE_ZERO_COPY};
+	Class *c = read_class_opts(&bytecode, &opts);
+	ok(c != NULL, "C is not NULL");
+	ok(c->pool.bytes == bytecode.data + 10, "Lazy pool indexes the encoded entries in place");
+	iok(eager->pool_size_bytes, c->pool_size_bytes, "Lazy and eager pools are the same size");
+	iok(2, c->this_class, "Members after the pool are parsed");
+	Item i = get_item(c, 2);
+	iok(1, i.value.ref.class_idx, "2 = Class #1 is decoded on demand");
+	i = get_class_string(c, c->super_class);
+	ok(16 == i.value.string.length && 0 == memcmp("java/lang/Object", i.value.string.value, 16), "Super class is java/lang/Object");
+
+	ok(detach_class(c), "Lazy class detaches from its buffer");
+	memset((char *) bytecode.data, 0, bytecode.length);
+	i = get_class_string(c, c->this_class);
+	ok(3 == i.value.string.length && 0 == memcmp("Foo", i.value.string.value, 3), "This class name survives the buffer");
+	free_class(eager);
+	free_class(c);
+	free((char *) bytecode.data);
+
+	// full pools of 65535 entries ending in a Long, at count - 2 and, with no slot left for its second half, at count - 1
+	unsigned char *data = malloc(10 + 6 + 65532 * 3 + 23);
+	uint16_t position;
+	for (position = 65533; position <= 65534; position++) {
+		size_t at = 10 + 6;
+		memcpy(data, "\xca\xfe\xba\xbe\x00\x00\x00\x33\xff\xff\x01\x00\x03" "Foo", at);
+		uint16_t k;
+		for (k = 2; k < position; k++, at += 3) {
+			memcpy(data + at, "\x07\x00\x01", 3);
+		}
+		memcpy(data + at, "\x05\x00\x00\x00\x01\x00\x00\x00\x02\x00\x21\x00\x02", 13);
+		memset(data + at + 13, 0, 10);
+		Bytecode full = {.data = (const char *) data, .length = at + 23, .index = 0};
+		Class *full_eager = read_class(&full);
+		full.index = 0;
+		ParseOptions full_opts = {.flags = PARSE_LAZY_POOL};
+		Class *full_lazy = NULL;
+		int err = read_class_err(&full, &full_opts, &full_lazy);
+		ok(full_eager != NULL && 0 == err && 65535 == full_lazy->const_pool_count && 2 == full_lazy->this_class &&
+		   full.index == full.length, position == 65533 ? "A Long in the last two pool slots parses lazily"
+		                                                  : "A Long in the last pool slot parses lazily as eagerly");
+		if (position == 65533) {
+			ok(full_lazy != NULL && ((long) 1 << 32 | 2) == to_long(get_item(full_lazy, 65533).value.lng),
+			   "The last Long decodes on demand");
+		}
+		free_class(full_eager);
+		free_class(full_lazy);
+	}
+	free(data);
+}
+
+void truncated() {
+	printh("Truncated input");
+	const unsigned char be[] = {0x12, 0x34, 0x56, 0x78};
+	iok(0x1234, load_u2(be), "u2 loads big-endian");
+	ok(0x12345678 == load_u4(be), "u4 loads big-endian");
+
+	// every prefix in a buffer of its own size, so reading past the end is caught by a sanitizer
+	int wrong = 0;
+	size_t length;
+	for (length = 4; length < sizeof(MINIMAL_CLASS); length++) {
+		char *data = malloc(length);
+		memcpy(data, MINIMAL_CLASS, length);
+		uint32_t flags;
+		for (flags = 0; flags <= (PARSE_ZERO_COPY | PARSE_LAZY_POOL); flags++) {
+			Bytecode bytecode = {.data = data, .length = length, .index = 0};
+			ParseOptions opts = {.flags = flags};
+			Class *c = NULL;
+			wrong += ENODATA != read_class_err(&bytecode, &opts, &c) || c != NULL || !bytecode.truncated;
+		}
+		free(data);
+	}
+	iok(0, wrong, "Every prefix of a class is reported truncated");
+
+	Bytecode bytecode = minimal_bytecode();
+	ok(read_class(&bytecode) != NULL && !bytecode.truncated, "The whole class is not truncated");
+	free((char *) bytecode.data);
+}
+
+void swap() {
+	printh("Byte swapping");
+	// an odd start, so no load is aligned
+	unsigned char src[1 + 4 * 67];
+	size_t i;
+	for (i = 0; i < sizeof(src); i++) {
+		src[i] = (unsigned char) (i * 7 + 1);
+	}
+	SwapKernel k;
+	for (k = SWAP_SCALAR; k <= SWAP_AVX2; k++) {
+		SwapKernel used = swap_use(k);
+		int wrong = 0;
+		size_t count;
+		for (count = 0; count <= 67; count++) {
+			uint16_t u2s[68];
+			uint32_t u4s[68];
+			u2s[count] = 0xaaaa;
+			u4s[count] = 0xaaaaaaaa;
+			swap_u2(u2s, src + 1, count);
+			swap_u4(u4s, src + 1, count);
+			for (i = 0; i < count; i++) {
+				wrong += u2s[i] != load_u2(src + 1 + 2 * i) || u4s[i] != load_u4(src + 1 + 4 * i);
+			}
+			wrong += u2s[count] != 0xaaaa || u4s[count] != 0xaaaaaaaa;
+			// in place, as the class parser decodes its interfaces
+			memcpy(u2s, src + 1, 2 * count);
+			memcpy(u4s, src + 1, 4 * count);
+			swap_u2(u2s, u2s, count);
+			swap_u4(u4s, u4s, count);
+			for (i = 0; i < count; i++) {
+				wrong += u2s[i] != load_u2(src + 1 + 2 * i) || u4s[i] != load_u4(src + 1 + 4 * i);
+			}
+		}
+		char msg[64];
+		snprintf(msg, sizeof(msg), "The %s kernel decodes every length", swap_kernel_name(used));
+		iok(0, wrong, msg);
+	}
+	swap_use(SWAP_BEST);
+}
+
+void mutf8() {
+	printh("Modified UTF-8");
+	char text[70];
+	memset(text, 'a', sizeof(text));
+	text[40] = '\xc3';
+	iok(40, (int) mutf8_ascii_length(text, sizeof(text)), "ASCII runs stop at the first non-ASCII byte");
+	text[5] = '\0';
+	iok(5, (int) mutf8_ascii_length(text, sizeof(text)), "ASCII runs stop at a NUL");
+	bool ascii;
+	ok(mutf8_validate("java/lang/Object", 16, &ascii) && ascii, "ASCII is well-formed");
+	ok(mutf8_validate("a\xc0\x80\xed\xa0\x80", 6, &ascii) && !ascii, "Encoded NUL and lone surrogate are well-formed");
+	ok(!mutf8_validate("\xc0\x81", 2, &ascii), "Overlong encoding is malformed");
+	ok(!mutf8_validate("\xf0\x9f\x98\x80", 4, &ascii), "Four-byte form is malformed");
+	ok(!mutf8_validate("a\0", 2, &ascii), "NUL byte is malformed");
+
+	char utf8[16];
+	size_t consumed;
+	size_t written = mutf8_to_utf8(utf8, sizeof(utf8), "\xed\xa0\xbd\xed\xb8\x80\xc0\x80", 8, &consumed);
+	ok(5 == written && 8 == consumed && 0 == memcmp("\xf0\x9f\x98\x80", utf8, 5), "Surrogate pair and NUL convert");
+
+	Bytecode bytecode = minimal_bytecode();
+	((char *) bytecode.data)[14] = '\xc3';
+	((char *) bytecode.data)[15] = '\xb6';
+	Class *c = read_class(&bytecode);
+	ok(c != NULL, "C is not NULL");
+	ok(!get_item(c, 1).value.string.ascii && get_item(c, 3).value.string.ascii, "ASCII strings are marked");
+	free_class(c);
+	((char *) bytecode.data)[15] = '\0';
+	bytecode.index = 0;
+	c = read_class(&bytecode);
+	ok(c != NULL, "Malformed strings are kept by default");
+	free_class(c);
+	bytecode.index = 0;
+	ParseOptions opts = {.flags = PARSE_STRICT_UTF8 | PARSE_LAZY_POOL};
+	Class *strict = NULL;
+	iok(EINVAL, read_class_err(&bytecode, &opts, &strict), "Malformed strings are rejected when strict");
+	free((char *) bytecode.data);
+}
+
+/* Intern "s0" to "s1999" into the table, recording the ids in the caller's array */
+void *intern_many(void *arg) {
+	void **args = arg;
+	uint32_t *ids = args[1];
+	char name[16];
+	int i;
+	for (i = 0; i < 2000; i++) {
+		int length = snprintf(name, sizeof(name), "s%d", i);
+		ids[i] = symbols_intern(args[0], name, (uint16_t) length, symbols_hash(name, length));
+	}
+	return NULL;
+}
+
+void symbols() {
+	printh("Symbol table");
+	SymbolTable *table = symbols_create();
+	ok(table != NULL, "Table is not NULL");
+	uint32_t a = symbols_intern(table, "()V", 3, symbols_hash("()V", 3));
+	uint32_t b = symbols_intern(table, "Code", 4, symbols_hash("Code", 4));
+	ok(a != b && a == symbols_intern(table, "()V", 3, symbols_hash("()V", 3)), "Equal strings share an id");
+	uint16_t length;
+	uint32_t hash;
+	const char *value = symbols_string(table, b, &length, &hash);
+	ok(4 == length && 0 == strcmp("Code", value) && symbols_hash("Code", 4) == hash, "Ids give back their strings");
+
+	uint32_t ids[4][2000];
+	void *args[4][2];
+	pthread_t threads[4];
+	int t, i, agree = 1;
+	for (t = 0; t < 4; t++) {
+		args[t][0] = table;
+		args[t][1] = ids[t];
+		pthread_create(&threads[t], NULL, intern_many, args[t]);
+	}
+	for (t = 0; t < 4; t++) {
+		pthread_join(threads[t], NULL);
+	}
+	for (t = 1; t < 4; t++) {
+		for (i = 0; i < 2000; i++) {
+			agree &= ids[t][i] == ids[0][i] && ids[t][i] != SYMBOL_NONE;
+		}
+	}
+	ok(agree, "Threads interning the same strings get the same ids");
+	uint32_t count;
+	size_t bytes;
+	symbols_usage(table, &count, &bytes);
+	iok(2002, (int) count, "Every string is stored once");
+
+	Bytecode foo = minimal_bytecode(), bar = minimal_bytecode();
+	memcpy((char *) bar.data + 13, "Bar", 3);
+	ParseOptions opts = {.flags = PARSE_ZERO_COPY, .symbols = table};
+	Class *c1 = read_class_opts(&foo, &opts);
+	Class *c2 = read_class_opts(&bar, &opts);
+	ok(c1 != NULL && c2 != NULL, "Classes parse with a symbol table");
+	Item object1 = get_item(c1, 3), object2 = get_item(c2, 3);
+	ok(object1.value.string.symbol == object2.value.string.symbol && object1.value.string.value == object2.value.string.value,
+	   "Classes share equal strings");
+	ok(get_item(c1, 1).value.string.symbol != get_item(c2, 1).value.string.symbol, "Different strings differ");
+	strok("java/lang/Object", (char *) object1.value.string.value, "Interned strings are NUL-terminated");
+	ok(detach_class(c1) && get_item(c1, 3).value.string.symbol == object1.value.string.symbol,
+	   "Detaching keeps the symbols");
+	free_class(c1);
+	free_class(c2);
+	foo.index = 0;
+	opts.flags = PARSE_LAZY_POOL;
+	c1 = read_class_opts(&foo, &opts);
+	ok(c1 != NULL && SYMBOL_NONE == get_item(c1, 3).value.string.symbol, "Lazy pools are not interned");
+	free_class(c1);
+	free((char *) foo.data);
+	free((char *) bar.data);
+	symbols_free(table);
+}
+
+/* What ordered() checks run_ordered() against: results arrive one per index, in order, on the calling thread */
+typedef struct {
+	pthread_t caller;
+	unsigned first_delay; /* microseconds index 0 takes */
+	size_t next;
+	int wrong;
+	unsigned workers_seen;
+} OrderedCheck;
+
+/* Every tenth index is slow, so later ones finish first and must wait in the reorder buffer */
+void *ordered_work(void *ctx, unsigned worker, size_t index) {
+	OrderedCheck *check = ctx;
+	__atomic_or_fetch(&check->workers_seen, 1u << worker, __ATOMIC_RELAXED);
+	if (index == 0 && check->first_delay > 0) {
+		usleep(check->first_delay);
+	} else if (index % 10 == 0) {
+		usleep(1000);
+	}
+	return (void *) (uintptr_t) (index + 1);
+}
+
+void ordered_emit(void *ctx, size_t index, void *result) {
+	OrderedCheck *check = ctx;
+	check->wrong += index != check->next || (uintptr_t) result != index + 1 ||
+	                !pthread_equal(check->caller, pthread_self());
+	check->next++;
+}
+
+void ordered() {
+	printh("Ordered workers");
+	OrderedCheck check = {.caller = pthread_self()};
+	iok(0, run_ordered(4, 1000, ordered_work, ordered_emit, &check), "Workers run");
+	ok(1000 == check.next && 0 == check.wrong, "Results of uneven tasks are emitted in index order on the caller");
+	ok(check.workers_seen & ~1u, "Tasks are shared between workers");
+
+	// more results than the reorder window holds, all held up behind the first
+	check = (OrderedCheck) {.caller = pthread_self(), .first_delay = 50000};
+	iok(0, run_ordered(2, 4 * WORKERS_WINDOW * 2, ordered_work, ordered_emit, &check), "A window's worth waits");
+	ok(4 * WORKERS_WINDOW * 2 == check.next && 0 == check.wrong, "Every result is emitted once the window drains");
+
+	check = (OrderedCheck) {.caller = pthread_self()};
+	iok(0, run_ordered(4, 0, ordered_work, ordered_emit, &check), "No tasks run");
+	iok(0, (int) check.next, "Nothing is emitted for no tasks");
+}
+
+void reader() {
+	printh("Reader");
+	// files whose contents name them, a missing file every seventh and a skipped name every eleventh, more than the
+	// buffers can hold at once so they are recycled
+	char dir[] = "/tmp/cfr-reader-XXXXXX";
+	ok(NULL != mkdtemp(dir), "Reader directory is created");
+	char paths[40][48], *names[40];
+	size_t i;
+	for (i = 0; i < 40; i++) {
+		snprintf(paths[i], sizeof(paths[i]), "%s/%zu", dir, i);
+		names[i] = i % 11 == 5 ? NULL : paths[i];
+		FILE *f = i % 7 == 3 ? NULL : fopen(paths[i], "w");
+		if (f != NULL) {
+			// the first file is empty, and the size of the rest grows with their index
+			size_t r;
+			for (r = 0; r < i; r++) {
+				fputs(paths[i], f);
+			}
+			fclose(f);
+		}
+	}
+	ReaderBackend backends[] = {READER_THREADS, READER_AUTO};
+	unsigned b;
+	for (b = 0; b < 2; b++) {
+		Reader *r = NULL;
+		ok(0 == reader_start(&r, names, 40, backends[b], 3, 4), b == 0 ? "Threads reader starts" : "Any reader starts");
+		int wrong = 0;
+		for (i = 0; i < 40; i++) {
+			Bytecode bytecode;
+			int err = reader_wait(r, i, &bytecode);
+			size_t length = strlen(paths[i]), k;
+			if (names[i] == NULL) {
+				wrong += 0 != err || NULL != bytecode.data;
+			} else if (i % 7 == 3) {
+				wrong += ENOENT != err;
+			} else {
+				wrong += 0 != err || (size_t) bytecode.length != i * length;
+				for (k = 0; 0 == err && k < i; k++) {
+					wrong += 0 != memcmp(bytecode.data + k * length, paths[i], length);
+				}
+			}
+			reader_release(r, i);
+		}
+		ok(0 == wrong, b == 0 ? "Threads read every file in order, failing the missing ones"
+		                       : "Any backend reads every file in order, failing the missing ones");
+		reader_stop(r);
+	}
+
+	// stopped with reads outstanding and none waited for
+	Reader *r = NULL;
+	int err = reader_start(&r, names, 40, READER_THREADS, 2, 2);
+	if (err == 0) {
+		reader_stop(r);
+	}
+	iok(0, err, "A reader stops with reads outstanding");
+	for (i = 0; i < 40; i++) {
+		unlink(paths[i]);
+	}
+	rmdir(dir);
+}
+
+/* Write length bytes of data to dir/name */
+void write_file(const char *dir, const char *name, const void *data, size_t length) {
+	char path[128];
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	FILE *f = fopen(path, "wb");
+	if (f != NULL) {
+		fwrite(data, 1, length, f);
+		fclose(f);
+	}
+}
+
+void classpath() {
+	printh("Classpath");
+	char dir[] = "/tmp/cfr-classpath-XXXXXX", sub[64], deeper[80];
+	ok(NULL != mkdtemp(dir), "Classpath directory is created");
+	snprintf(sub, sizeof(sub), "%s/sub", dir);
+	snprintf(deeper, sizeof(deeper), "%s/deeper", sub);
+	mkdir(sub, 0755);
+	mkdir(deeper, 0755);
+	// class files are told by their magic, not their names
+	write_file(deeper, "C.class", MINIMAL_CLASS, sizeof(MINIMAL_CLASS));
+	write_file(sub, "B.class", MINIMAL_CLASS, sizeof(MINIMAL_CLASS));
+	write_file(dir, "A.bin", MINIMAL_CLASS, sizeof(MINIMAL_CLASS));
+	write_file(dir, "notes.txt", "not a class", 11);
+	write_file(dir, "short", "\xca\xfe", 2);
+
+	char classpath[256];
+	snprintf(classpath, sizeof(classpath), "%s/:%s/lib.jar:%s/missing", dir, dir, dir);
+	Classpath cp;
+	memset(&cp, 0, sizeof(cp));
+	iok(ENOENT, classpath_scan(&cp, classpath), "A missing element is reported");
+	iok(3, (int) cp.files_count, "Class files are found in every directory below the others");
+	iok(1, (int) cp.skipped, "A file that is not a class is skipped");
+	ok(1 == cp.jars_count && 0 == strcmp(cp.jars[0] + strlen(dir), "/lib.jar"), "Archives are listed by name");
+	int ordered = 1, found = 0;
+	size_t i;
+	for (i = 0; i < cp.files_count; i++) {
+		struct stat st;
+		ordered &= 0 == stat(cp.files[i].path, &st) && st.st_ino == cp.files[i].inode &&
+		           (uint64_t) st.st_size == cp.files[i].size && (i == 0 || cp.files[i - 1].inode <= cp.files[i].inode);
+		found += 0 == strcmp(cp.files[i].path + strlen(dir), "/sub/deeper/C.class") ||
+		         0 == strcmp(cp.files[i].path + strlen(dir), "/A.bin");
+	}
+	ok(ordered, "Files are ordered by inode");
+	iok(2, found, "Paths join the element without its trailing slash");
+	classpath_free(&cp);
+	ok(NULL == cp.files && 0 == cp.files_count, "Freed classpath is empty");
+
+	const char *names[] = {"sub/deeper/C.class", "sub/B.class", "A.bin", "notes.txt", "short", "sub/deeper", "sub"};
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		char path[128];
+		snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+		remove(path);
+	}
+	rmdir(dir);
+}
+
+void test_inflate() {
+	printh("Inflate");
+	const uint8_t fixed[] = {0xcb, 0x48, 0xcd, 0xc9, 0xc9, 0x57, 0xc8, 0x40, 0x90, 0x00};
+	const uint8_t stored[] = {0x01, 0x03, 0x00, 0xfc, 0xff, 0x61, 0x62, 0x63};
+	uint8_t out[18] = {0};
+	ok(0 == inflate_raw(out, 17, fixed, sizeof(fixed)), "Fixed Huffman block inflates");
+	strok("hello hello hello", (char *) out, "Fixed Huffman block content");
+	memset(out, 0, sizeof(out));
+	ok(0 == inflate_raw(out, 3, stored, sizeof(stored)), "Stored block inflates");
+	strok("abc", (char *) out, "Stored block content");
+	ok(EOVERFLOW == inflate_raw(out, 2, stored, sizeof(stored)), "Output larger than expected is rejected");
+	ok(EINVAL == inflate_raw(out, 17, fixed, 4), "Truncated input is rejected");
+}
+
+void output() {
+	printh("Output");
+	Output out;
+	ok(output_init(&out, -1, 4), "Output initialises in memory");
+	output_uint(&out, 0);
+	output_char(&out, ' ');
+	output_uint(&out, UINT64_MAX);
+	output_char(&out, ' ');
+	output_int(&out, INT64_MIN);
+	output_char(&out, ' ');
+	output_hex(&out, 0x21);
+	output_char(&out, ' ');
+	output_double(&out, 1.5);
+	output_char(&out, '\0');
+	strok("0 18446744073709551615 -9223372036854775808 21 1.500000", out.data, "Numbers format as printf would");
+	ok(out.capacity >= out.length, "Output grew to fit");
+
+	char *data = NULL, *taken;
+	size_t length, capacity = 0;
+	output_take(&out, &data, &length, &capacity);
+	ok(0 == out.length && out.data != NULL && 56 == length && capacity >= length, "Output starts over after a take");
+	taken = data;
+	output_take(&out, &data, &length, &capacity);
+	ok(out.data == taken && 0 == out.length, "A buffer handed back is written into again");
+	free(data);
+
+	Bytecode bytecode = minimal_bytecode();
+	Class *c = read_class(&bytecode);
+	output_class(&out, c);
+	output_char(&out, '\0');
+	ok(NULL != strstr(out.data, "Access flags: 21\nThis class: Foo\nSuper class: java/lang/Object\n"), "Class header is printed");
+	ok(NULL != strstr(out.data, "Attribute name: SourceFile"), "Class attribute is printed");
+	free_class(c);
+	free((char *) bytecode.data);
+	output_free(&out);
+}
+
+void json() {
+	printh("JSON");
+	Output out;
+	output_init(&out, -1, 64);
+	const char mutf8[] = "a\"\\\n\x01\xc0\x80\xc3\xa9\xed\xa0\xbd\xed\xb8\x80\xed\xa0\x80\xff";
+	output_json_string(&out, mutf8, sizeof(mutf8) - 1);
+	output_char(&out, '\0');
+	strok("\"a\\\"\\\\\\n\\u0001\\u0000\xc3\xa9\xf0\x9f\x98\x80\\ud800\xef\xbf\xbd\"", out.data,
+		"Modified UTF-8 is escaped to standard UTF-8");
+	out.length = 0;
+
+	Bytecode bytecode = minimal_bytecode();
+	Class *c = read_class(&bytecode);
+	output_json_class(&out, c, "foo.jar", "Foo.class", 9);
+	output_char(&out, '\0');
+	const char *head = "{\"file\":\"foo.jar!/Foo.class\",\"minor_version\":0,\"major_version\":51,";
+	ok(0 == strncmp(out.data, head, strlen(head)), "Object starts with the file and versions");
+	ok(NULL != strstr(out.data, "\"this_class\":\"Foo\",\"super_class\":\"java/lang/Object\",\"interfaces\":[]"),
+		"Class names are resolved");
+	ok(NULL != strstr(out.data, "\"attributes\":[{\"name\":\"SourceFile\",\"length\":2}]}"), "Object ends with the class attributes");
+	free_class(c);
+	out.length = 0;
+
+	// this_class names a UTF-8 entry rather than a Class, super_class is past the pool
+	char *data = (char *) bytecode.data;
+	data[68] = 0x01;
+	data[70] = 0x63;
+	bytecode.index = 0;
+	c = read_class(&bytecode);
+	output_json_class(&out, c, "Foo.class", NULL, 0);
+	output_char(&out, '\0');
+	ok(NULL != strstr(out.data, "\"this_class\":null,\"super_class\":null,\"interfaces\":[]"),
+		"Names of bad class entries are null");
+	free_class(c);
+	free(data);
+	out.length = 0;
+
+	// Foo with a Long -2 and a Double 2.5 in its pool
+	static const unsigned char NUMBERS_CLASS[] = {
+		0xca, 0xfe, 0xba, 0xbe, 0x00, 0x00, 0x00, 0x33, 0x00, 0x09,
+		0x01, 0x00, 0x03, 'F', 'o', 'o',
+		0x07, 0x00, 0x01,
+		0x05, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe,
+		0x06, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x01, 0x00, 0x10, 'j', 'a', 'v', 'a', '/', 'l', 'a', 'n', 'g', '/', 'O', 'b', 'j', 'e', 'c', 't',
+		0x07, 0x00, 0x07,
+		0x00, 0x21, 0x00, 0x02, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+	};
+	bytecode = (Bytecode) {.data = (const char *) NUMBERS_CLASS, .length = sizeof(NUMBERS_CLASS), .index = 0};
+	c = read_class(&bytecode);
+	ok(c != NULL && -2 == to_long(get_item(c, 3).value.lng) && 2.5 == to_double(get_item(c, 5).value.dbl),
+		"Long and Double entries convert to their values");
+	output_json_class(&out, c, "Foo.class", NULL, 0);
+	output_char(&out, '\0');
+	ok(NULL != strstr(out.data, "{\"index\":3,\"tag\":\"Long\",\"value\":-2},{\"index\":5,\"tag\":\"Double\",\"value\":2.5}"),
+		"Long and Double values are written as numbers");
+	free_class(c);
+	output_free(&out);
+}
+
+void export() {
+	printh("Export");
+	Output out;
+	output_init(&out, -1, 64);
+	Bytecode bytecode = minimal_bytecode();
+	Class *c = read_class(&bytecode);
+	export_encode_class(&out, c, "Foo.class", NULL, 0);
+	export_encode_error(&out, "Bar.class", NULL, 0, "not a valid class file");
+	Exporter *exporter = export_create();
+	ok(exporter != NULL, "Exporter is created");
+	ok(export_rows(exporter, out.data, out.length), "Encoded rows are appended");
+
+	// the classes row is 1 + 13 + 7 + 20 bytes of table and strings then 8 u16s; cut anywhere it must not be read past
+	Exporter *cut = export_create();
+	int rejected = 1;
+	size_t length;
+	for (length = 1; length < 57; length++) {
+		char *prefix = malloc(length);
+		memcpy(prefix, out.data, length);
+		rejected &= !export_rows(cut, prefix, length);
+		free(prefix);
+	}
+	ok(rejected && export_rows(cut, out.data, 57), "Rows cut short are rejected");
+	export_free(cut);
+
+	char dir[] = "/tmp/cfr-export-XXXXXX";
+	ok(NULL != mkdtemp(dir), "Export directory is created");
+	ok(0 == export_write(exporter, dir), "Tables are written");
+	char path[64];
+	snprintf(path, sizeof(path), "%s/classes.cfrc", dir);
+	FILE *f = fopen(path, "rb");
+	char header[24] = {0};
+	ok(f != NULL && sizeof(header) == fread(header, 1, sizeof(header), f), "Classes table is readable");
+	ok(0 == memcmp(header, "CFRCOL\0\1", 8), "Classes table starts with the magic");
+	ok(12 == header[8] && 1 == header[16], "Classes table has 12 columns and 1 row");
+	if (f != NULL) {
+		fclose(f);
+	}
+	export_free(exporter);
+
+	// columns of 4-byte string ids larger than the file's write buffer, and not a multiple of 8 bytes long
+	exporter = export_create();
+	output_free(&out);
+	output_init(&out, -1, 64);
+	uint32_t rows = OUTPUT_BUFFER / 4 + 1, r;
+	for (r = 0; r < rows; r++) {
+		export_encode_error(&out, "Bar.class", NULL, 0, "not a valid class file");
+	}
+	export_rows(exporter, out.data, out.length);
+	ok(0 == export_write(exporter, dir), "Tables with large columns are written");
+	snprintf(path, sizeof(path), "%s/errors.cfrc", dir);
+	f = fopen(path, "rb");
+	uint64_t lengths[2] = {0, 0};
+	long end = 0;
+	if (f != NULL) {
+		// the header and two column descriptors, "file" and "error", pad to 40 bytes
+		fseek(f, 40, SEEK_SET);
+		int column;
+		for (column = 0; column < 2 && 1 == fread(&lengths[column], 8, 1, f); column++) {
+			fseek(f, (long) ((lengths[column] + 7) / 8 * 8), SEEK_CUR);
+		}
+		end = ftell(f);
+		fseek(f, 0, SEEK_END);
+		end -= ftell(f);
+		fclose(f);
+	}
+	ok(4 * (uint64_t) rows == lengths[0] && 4 * (uint64_t) rows == lengths[1] && 0 == end,
+	   "Columns larger than the buffer stay aligned");
+
+	const char *tables[] = {"classes", "fields", "methods", "attributes", "refs", "errors", "strings"};
+	unsigned t;
+	for (t = 0; t < sizeof(tables) / sizeof(tables[0]); t++) {
+		snprintf(path, sizeof(path), "%s/%s.cfrc", dir, tables[t]);
+		unlink(path);
+	}
+	rmdir(dir);
+	export_free(exporter);
+	free_class(c);
+	free((char *) bytecode.data);
+	output_free(&out);
+}
+
+/* An allocator that counts what is live and refuses to hand out more than limit blocks */
+typedef struct {
+	int live;
+	int limit;
+} Counted;
+
+void *counted_alloc(void *ctx, size_t size) {
+	Counted *counted = ctx;
+	if (counted->limit-- <= 0) {
+		return NULL;
+	}
+	counted->live++;
+	return malloc(size);
+}
+
+void counted_free(void *ctx, void *ptr) {
+	((Counted *) ctx)->live--;
+	free(ptr);
+}
+
+void library() {
+	printh("Library");
+	iok(CFR_API_VERSION, cfr_api_version(), "Library is the version of its header");
+	CfrClass *cls = NULL;
+	iok(CFR_OK, cfr_open_buffer(&cls, MINIMAL_CLASS, sizeof(MINIMAL_CLASS), NULL), "Buffer opens");
+	CfrString name;
+	ok(CFR_OK == cfr_name(cls, &name) && 3 == name.length && 0 == memcmp("Foo", name.data, 3), "Name is Foo");
+	ok(CFR_OK == cfr_super_name(cls, &name) && 16 == name.length, "Super is java/lang/Object");
+	iok(51, cfr_major_version(cls), "Major version is 51");
+	CfrAttribute attribute;
+	ok(CFR_OK == cfr_attribute(cls, CFR_OWNER_CLASS, 0, 0, &attribute) && 2 == attribute.length
+	   && 10 == attribute.name.length, "Class attribute is SourceFile");
+	iok(CFR_ERR_ARGUMENT, cfr_attribute(cls, CFR_OWNER_FIELD, 0, 0, &attribute), "Missing field is an argument error");
+	CfrConstant constant;
+	ok(CFR_OK == cfr_constant(cls, 2, &constant) && 7 == constant.tag && 1 == constant.value.ref.first,
+	   "Constant 2 is Class #1");
+	iok(CFR_ERR_ARGUMENT, cfr_constant(cls, 7, &constant), "Constant past the pool is an argument error");
+	cfr_free(cls);
+
+	iok(CFR_ERR_NOT_CLASS, cfr_open_buffer(&cls, "\xca\xfe", 2, NULL), "Short input is not a class");
+	ok(cls == NULL, "Failed open leaves no handle");
+	iok(CFR_ERR_TRUNCATED, cfr_open_buffer(&cls, MINIMAL_CLASS, 8, NULL), "Input cut off in the header is truncated");
+	CfrOptions strict = {.flags = CFR_STRICT};
+	iok(CFR_OK, cfr_open_buffer(&cls, MINIMAL_CLASS, sizeof(MINIMAL_CLASS), &strict), "Well-formed class opens strictly");
+	cfr_free(cls);
+	iok(CFR_ERR_TRUNCATED, cfr_open_buffer(&cls, MINIMAL_CLASS, sizeof(MINIMAL_CLASS) - 1, NULL),
+	    "Input cut off in an attribute is truncated");
+
+	Counted counted = {0, 100};
+	CfrAllocator allocator = {counted_alloc, counted_free, &counted};
+	CfrOptions opts = {.flags = CFR_BORROW, .allocator = &allocator};
+	iok(CFR_OK, cfr_open_buffer(&cls, MINIMAL_CLASS, sizeof(MINIMAL_CLASS), &opts), "Buffer opens with an allocator");
+	ok(counted.live > 0, "Allocator supplied the memory");
+	ok(CFR_OK == cfr_attribute(cls, CFR_OWNER_CLASS, 0, 0, &attribute)
+	   && attribute.data == MINIMAL_CLASS + sizeof(MINIMAL_CLASS) - 2, "Borrowed payloads view the buffer");
+	cfr_free(cls);
+	iok(0, counted.live, "Everything allocated is freed");
+	counted.limit = 1;
+	iok(CFR_ERR_NOMEM, cfr_open_buffer(&cls, MINIMAL_CLASS, sizeof(MINIMAL_CLASS), &opts), "Refused memory is reported");
+	iok(0, counted.live, "Nothing leaks when memory runs out");
+
+	char path[] = "/tmp/cfr-library-XXXXXX";
+	int fd = mkstemp(path);
+	ok(fd >= 0 && sizeof(MINIMAL_CLASS) == write(fd, MINIMAL_CLASS, sizeof(MINIMAL_CLASS)), "Class file is written");
+	iok(CFR_OK, cfr_open_fd(&cls, fd, NULL), "Descriptor opens");
+	close(fd);
+	unlink(path);
+	ok(CFR_OK == cfr_name(cls, &name) && 0 == memcmp("Foo", name.data, 3), "Name survives closing the descriptor");
+	cfr_free(cls);
+}
+
 /* Print a pretty test header so we can distinguish results */
 void printh(const char *test_name) {
 	printf("#####################\n");